@@ -0,0 +1,641 @@
+#include "Bench.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const unsigned long SECOND = 1000000UL;
+const size_t MAX_EVENTS = 256;
+const size_t READ_SIZE = 65536;
+const size_t FLOOD_LOW_WATER = 16384;    /* refill a flooder below this much unsent */
+const size_t STALL_LIMIT = 256 * 1024;   /* unsent bytes after which a paced client skips a send */
+const int FLOOD_BATCH_LINES = 32;
+
+unsigned long toUs(double seconds) {
+    return seconds > 0 ? static_cast<unsigned long>(seconds * SECOND) : 0;
+}
+
+double toSeconds(unsigned long us) {
+    return static_cast<double>(us) / SECOND;
+}
+
+std::string channelName(int channel) {
+    std::ostringstream oss;
+    oss << "#bench" << channel;
+    return oss.str();
+}
+
+/* Finds `needle` in a line that is not NUL-terminated. */
+const char* find(const char* data, size_t length, const char* needle) {
+    size_t n = strlen(needle);
+    for (size_t i = 0; i + n <= length; ++i) {
+        if (memcmp(data + i, needle, n) == 0)
+            return data + i;
+    }
+    return NULL;
+}
+
+bool startsWith(const LineView& line, const std::string& prefix) {
+    return line.length >= prefix.size() && memcmp(line.data, prefix.data(), prefix.size()) == 0;
+}
+
+void writeString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char ch = value[i];
+        if (ch == '"' || ch == '\\')
+            out << '\\' << ch;
+        else if (ch < 0x20)
+            out << ' ';
+        else
+            out << ch;
+    }
+    out << '"';
+}
+
+}
+
+BenchOptions::BenchOptions()
+    : scenario("load"), host("127.0.0.1"), port(6667), password("jopa"), clients(1000), channels(10), flooders(0),
+      rate(1), privatePercent(10), payload(64), connectWindow(64), connectRate(0), setupTimeout(30),
+      warmup(1), duration(10), drain(2), seed(1) {}
+
+Bench::Connection::Connection()
+    : fd(-1), state(IDLE), flooder(false), generation(0), channel(0), outPos(0), wantWrite(false), started(0) {}
+
+Bench::Bench(const BenchOptions& opts)
+    : options(opts), epollFd(-1), connections(opts.clients + opts.flooders), channelMembers(opts.channels, 0),
+      padding(opts.payload, 'x'), random(opts.seed ? opts.seed : 1), opened(0), inFlight(0), connected(0), joined(0),
+      failed(0), setupStart(0), connectEnd(0), setupEnd(0), loadStart(0), measureStart(0), measureEnd(0), sending(false), sent(0),
+      expected(0), delivered(0), received(0), floodBytes(0), stalls(0), disconnects(0), errorLines(0), reconnects(0),
+      rejoined(0), churnFailed(0) {
+    for (size_t i = 0; i < connections.size(); ++i) {
+        Connection& c = connections[i];
+        int index = static_cast<int>(i);
+        c.flooder = index >= options.clients;
+        c.channel = (c.flooder ? index - options.clients : index) % options.channels;
+        setNick(c, index);
+    }
+}
+
+void Bench::setNick(Connection& c, int index) {
+    std::ostringstream nick;
+    nick << (c.flooder ? "f" : c.generation % 2 ? "r" : "b") << (c.flooder ? index - options.clients : index);
+    c.nick = nick.str();
+}
+
+Bench::~Bench() {
+    closeAll();
+    if (epollFd != -1)
+        close(epollFd);
+}
+
+bool Bench::run() {
+    if (!raiseFdLimit())
+        return false;
+    epollFd = epoll_create(1024);
+    if (epollFd < 0) {
+        std::cerr << "ircbench: epoll_create: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int total = static_cast<int>(connections.size());
+    if (options.scenario == "storm")
+        options.connectWindow = total;
+    setupStart = nowUs();
+    connectEnd = setupStart;
+    setupEnd = setupStart;
+    unsigned long deadline = setupStart + toUs(options.setupTimeout);
+    unsigned long now = setupStart;
+    while (joined + failed < total && now < deadline) {
+        openConnections(now);
+        /* with a connect rate, wake up for the next slot */
+        poll(options.connectRate > 0 && opened < total ? 1 : waitFor(deadline, now));
+        now = nowUs();
+    }
+    for (size_t i = 0; i < connections.size(); ++i) {
+        Connection& c = connections[i];
+        if (c.state == IDLE) {
+            c.state = CLOSED;
+            ++failed;
+        } else if (c.state == CONNECTING || c.state == REGISTERING) {
+            closeConnection(c);
+        }
+    }
+    std::cerr << "ircbench: " << connected << "/" << total << " connected in "
+              << toSeconds(connectEnd - setupStart) << " s, " << joined << " joined in "
+              << toSeconds(setupEnd - setupStart) << " s" << std::endl;
+    if (joined == 0 || options.scenario == "storm")
+        return true;
+
+    startLoad();
+    now = nowUs();
+    while (now < measureEnd) {
+        sendDue(now);
+        poll(waitFor(measureEnd, now));
+        now = nowUs();
+    }
+    sending = false;
+    deadline = now + toUs(options.drain);
+    while ((delivered < expected || inFlight > 0) && now < deadline) {
+        poll(waitFor(deadline, now));
+        now = nowUs();
+    }
+    if (options.scenario == "churn")
+        std::cerr << "ircbench: " << rejoined << "/" << reconnects << " measured reconnects joined again" << std::endl;
+    else
+        std::cerr << "ircbench: " << delivered << "/" << expected << " measured deliveries arrived" << std::endl;
+    closeAll();
+    return true;
+}
+
+unsigned long Bench::nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * SECOND + static_cast<unsigned long>(ts.tv_nsec) / 1000UL;
+}
+
+/* xorshift64: the same seed gives the same targets and send phases. */
+unsigned long Bench::nextRandom() {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    return random;
+}
+
+/* Thousands of sockets need more than the usual soft limit of 1024. */
+bool Bench::raiseFdLimit() {
+    rlim_t need = connections.size() + 16;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+        return true;
+    if (limit.rlim_cur >= need)
+        return true;
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < need) {
+        std::cerr << "ircbench: " << connections.size() << " connections need " << need
+                  << " descriptors, the hard limit is " << limit.rlim_max << std::endl;
+        return false;
+    }
+    limit.rlim_cur = need;
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        std::cerr << "ircbench: setrlimit: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* Keeps at most connectWindow handshakes going, and under connectRate. */
+void Bench::openConnections(unsigned long now) {
+    int total = static_cast<int>(connections.size());
+    int allowed = total;
+    if (options.connectRate > 0) {
+        allowed = static_cast<int>(toSeconds(now - setupStart) * options.connectRate) + 1;
+        if (allowed > total)
+            allowed = total;
+    }
+    while (opened < allowed && inFlight < options.connectWindow) {
+        if (!openConnection(opened++))
+            ++failed;
+    }
+}
+
+bool Bench::openConnection(int index) {
+    Connection& c = connections[index];
+    c.state = CLOSED;
+    c.started = nowUs();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "ircbench: bad address " << options.host << std::endl;
+        return false;
+    }
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c.fd < 0)
+        return false;
+    int on = 1; // Timestamps are taken at write(); Nagle would hold them back
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.u32 = index;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, c.fd, &event) < 0) {
+        close(c.fd);
+        c.fd = -1;
+        return false;
+    }
+    if (connect(c.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(c.fd);
+        c.fd = -1;
+        return false;
+    }
+    c.wantWrite = true;
+    c.state = CONNECTING;
+    ++inFlight;
+    return true;
+}
+
+void Bench::poll(int timeoutMs) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+    for (int i = 0; i < count; ++i)
+        handleEvent(events[i].data.u32, events[i].events);
+}
+
+void Bench::handleEvent(int index, unsigned events) {
+    Connection& c = connections[index];
+    if (c.state == CLOSED)
+        return;
+    if (c.state == CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+            closeConnection(c);
+            return;
+        }
+        if (c.generation == 0) {
+            unsigned long now = nowUs();
+            ++connected;
+            connectLatency.record(now - c.started);
+            connectEnd = now;
+        }
+        handleConnected(c);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        handleReadable(c);
+    if (c.state != CLOSED && (events & EPOLLOUT))
+        flush(c);
+}
+
+/* PASS, NICK, USER and JOIN go out together; the JOIN coming back ends the setup. */
+void Bench::handleConnected(Connection& c) {
+    c.state = REGISTERING;
+    queue(c, "PASS :" + options.password + "\r\nNICK " + c.nick + "\r\nUSER bench 0 * :ircbench\r\nJOIN "
+                 + channelName(c.channel) + "\r\n");
+}
+
+void Bench::handleReadable(Connection& c) {
+    char buffer[READ_SIZE];
+    while (c.state != CLOSED) {
+        ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            closeConnection(c);
+            return;
+        }
+        unsigned long now = nowUs();
+        c.framer.feed(buffer, n);
+        LineView line;
+        while (c.state != CLOSED && c.framer.next(line))
+            handleLine(c, line, now);
+    }
+}
+
+void Bench::handleLine(Connection& c, const LineView& line, unsigned long now) {
+    static const std::string ping("PING");
+    static const std::string error("ERROR");
+    if (startsWith(line, ping)) {
+        queue(c, "PONG" + std::string(line.data + ping.size(), line.length - ping.size()) + "\r\n");
+        return;
+    }
+    if (startsWith(line, error)) {
+        ++errorLines;
+        return;
+    }
+    const char* command = find(line.data, line.length, " PRIVMSG ");
+    if (command) {
+        const char* end = line.data + line.length;
+        const char* text = find(command, end - command, " :");
+        if (text)
+            handleMessage(text + 2, end - text - 2, now);
+        return;
+    }
+    if (c.state != REGISTERING)
+        return;
+    if (startsWith(line, ":" + c.nick + "!") && find(line.data, line.length, " JOIN ")) {
+        c.state = JOINED;
+        --inFlight;
+        ++channelMembers[c.channel];
+        if (c.generation == 0) {
+            ++joined;
+            setupLatency.record(now - c.started);
+            setupEnd = now;
+            return;
+        }
+        if (c.started >= measureStart && c.started < measureEnd) {
+            ++rejoined;
+            latency.record(now - c.started);
+        }
+        if (sending)
+            schedule.push(Send(now + toUs(1.0 / options.rate), static_cast<int>(&c - &connections[0])));
+        return;
+    }
+    /* ":server 464 ...": an error numeric during registration, e.g. a wrong password */
+    const char* space = static_cast<const char*>(memchr(line.data, ' ', line.length));
+    if (space && space + 4 < line.data + line.length && (space[1] == '4' || space[1] == '5') && space[4] == ' ') {
+        if (failed == 0)
+            std::cerr << "ircbench: " << c.nick << ": " << std::string(line.data, line.length) << std::endl;
+        closeConnection(c);
+    }
+}
+
+/* Timed texts are "T<send time in us>" and padding; flood texts start with "F". */
+void Bench::handleMessage(const char* text, size_t length, unsigned long now) {
+    ++received;
+    if (length < 2 || text[0] != 'T')
+        return;
+    unsigned long sentAt = 0;
+    for (size_t i = 1; i < length && text[i] >= '0' && text[i] <= '9'; ++i)
+        sentAt = sentAt * 10 + (text[i] - '0');
+    if (sentAt < measureStart || sentAt >= measureEnd)
+        return;
+    ++delivered;
+    latency.record(now > sentAt ? now - sentAt : 0);
+}
+
+void Bench::queue(Connection& c, const std::string& data) {
+    c.out += data;
+    flush(c);
+}
+
+/* A flooder is topped up here whenever it runs low, and keeps write interest
+   for as long as the load runs, so it writes exactly as fast as the socket
+   drains. */
+void Bench::flush(Connection& c) {
+    bool flooding = c.flooder && sending && c.state == JOINED;
+    for (;;) {
+        if (flooding && c.out.size() - c.outPos < FLOOD_LOW_WATER)
+            c.out += floodBatches[c.channel];
+        if (c.outPos == c.out.size())
+            break;
+        ssize_t n = send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0) {
+            closeConnection(c);
+            return;
+        }
+        c.outPos += n;
+        if (c.flooder && sending)
+            floodBytes += n;
+    }
+    if (c.outPos == c.out.size()) {
+        c.out.clear();
+        c.outPos = 0;
+    } else if (c.outPos > c.out.size() / 2) {
+        c.out.erase(0, c.outPos);
+        c.outPos = 0;
+    }
+    bool want = !c.out.empty() || flooding;
+    if (want == c.wantWrite)
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = want ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u32 = static_cast<unsigned>(&c - &connections[0]);
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &event) == 0)
+        c.wantWrite = want;
+}
+
+/* A connection lost before its JOIN came back counts as failed, or as a
+   failed reconnect, one lost afterwards as a disconnect. */
+void Bench::closeConnection(Connection& c) {
+    if (c.state == CONNECTING || c.state == REGISTERING) {
+        --inFlight;
+        ++(c.generation > 0 ? churnFailed : failed);
+    } else if (c.state == JOINED) {
+        ++disconnects;
+        --channelMembers[c.channel];
+    }
+    if (c.fd != -1)
+        close(c.fd);
+    c.fd = -1;
+    c.state = CLOSED;
+    c.out.clear();
+    c.outPos = 0;
+}
+
+void Bench::closeAll() {
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i].fd != -1)
+            close(connections[i].fd);
+        connections[i].fd = -1;
+        connections[i].state = CLOSED;
+    }
+}
+
+/* Paced clients start at random points of their first interval so the
+   load is spread evenly instead of arriving in waves. */
+void Bench::startLoad() {
+    loadStart = nowUs();
+    measureStart = loadStart + toUs(options.warmup);
+    measureEnd = measureStart + toUs(options.duration);
+    sending = true;
+    unsigned long interval = options.rate > 0 ? toUs(1.0 / options.rate) : 0;
+    if (interval == 0)
+        interval = 1;
+    for (int i = 0; i < options.clients; ++i) {
+        if (connections[i].state == JOINED && options.rate > 0)
+            schedule.push(Send(loadStart + nextRandom() % interval, i));
+    }
+    floodBatches.resize(options.channels);
+    for (int ch = 0; ch < options.channels; ++ch) {
+        std::string line = "PRIVMSG " + channelName(ch) + " :F" + padding + "\r\n";
+        for (int i = 0; i < FLOOD_BATCH_LINES; ++i)
+            floodBatches[ch] += line;
+    }
+    startFlooders();
+}
+
+void Bench::sendDue(unsigned long now) {
+    unsigned long interval = toUs(1.0 / options.rate);
+    while (!schedule.empty() && schedule.top().first <= now) {
+        Send due = schedule.top();
+        schedule.pop();
+        if (options.scenario == "churn") {
+            reconnect(due.second, now); // rescheduled when its JOIN comes back
+            continue;
+        }
+        sendTimed(due.second, now);
+        /* keep the rate even when a send was late, unless it fell far behind */
+        unsigned long next = due.first + interval;
+        if (next + SECOND < now)
+            next = now + interval;
+        if (connections[due.second].state == JOINED)
+            schedule.push(Send(next, due.second));
+    }
+}
+
+void Bench::sendTimed(int index, unsigned long now) {
+    Connection& c = connections[index];
+    if (c.state != JOINED)
+        return;
+    if (c.out.size() - c.outPos > STALL_LIMIT) {
+        ++stalls;
+        return;
+    }
+    std::string target;
+    unsigned long recipients = 0;
+    if (options.privatePercent > 0 && static_cast<int>(nextRandom() % 100) < options.privatePercent) {
+        int other = static_cast<int>(nextRandom() % options.clients);
+        if (other != index && connections[other].state == JOINED) {
+            target = connections[other].nick;
+            recipients = 1;
+        }
+    }
+    if (target.empty()) {
+        target = channelName(c.channel);
+        recipients = channelMembers[c.channel] - 1;
+    }
+    std::ostringstream line;
+    line << "PRIVMSG " << target << " :T" << now << ' ';
+    std::string text = line.str();
+    size_t header = text.size() - (8 + target.size() + 2);
+    if (header < padding.size())
+        text.append(padding, 0, padding.size() - header);
+    text += "\r\n";
+    if (now >= measureStart && now < measureEnd) {
+        ++sent;
+        expected += recipients;
+    }
+    queue(c, text);
+}
+
+/* Leaves with a QUIT and starts over under the other nick. The next
+   reconnect is only scheduled once this one has joined, so a server that
+   falls behind gets fewer of them instead of a growing backlog. */
+void Bench::reconnect(int index, unsigned long now) {
+    Connection& c = connections[index];
+    if (c.state != JOINED)
+        return;
+    static const char quit[] = "QUIT :churn\r\n";
+    send(c.fd, quit, sizeof(quit) - 1, MSG_NOSIGNAL);
+    close(c.fd);
+    c.fd = -1;
+    c.state = CLOSED;
+    --channelMembers[c.channel];
+    c.out.clear();
+    c.outPos = 0;
+    c.framer = LineFramer();
+    ++c.generation;
+    setNick(c, index);
+    if (now >= measureStart && now < measureEnd)
+        ++reconnects;
+    if (!openConnection(index))
+        ++churnFailed;
+}
+
+void Bench::startFlooders() {
+    for (size_t i = options.clients; i < connections.size(); ++i) {
+        if (connections[i].state == JOINED)
+            flush(connections[i]);
+    }
+}
+
+/* Milliseconds until `deadline` or the next scheduled send, whichever is first. */
+int Bench::waitFor(unsigned long deadline, unsigned long now) const {
+    if (!schedule.empty() && sending && schedule.top().first < deadline)
+        deadline = schedule.top().first;
+    if (deadline <= now)
+        return 0;
+    unsigned long ms = (deadline - now + 999) / 1000;
+    return ms > 100 ? 100 : static_cast<int>(ms);
+}
+
+void Bench::writeHistogram(std::ostream& out, const LatencyHistogram& histogram) {
+    out << "{\"count\": " << histogram.count()
+        << ", \"min\": " << histogram.min()
+        << ", \"mean\": " << static_cast<unsigned long>(histogram.mean() + 0.5)
+        << ", \"p50\": " << histogram.percentile(50)
+        << ", \"p90\": " << histogram.percentile(90)
+        << ", \"p99\": " << histogram.percentile(99)
+        << ", \"p99_9\": " << histogram.percentile(99.9)
+        << ", \"max\": " << histogram.max() << "}";
+}
+
+void Bench::writeJson(std::ostream& out) const {
+    double setupSeconds = toSeconds(setupEnd - setupStart);
+    double measured = toSeconds(measureEnd - measureStart);
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(3);
+    json << "{\n  \"options\": {\"scenario\": ";
+    writeString(json, options.scenario);
+    json << ", \"host\": ";
+    writeString(json, options.host);
+    json << ", \"port\": " << options.port
+         << ", \"clients\": " << options.clients
+         << ", \"channels\": " << options.channels
+         << ", \"flooders\": " << options.flooders
+         << ", \"rate\": " << options.rate
+         << ", \"private_percent\": " << options.privatePercent
+         << ", \"payload\": " << options.payload
+         << ", \"connect_window\": " << options.connectWindow
+         << ", \"connect_rate\": " << options.connectRate
+         << ", \"warmup\": " << options.warmup
+         << ", \"duration\": " << options.duration
+         << ", \"seed\": " << options.seed << "},\n";
+    double connectSeconds = toSeconds(connectEnd - setupStart);
+    json << "  \"setup\": {\"connections\": " << connections.size()
+         << ", \"connected\": " << connected
+         << ", \"connect_seconds\": " << connectSeconds
+         << ", \"connect_per_sec\": " << (connectSeconds > 0 ? connected / connectSeconds : 0)
+         << ", \"connect_latency_us\": ";
+    writeHistogram(json, connectLatency);
+    json << ", \"joined\": " << joined
+         << ", \"failed\": " << failed
+         << ", \"seconds\": " << setupSeconds
+         << ", \"per_sec\": " << (setupSeconds > 0 ? joined / setupSeconds : 0)
+         << ", \"latency_us\": ";
+    writeHistogram(json, setupLatency);
+    if (options.scenario == "storm") {
+        json << "}\n}\n";
+        out << json.str();
+        return;
+    }
+    json << "},\n";
+    if (options.scenario == "churn") {
+        json << "  \"churn\": {\"seconds\": " << measured
+             << ", \"reconnects\": " << reconnects
+             << ", \"rejoined\": " << rejoined
+             << ", \"per_sec\": " << (measured > 0 ? rejoined / measured : 0)
+             << ", \"failed\": " << churnFailed
+             << ", \"disconnects\": " << disconnects
+             << ", \"error_lines\": " << errorLines << "},\n";
+        json << "  \"latency_us\": ";
+        writeHistogram(json, latency);
+        json << "\n}\n";
+        out << json.str();
+        return;
+    }
+    json << "  \"load\": {\"seconds\": " << measured
+         << ", \"sent\": " << sent
+         << ", \"sent_per_sec\": " << (measured > 0 ? sent / measured : 0)
+         << ", \"expected\": " << expected
+         << ", \"delivered\": " << delivered
+         << ", \"delivered_per_sec\": " << (measured > 0 ? delivered / measured : 0)
+         << ", \"lost\": " << (expected > delivered ? expected - delivered : 0)
+         << ", \"received_total\": " << received
+         << ", \"flood_bytes\": " << floodBytes
+         << ", \"stalls\": " << stalls
+         << ", \"disconnects\": " << disconnects
+         << ", \"error_lines\": " << errorLines << "},\n";
+    json << "  \"latency_us\": ";
+    writeHistogram(json, latency);
+    json << "\n}\n";
+    out << json.str();
+}
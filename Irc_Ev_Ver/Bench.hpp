@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <ostream>
+#include "LineFramer.hpp"
+#include "LatencyHistogram.hpp"
+
+/* What ircbench runs; every field has a command line flag, see ircbench.cpp. */
+struct BenchOptions {
+    std::string scenario; /* "load"; "storm": every connection at once, no load phase; "churn": reconnects instead of messages */
+    std::string host;
+    int port;
+    std::string password;
+    int clients;          /* paced clients, spread over `channels` */
+    int channels;
+    int flooders;         /* extra clients that write PRIVMSGs as fast as the socket takes them */
+    double rate;          /* PRIVMSGs per second per paced client, or reconnects in "churn" */
+    int privatePercent;   /* share of them sent to another client instead of the channel */
+    int payload;          /* bytes of message text, timestamp included */
+    int connectWindow;    /* connections allowed between connect() and the JOIN coming back */
+    double connectRate;   /* new connections per second, 0 as fast as the window allows */
+    double setupTimeout;  /* seconds for every client to get through PASS/NICK/USER/JOIN */
+    double warmup;        /* seconds of load before latencies are recorded */
+    double duration;      /* seconds of load that are measured */
+    double drain;         /* seconds to wait for messages still in flight */
+    unsigned long seed;
+
+    BenchOptions();
+};
+
+/* Client simulator: one thread, one epoll, non-blocking loopback sockets.
+   Every connection registers and joins its channel, then paced clients
+   send PRIVMSGs carrying their send time (CLOCK_MONOTONIC, microseconds),
+   and whoever receives one records the end-to-end latency.
+   The "storm" scenario stops after the setup, which it runs with every
+   connect() issued at once, as after a netsplit: connections/sec and the
+   time to connect then show how the server's accept path copes.
+   In "churn" the paced clients do not talk: each one QUITs at its rate and
+   connects, registers and joins again right away, the way short-lived bots
+   and flapping clients do, and the time from connect() to the JOIN coming
+   back is what gets recorded. */
+class Bench {
+public:
+    explicit Bench(const BenchOptions& opts);
+    ~Bench();
+    /* Connects, runs the load and drains. False when the run could not
+       start at all (fd limit, epoll); partial setups still produce results. */
+    bool run();
+    /* The options and results as one JSON object. */
+    void writeJson(std::ostream& out) const;
+
+private:
+    enum State { IDLE, CONNECTING, REGISTERING, JOINED, CLOSED };
+
+    struct Connection {
+        int fd;
+        State state;
+        bool flooder;
+        int generation;         /* reconnects so far; alternates the nick so a QUIT still in flight does not collide */
+        int channel;
+        std::string nick;
+        LineFramer framer;
+        std::string out;        /* not written yet, from outPos on */
+        size_t outPos;
+        bool wantWrite;         /* EPOLLOUT registered */
+        unsigned long started;  /* when connect() was called */
+
+        Connection();
+    };
+
+    typedef std::pair<unsigned long, int> Send; /* due time, connection */
+    typedef std::priority_queue<Send, std::vector<Send>, std::greater<Send> > Schedule;
+
+    BenchOptions options;
+    int epollFd;
+    std::vector<Connection> connections;
+    std::vector<int> channelMembers; /* joined connections per channel, flooders included */
+    Schedule schedule;
+    std::string padding;
+    std::vector<std::string> floodBatches; /* per channel */
+    unsigned long random;
+
+    /* connection setup */
+    int opened;
+    int inFlight;
+    int connected;                /* TCP handshakes completed */
+    int joined;
+    int failed;
+    unsigned long setupStart;
+    unsigned long connectEnd;     /* the last handshake that completed */
+    unsigned long setupEnd;       /* the last JOIN that came back */
+    LatencyHistogram connectLatency;
+    LatencyHistogram setupLatency;
+
+    /* load */
+    unsigned long loadStart;
+    unsigned long measureStart;
+    unsigned long measureEnd;
+    bool sending;
+    unsigned long sent;           /* timed messages sent inside the window */
+    unsigned long expected;       /* deliveries those should cause */
+    unsigned long delivered;      /* of those, how many arrived */
+    unsigned long received;       /* every PRIVMSG that arrived, any time */
+    unsigned long floodBytes;
+    unsigned long stalls;         /* sends skipped because the server stopped reading */
+    unsigned long disconnects;
+    unsigned long errorLines;
+    LatencyHistogram latency;
+
+    /* churn */
+    unsigned long reconnects;     /* QUIT and connect again, inside the window */
+    unsigned long rejoined;       /* of those, how many got their JOIN back */
+    int churnFailed;
+
+    static unsigned long nowUs();
+    unsigned long nextRandom();
+    bool raiseFdLimit();
+    void openConnections(unsigned long now);
+    bool openConnection(int index);
+    void poll(int timeoutMs);
+    void handleEvent(int index, unsigned events);
+    void handleConnected(Connection& c);
+    void handleReadable(Connection& c);
+    void handleLine(Connection& c, const LineView& line, unsigned long now);
+    void handleMessage(const char* text, size_t length, unsigned long now);
+    void queue(Connection& c, const std::string& data);
+    void flush(Connection& c);
+    void closeConnection(Connection& c);
+    void closeAll();
+    void startLoad();
+    void sendDue(unsigned long now);
+    void sendTimed(int index, unsigned long now);
+    void reconnect(int index, unsigned long now);
+    void setNick(Connection& c, int index);
+    void startFlooders();
+    int waitFor(unsigned long deadline, unsigned long now) const;
+    static void writeHistogram(std::ostream& out, const LatencyHistogram& histogram);
+
+    Bench(const Bench&);
+    Bench& operator=(const Bench&);
+};
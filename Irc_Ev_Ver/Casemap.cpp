@@ -0,0 +1,11 @@
+#include "Casemap.hpp"
+
+std::string casefold(const std::string& name) {
+    std::string folded(name);
+    for (std::string::iterator it = folded.begin(); it != folded.end(); ++it) {
+        char c = *it;
+        if (c >= 'A' && c <= '^') /* A-Z and [ \ ] ^ become a-z and { | } ~ */
+            *it = static_cast<char>(c + 32);
+    }
+    return folded;
+}
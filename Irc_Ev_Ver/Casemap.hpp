@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+/* RFC 1459 casemapping used for nicks and channel names: A-Z fold to a-z
+   and "[]\^" to "{}|~", so "Bob[1]" and "bob{1}" are the same name. */
+std::string casefold(const std::string& name);
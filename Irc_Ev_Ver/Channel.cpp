@@ -1,57 +1,76 @@
 #include "Channel.hpp"
-#include <iostream>
+#include "Log.hpp"
+#include <algorithm>
+
+namespace {
+
+bool socketLess(const Channel::Member& member, int clientSocket) { return member.socket < clientSocket; }
+
+}
 
 Channel::Channel(const std::string& n)
-    : name(n), topic(""), inviteOnly(false), topicRestricted(false), key(""), userLimit(0) {}
+    : name(n), operatorCount(0), topic(""), inviteOnly(false), topicRestricted(false), key(""), userLimit(0) {
+    pthread_mutex_init(&lock, NULL);
+}
 
-void Channel::join(int clientSocket) {
-    if (members.empty()) {
-        members[clientSocket] = true;
-    } else {
-        members[clientSocket] = false;
-    }
+Channel::~Channel() { pthread_mutex_destroy(&lock); }
+
+Channel::Members::iterator Channel::findMember(int clientSocket) {
+    Members::iterator it = std::lower_bound(members.begin(), members.end(), clientSocket, socketLess);
+    return (it != members.end() && it->socket == clientSocket) ? it : members.end();
+}
+
+Channel::Members::const_iterator Channel::findMember(int clientSocket) const {
+    Members::const_iterator it = std::lower_bound(members.begin(), members.end(), clientSocket, socketLess);
+    return (it != members.end() && it->socket == clientSocket) ? it : members.end();
+}
 
-    for (std::vector<int>::iterator it = invited.begin(); it != invited.end(); ++it) {
-        if (*it == clientSocket) {
-            invited.erase(it);
-            break;
-        }
+/* The first member becomes an operator. */
+void Channel::join(int clientSocket) {
+    Members::iterator it = std::lower_bound(members.begin(), members.end(), clientSocket, socketLess);
+    if (it == members.end() || it->socket != clientSocket) {
+        Member member;
+        member.socket = clientSocket;
+        member.isOperator = members.empty();
+        if (member.isOperator)
+            ++operatorCount;
+        members.insert(it, member);
     }
+    invited.erase(clientSocket);
 }
 
 void Channel::removeMember(int clientSocket) {
-    std::cout << "Removing socket " << clientSocket << " from channel " << name << ", members before: " << members.size() << std::endl;
-    members.erase(clientSocket);
-    std::cout << "After removing socket " << clientSocket << ", members left: " << members.size() << std::endl;
-    for (std::vector<int>::iterator it = invited.begin(); it != invited.end(); ++it) {
-        if (*it == clientSocket) {
-            invited.erase(it);
-            break;
-        }
-    }
-    bool hasOperator = false;
-    for (std::map<int, bool>::iterator it = members.begin(); it != members.end(); ++it) {
-        if (it->second == true) {
-            hasOperator = true;
-            break;
-        }
+    LOG_DEBUG("Removing socket " << clientSocket << " from channel " << name << ", members before: " << members.size());
+    Members::iterator it = findMember(clientSocket);
+    if (it != members.end()) {
+        if (it->isOperator)
+            --operatorCount;
+        members.erase(it);
     }
-    if (!hasOperator && !members.empty()) {
-        std::map<int, bool>::iterator firstMember = members.begin();
-        setOperator(firstMember->first, true);
-        std::cout << "Promoted client " << firstMember->first << " to operator in channel " << name << std::endl;
+    LOG_DEBUG("After removing socket " << clientSocket << ", members left: " << members.size());
+    invited.erase(clientSocket);
+    if (operatorCount == 0 && !members.empty()) {
+        members.front().isOperator = true;
+        operatorCount = 1;
+        LOG_DEBUG("Promoted client " << members.front().socket << " to operator in channel " << name);
     }
 }
-std::string Channel::getName() const { return name; }
+const std::string& Channel::getName() const { return name; }
+
+const Channel::Members& Channel::getMembers() const { return members; }
+
+bool Channel::hasMember(int clientSocket) const { return findMember(clientSocket) != members.end(); }
+
+size_t Channel::getMemberCount() const { return members.size(); }
 
-std::map<int, bool> Channel::getMembers() const { return members; }
+size_t Channel::getOperatorCount() const { return operatorCount; }
 
 bool Channel::isOperator(int clientSocket) const {
-    std::map<int, bool>::const_iterator it = members.find(clientSocket);
-    return (it != members.end() && it->second);
+    Members::const_iterator it = findMember(clientSocket);
+    return (it != members.end() && it->isOperator);
 }
 
-std::string Channel::getTopic() const { return topic; }
+const std::string& Channel::getTopic() const { return topic; }
 
 void Channel::setTopic(const std::string& t) { topic = t; }
 
@@ -63,14 +82,18 @@ bool Channel::isTopicRestricted() const { return topicRestricted; }
 
 void Channel::setTopicRestricted(bool value) { topicRestricted = value; }
 
-std::string Channel::getKey() const { return key; }
+const std::string& Channel::getKey() const { return key; }
 
 void Channel::setKey(const std::string& k) { key = k; }
 
 void Channel::setOperator(int clientSocket, bool value) {
-    std::map<int, bool>::iterator it = members.find(clientSocket);
-    if (it != members.end()) {
-        it->second = value;
+    Members::iterator it = findMember(clientSocket);
+    if (it != members.end() && it->isOperator != value) {
+        it->isOperator = value;
+        if (value)
+            ++operatorCount;
+        else
+            --operatorCount;
     }
 }
 
@@ -78,13 +101,10 @@ int Channel::getUserLimit() const { return userLimit; }
 
 void Channel::setUserLimit(int limit) { userLimit = limit; }
 
-void Channel::invite(int clientSocket) {
-    invited.push_back(clientSocket);
-}
+void Channel::invite(int clientSocket) { invited.insert(clientSocket); }
 
-bool Channel::isInvited(int clientSocket) const {
-    for (std::vector<int>::const_iterator it = invited.begin(); it != invited.end(); ++it) {
-        if (*it == clientSocket) return true;
-    }
-    return false;
-}
\ No newline at end of file
+void Channel::uninvite(int clientSocket) { invited.erase(clientSocket); }
+
+bool Channel::isInvited(int clientSocket) const { return invited.find(clientSocket) != invited.end(); }
+
+pthread_mutex_t& Channel::getLock() { return lock; }
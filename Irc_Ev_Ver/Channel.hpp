@@ -1,39 +1,69 @@
 #pragma once
 
 #include <string>
-#include <map>
 #include <vector>
+#include <tr1/unordered_set>
+#include <pthread.h>
 
+/* Membership changes (join, removeMember, invite) go through
+   ChannelDirectory, which keeps the per-client index of channels in step.
+   Members change only under Server::channelsLock held exclusively. Topic,
+   modes and operator flags may also change under it held shared, by MODE
+   and TOPIC; those take getLock() too, as does anyone reading them then. */
 class Channel {
 public:
+    struct Member {
+        int socket;
+        bool isOperator;
+    };
+    /* Sorted by socket: lookups are a binary search over one contiguous block. */
+    typedef std::vector<Member> Members;
+
     Channel(const std::string& n);
-    void join(int clientSocket);
-    void removeMember(int clientSocket);
-    std::string getName() const;
-    std::map<int, bool> getMembers() const;
+    ~Channel();
+    const std::string& getName() const;
+    const Members& getMembers() const;
+    bool hasMember(int clientSocket) const;
+    size_t getMemberCount() const;
+    size_t getOperatorCount() const;
     bool isOperator(int clientSocket) const;
-    std::string getTopic() const;
+    const std::string& getTopic() const;
     void setTopic(const std::string& t);
     bool isInviteOnly() const;
     void setInviteOnly(bool value);
     bool isTopicRestricted() const;
     void setTopicRestricted(bool value);
-    std::string getKey() const;
+    const std::string& getKey() const;
     void setKey(const std::string& k);
     void setOperator(int clientSocket, bool value);
     int getUserLimit() const;
     void setUserLimit(int limit);
-    void invite(int clientSocket);
     bool isInvited(int clientSocket) const;
+    pthread_mutex_t& getLock();
 
 private:
+    typedef std::tr1::unordered_set<int> InviteSet;
+
     std::string name;
-    std::map<int, bool> members; // socket -> isOperator
+    Members members;
+    size_t operatorCount;
     std::string topic;
     bool inviteOnly;
     bool topicRestricted;
     std::string key;
     int userLimit;
-    std::vector<int> invited;
-};
+    InviteSet invited;
+    pthread_mutex_t lock;
 
+    void join(int clientSocket);
+    void removeMember(int clientSocket);
+    void invite(int clientSocket);
+    void uninvite(int clientSocket);
+    Members::iterator findMember(int clientSocket);
+    Members::const_iterator findMember(int clientSocket) const;
+
+    Channel(const Channel&);
+    Channel& operator=(const Channel&);
+
+    friend class ChannelDirectory;
+};
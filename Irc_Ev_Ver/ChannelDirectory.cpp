@@ -0,0 +1,107 @@
+#include "ChannelDirectory.hpp"
+#include "Casemap.hpp"
+#include "Log.hpp"
+
+ChannelDirectory::ChannelDirectory() {}
+
+ChannelDirectory::~ChannelDirectory() { clear(); }
+
+Channel* ChannelDirectory::find(const std::string& name) const {
+    Map::const_iterator it = channels.find(casefold(name));
+    return it == channels.end() ? NULL : it->second;
+}
+
+Channel* ChannelDirectory::create(const std::string& name) {
+    std::pair<Map::iterator, bool> slot = channels.insert(std::make_pair(casefold(name), static_cast<Channel*>(NULL)));
+    if (slot.second)
+        slot.first->second = new Channel(name);
+    return slot.first->second;
+}
+
+void ChannelDirectory::join(Channel* channel, int clientSocket) {
+    if (channel->hasMember(clientSocket))
+        return;
+    ClientChannels& entry = clients[clientSocket];
+    if (channel->isInvited(clientSocket))
+        unlist(entry.invitedTo, channel);
+    channel->join(clientSocket); /* also uses up the invite */
+    entry.joined.push_back(channel);
+}
+
+void ChannelDirectory::leave(Channel* channel, int clientSocket) {
+    ClientIndex::iterator it = clients.find(clientSocket);
+    if (it != clients.end()) {
+        unlist(it->second.joined, channel);
+        if (channel->isInvited(clientSocket))
+            unlist(it->second.invitedTo, channel);
+    }
+    channel->removeMember(clientSocket); /* also drops a pending invite */
+}
+
+void ChannelDirectory::invite(Channel* channel, int clientSocket) {
+    if (channel->isInvited(clientSocket))
+        return;
+    channel->invite(clientSocket);
+    clients[clientSocket].invitedTo.push_back(channel);
+}
+
+bool ChannelDirectory::reclaimIfEmpty(Channel* channel) {
+    if (!channel || channel->getMemberCount() > 0)
+        return false;
+    LOG_DEBUG("Channel " << channel->getName() << " is empty, removing it");
+    /* Invitees still point at the channel */
+    for (Channel::InviteSet::const_iterator it = channel->invited.begin(); it != channel->invited.end(); ++it) {
+        ClientIndex::iterator entry = clients.find(*it);
+        if (entry != clients.end())
+            unlist(entry->second.invitedTo, channel);
+    }
+    channels.erase(casefold(channel->getName()));
+    delete channel;
+    return true;
+}
+
+void ChannelDirectory::removeMember(int clientSocket) {
+    ClientIndex::iterator it = clients.find(clientSocket);
+    if (it == clients.end())
+        return;
+    ClientChannels entry;
+    entry.joined.swap(it->second.joined);
+    entry.invitedTo.swap(it->second.invitedTo);
+    clients.erase(it);
+
+    for (size_t i = 0; i < entry.invitedTo.size(); ++i)
+        entry.invitedTo[i]->uninvite(clientSocket);
+    for (size_t i = 0; i < entry.joined.size(); ++i) {
+        entry.joined[i]->removeMember(clientSocket);
+        reclaimIfEmpty(entry.joined[i]);
+    }
+}
+
+const ChannelDirectory::ChannelList& ChannelDirectory::channelsOf(int clientSocket) const {
+    static const ChannelList none;
+    ClientIndex::const_iterator it = clients.find(clientSocket);
+    return it == clients.end() ? none : it->second.joined;
+}
+
+void ChannelDirectory::clear() {
+    for (Map::iterator it = channels.begin(); it != channels.end(); ++it)
+        delete it->second;
+    channels.clear();
+    clients.clear();
+}
+
+size_t ChannelDirectory::size() const { return channels.size(); }
+
+ChannelDirectory::iterator ChannelDirectory::begin() { return channels.begin(); }
+
+ChannelDirectory::iterator ChannelDirectory::end() { return channels.end(); }
+
+void ChannelDirectory::unlist(ChannelList& list, Channel* channel) {
+    for (ChannelList::iterator it = list.begin(); it != list.end(); ++it) {
+        if (*it == channel) {
+            *it = list.back();
+            list.pop_back();
+            return;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+#include "Channel.hpp"
+
+/* All channels, keyed by casefolded name (see Casemap.hpp). Each Channel is
+   its own heap node, so a Channel* stays valid while other channels come
+   and go; a channel is freed as soon as its last member leaves.
+   Also indexes, per client, the channels it is in or invited to, so a
+   disconnect only visits those. Joins, kicks and invites go through here
+   to keep that index right. Lives in Server and is guarded by channelsLock. */
+class ChannelDirectory {
+public:
+    typedef std::tr1::unordered_map<std::string, Channel*> Map;
+    typedef Map::iterator iterator;
+    typedef std::vector<Channel*> ChannelList;
+
+    ChannelDirectory();
+    ~ChannelDirectory();
+
+    Channel* find(const std::string& name) const;
+    /* Creates `name` (spelled as given) unless it exists; returns the channel. */
+    Channel* create(const std::string& name);
+    void join(Channel* channel, int clientSocket);
+    /* Takes `clientSocket` out of `channel`; the caller reclaims the channel when done with it. */
+    void leave(Channel* channel, int clientSocket);
+    void invite(Channel* channel, int clientSocket);
+    /* Frees `channel` if nobody is left in it; returns true when it did. */
+    bool reclaimIfEmpty(Channel* channel);
+    /* Takes `clientSocket` out of its channels and invite lists, reclaiming the ones it empties. */
+    void removeMember(int clientSocket);
+    /* The channels `clientSocket` has joined. */
+    const ChannelList& channelsOf(int clientSocket) const;
+    void clear();
+    size_t size() const;
+    iterator begin();
+    iterator end();
+
+private:
+    struct ClientChannels {
+        ChannelList joined;
+        ChannelList invitedTo;
+    };
+    typedef std::tr1::unordered_map<int, ClientChannels> ClientIndex;
+
+    Map channels;
+    ClientIndex clients;
+
+    static void unlist(ChannelList& list, Channel* channel);
+
+    ChannelDirectory(const ChannelDirectory&);
+    ChannelDirectory& operator=(const ChannelDirectory&);
+};
@@ -1,25 +1,59 @@
 #include "Client.hpp"
 
-Client::Client(int s)
-    : socket(s), passwordEntered(false), passwordAttempts(3), nickname(""), username(""), realname(""), inputBuffer(""), outputBuffer("") {}
-
-Client::Client()
-    : socket(-1), passwordEntered(false), passwordAttempts(3), nickname(""), username(""), realname(""), inputBuffer(""), outputBuffer("") {}
+Client::Client(int s, unsigned long clientId, size_t shardIndex)
+    : socket(s), id(clientId), shard(shardIndex), passwordEntered(false), passwordAttempts(3), oper(false), nickname(""), username(""), realname(""), writeArmed(false), readArmed(true), dirty(false), lastActivity(0), lastCommand(0), awaitingPong(false), carried(false), throttleCount(0) {
+    timer.owner = socket;
+    floodTimer.owner = socket;
+}
 
 int Client::getSocket() const { return socket; }
+unsigned long Client::getId() const { return id; }
+size_t Client::getShard() const { return shard; }
 bool Client::isPasswordEntered() const { return passwordEntered; }
 void Client::setPasswordEntered(bool value) { passwordEntered = value; }
 int Client::getPasswordAttempts() const { return passwordAttempts; }
 void Client::setPasswordAttempts(int attempts) { passwordAttempts = attempts; }
-std::string Client::getNickname() const { return nickname; }
+const std::string& Client::getNickname() const { return nickname; }
 void Client::setNickname(const std::string& nick) { nickname = nick; }
-std::string Client::getUsername() const { return username; }
+const std::string& Client::getUsername() const { return username; }
 void Client::setUsername(const std::string& user) { username = user; }
-std::string Client::getRealname() const { return realname; }
+const std::string& Client::getRealname() const { return realname; }
 void Client::setRealname(const std::string& name) { realname = name; }
-std::string Client::getInputBuffer() const { return inputBuffer; }
-void Client::appendInputBuffer(const std::string& data) { inputBuffer += data; }
-void Client::clearInputBuffer() { inputBuffer = ""; }
-std::string Client::getOutputBuffer() const { return outputBuffer; }
-void Client::appendOutputBuffer(const std::string& data) { outputBuffer += data; }
-void Client::eraseOutputBuffer(size_t bytes) { outputBuffer.erase(0, bytes); }
\ No newline at end of file
+bool Client::isRegistered() const { return passwordEntered && !nickname.empty() && !username.empty(); }
+
+bool Client::isOper() const { return oper; }
+void Client::setOper(bool value) { oper = value; }
+
+LineFramer& Client::getFramer() { return framer; }
+size_t Client::getInputSize() const { return framer.pending() + framer.parked(); }
+void Client::appendOutputBuffer(const std::string& data) { outputQueue.append(data.data(), data.size()); }
+void Client::appendOutputBuffer(const char* data, size_t length) { outputQueue.append(data, length); }
+void Client::appendOutputBuffer(const BufferRef& data) { outputQueue.append(data); }
+void Client::eraseOutputBuffer(size_t bytes) { outputQueue.consume(bytes); }
+int Client::fillOutputIov(struct iovec* iov, int maxIov) const { return outputQueue.fillIov(iov, maxIov); }
+SendQueue& Client::getOutputQueue() { return outputQueue; }
+size_t Client::getOutputSize() const { return outputQueue.size(); }
+void Client::setSendQueue(size_t limit, QueueAccount* account) { outputQueue.setLimit(limit); outputQueue.setAccount(account); }
+void Client::setQueuePools(FixedPool* chunks, FixedPool* segments) { outputQueue.setPools(chunks, segments); }
+bool Client::isSendQueueExceeded() const { return outputQueue.overflowed(); }
+bool Client::hasPendingOutput() const { return !outputQueue.empty(); }
+bool Client::isWriteArmed() const { return writeArmed; }
+void Client::setWriteArmed(bool value) { writeArmed = value; }
+bool Client::isReadArmed() const { return readArmed; }
+void Client::setReadArmed(bool value) { readArmed = value; }
+bool Client::isDirty() const { return dirty; }
+void Client::setDirty(bool value) { dirty = value; }
+TimerNode& Client::getTimer() { return timer; }
+unsigned long Client::getLastActivity() const { return lastActivity; }
+unsigned long Client::getLastCommand() const { return lastCommand; }
+void Client::touch(unsigned long now) { lastActivity = now; awaitingPong = false; }
+void Client::setLastCommand(unsigned long now) { lastCommand = now; }
+bool Client::isAwaitingPong() const { return awaitingPong; }
+void Client::setAwaitingPong(bool value) { awaitingPong = value; }
+TokenBucket& Client::getFloodBucket() { return floodBucket; }
+TimerNode& Client::getFloodTimer() { return floodTimer; }
+TickBudget& Client::getTickBudget() { return tickBudget; }
+bool Client::isCarried() const { return carried; }
+void Client::setCarried(bool value) { carried = value; }
+unsigned long Client::getThrottleCount() const { return throttleCount; }
+void Client::countThrottle() { ++throttleCount; }
\ No newline at end of file
@@ -1,36 +1,87 @@
 #pragma once
 
 #include <string>
+#include "SendQueue.hpp"
+#include "LineFramer.hpp"
+#include "TimerWheel.hpp"
+#include "FloodControl.hpp"
 
 class Client {
 public:
-    Client(int s);
-    Client();
+    /* Without arguments: the placeholder std::map::operator[] default-constructs. */
+    Client(int s = -1, unsigned long clientId = 0, size_t shardIndex = 0);
     int getSocket() const;
+    unsigned long getId() const;
+    size_t getShard() const;
     bool isPasswordEntered() const;
     void setPasswordEntered(bool value);
     int getPasswordAttempts() const;
     void setPasswordAttempts(int attempts);
-    std::string getNickname() const;
+    const std::string& getNickname() const;
     void setNickname(const std::string& nick);
-    std::string getUsername() const;
+    const std::string& getUsername() const;
     void setUsername(const std::string& user);
-    std::string getRealname() const;
+    const std::string& getRealname() const;
     void setRealname(const std::string& name);
-    std::string getInputBuffer() const;
-    void appendInputBuffer(const std::string& data);
-    void clearInputBuffer();
-    std::string getOutputBuffer() const;
+    bool isRegistered() const; /* password, nickname and username all given */
+    bool isOper() const; /* OPER succeeded, see CommandHandler::handleOper() */
+    void setOper(bool value);
+    LineFramer& getFramer();
+    size_t getInputSize() const; /* received bytes not yet run as commands, the RecvQ */
     void appendOutputBuffer(const std::string& data);
+    void appendOutputBuffer(const char* data, size_t length);
+    void appendOutputBuffer(const BufferRef& data); /* shares the buffer, no copy */
     void eraseOutputBuffer(size_t bytes);
+    int fillOutputIov(struct iovec* iov, int maxIov) const;
+    SendQueue& getOutputQueue(); /* for Reactor::send() */
+    size_t getOutputSize() const;
+    void setSendQueue(size_t limit, QueueAccount* account); /* see SendQueue::setLimit() */
+    void setQueuePools(FixedPool* chunks, FixedPool* segments); /* see SendQueue::setPools() */
+    bool isSendQueueExceeded() const;
+    bool hasPendingOutput() const;
+    bool isWriteArmed() const;
+    void setWriteArmed(bool value);
+    bool isReadArmed() const;
+    void setReadArmed(bool value);
+    bool isDirty() const;
+    void setDirty(bool value);
+    TimerNode& getTimer();
+    unsigned long getLastActivity() const;
+    unsigned long getLastCommand() const;
+    void touch(unsigned long now); /* anything arrived, the peer is alive */
+    void setLastCommand(unsigned long now);
+    bool isAwaitingPong() const;
+    void setAwaitingPong(bool value);
+    TokenBucket& getFloodBucket();
+    TimerNode& getFloodTimer();
+    TickBudget& getTickBudget();
+    bool isCarried() const; /* in Shard::carried, lines left for the next tick */
+    void setCarried(bool value);
+    unsigned long getThrottleCount() const;
+    void countThrottle();
 
 private:
     int socket;
+    unsigned long id; /* unique for the process lifetime, unlike the fd */
+    size_t shard; /* index of the Shard whose thread owns the buffers */
     bool passwordEntered;
     int passwordAttempts;
+    bool oper;
     std::string nickname;
     std::string username;
     std::string realname;
-    std::string inputBuffer;
-    std::string outputBuffer;
+    LineFramer framer; /* inbound bytes not yet split into lines */
+    SendQueue outputQueue;
+    bool writeArmed; /* write interest currently registered with the reactor */
+    bool readArmed; /* read interest currently registered, dropped while flood control holds input */
+    bool dirty; /* queued in Shard::dirtyClients for this tick */
+    TimerNode timer; /* registration, keepalive or idle deadline in the shard's TimerWheel */
+    unsigned long lastActivity; /* TimerWheel::now() of the last bytes received */
+    unsigned long lastCommand; /* same, for the last command other than PING/PONG */
+    bool awaitingPong; /* a keepalive PING is out and nothing has come back yet */
+    TokenBucket floodBucket; /* command budget, see Shard::admit() */
+    TimerNode floodTimer; /* armed while input is parked waiting for floodBucket */
+    TickBudget tickBudget; /* commands run this loop iteration, see Shard::runCommands() */
+    bool carried; /* input parked until the next iteration, the tick budget ran out */
+    unsigned long throttleCount; /* times the budget ran out */
 };
\ No newline at end of file
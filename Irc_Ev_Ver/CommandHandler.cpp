@@ -1,32 +1,33 @@
 #include "CommandHandler.hpp"
 #include "Server.hpp"
-#include <iostream>
+#include "Shard.hpp"
+#include "Reply.hpp"
+#include "MetricsExporter.hpp"
+#include "Log.hpp"
+#include "Locks.hpp"
 #include <string>
 #include <vector>
-#include <poll.h>
 #include <cstring>
 #include <stdio.h>
-#include <sstream>
 #include <cstdlib>
 #include <unistd.h>
 
-CommandHandler::CommandHandler(Server& s) : server(s) {}
+CommandHandler::CommandHandler(Server& s, Shard& sh) : server(s), shard(sh), router(s, sh) {}
 
 /* The `checkClient` function verifies whether a client (identified by their socket) 
-exists in the server's list of active clients. 
+exists in this shard's list of clients, which only this thread changes. 
 If the client does not exist, an error message is printed, 
 the client is removed from the server, and the function returns `false`. 
 If the client exists, a reference to the client object is assigned to the provided pointer, 
 and the function returns `true`. */
 
-bool CommandHandler::checkClient(int clientSocket, std::vector<pollfd>& fds, Client*& client) {
-    std::map<int, Client>::iterator it = server.m_clients.find(clientSocket);
-    if (it == server.m_clients.end()) {
-        std::cerr << "Error: Unknown client\n";
-        server.removeClient(clientSocket, fds);
+bool CommandHandler::checkClient(int clientSocket, Client*& client) {
+    client = shard.findClient(clientSocket);
+    if (!client) {
+        LOG_ERROR("Unknown client");
+        shard.removeClient(clientSocket);
         return false;
     }
-    client = &it->second;
     return true;
 }
 
@@ -36,56 +37,51 @@ It verifies the password provided in the command and takes appropriate actions:
    and the output buffer is updated for further communication.
 2. If the password is incorrect, the client is notified, and the remaining attempts 
    are decremented. After exhausting all attempts, the client is disconnected.
-3. If the input does not start with "PASS :", the function exits without processing further. */
+3. If the message is not a `PASS` with a parameter, the function exits without processing further. */
 
-void CommandHandler::handlePassword(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    // Проверяем, начинается ли строка с "PASS :"
-    if (input.rfind("PASS :", 0) != 0) {
+void CommandHandler::handlePassword(int clientSocket, const Message& msg, Client& client) {
+    if (msg.id != CMD_PASS || msg.paramCount == 0) {
         /* Если это не команда PASS, просто выходим и ждём следующую команду
         Ну короче здесь есть сомнения */
         return;
     }
 
-    std::string password = input.substr(6);
+    std::string password = msg.param(0);
     while (!password.empty() && (password[0] == ' ' || password[password.length() - 1] == ' ')) {
         if (password[0] == ' ') password.erase(0, 1);
         if (!password.empty() && password[password.length() - 1] == ' ') password.erase(password.length() - 1);
     }
 
+    // Until a nickname is set the client is addressed as guest<fd>
+    char guestName[32];
+    snprintf(guestName, sizeof(guestName), "guest%d", clientSocket);
+    const char* clientName = client.getNickname().empty() ? guestName : client.getNickname().c_str();
+
     if (password == server.config.getPassword()) {
         client.setPasswordEntered(true);
-        std::cout << "Client authenticated with password: " << password << "\n";
+        LOG_INFO("Client authenticated with password: " << password);
         
-        std::ostringstream oss;
-        oss << clientSocket;
-        std::string clientName = client.getNickname().empty() ? "guest" + oss.str() : client.getNickname();
-        std::string response = ":server@localhost 001 " + clientName + " :✅ Great, that's the correct password, champ!\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        Reply(client, RPL_WELCOME, clientName).send("✅ Great, that's the correct password, champ!");
+        shard.markDirty(client);
     } else {
         client.setPasswordAttempts(client.getPasswordAttempts() - 1);
-        std::ostringstream ossClient;
-        ossClient << clientSocket;
-        std::string clientName = client.getNickname().empty() ? "guest" + ossClient.str() : client.getNickname();
 
         if (client.getPasswordAttempts() > 0) {
-            std::ostringstream ossAttempts;
-            ossAttempts << client.getPasswordAttempts();
-            std::string response = ":server@localhost 464 " + clientName + " :Wrong password. Attempts left: " + ossAttempts.str() + "\r\n";
-            client.appendOutputBuffer(response);
-            fds[i].events |= POLLOUT;
+            char text[64];
+            snprintf(text, sizeof(text), "Wrong password. Attempts left: %d", client.getPasswordAttempts());
+            Reply(client, ERR_PASSWDMISMATCH, clientName).send(text);
+            shard.markDirty(client);
         } else {
-            std::string response = ":server@localhost 464 " + clientName + " :Too many wrong attempts. Disconnecting\r\n";
-            client.appendOutputBuffer(response);
-            fds[i].events |= POLLOUT;
-            server.removeClient(clientSocket, fds);
+            Reply(client, ERR_PASSWDMISMATCH, clientName).send("Too many wrong attempts. Disconnecting");
+            shard.markDirty(client);
+            shard.removeClient(clientSocket);
         }
     }
 }
 
 /* This piece of code must remain untouched under any circumstances. */
-void CommandHandler::handleQuit(int clientSocket, Client& client, std::vector<pollfd>& fds) {
-    std::cout << "Client requested to quit.\n";
+void CommandHandler::handleQuit(int clientSocket, Client& client) {
+    LOG_INFO("Client " << clientSocket << " requested to quit.");
     (void)client;
 
     // std::string quitMessage = ":" + client.getNickname() + " QUIT :Quit\r\n";
@@ -100,73 +96,67 @@ void CommandHandler::handleQuit(int clientSocket, Client& client, std::vector<po
     //         }
     //     }
     // }
-    server.removeClient(clientSocket, fds);
+    shard.removeClient(clientSocket);
 }
 /* End of message */
 
 /* The `handleNick` function processes the `NICK` command sent by a client. 
 It performs the following steps:
-1. If the input length is less than or equal to 5, a response is sent indicating 
+1. If no parameter was given, a response is sent indicating 
    that there are not enough parameters, and the function exits.
-2. The provided nickname is extracted and trimmed of leading and trailing spaces.
-3. If the nickname is empty after trimming, a response is sent stating that 
+2. The nickname is the first parameter.
+3. If the nickname is empty (a bare "NICK :"), a response is sent stating that 
    no nickname was given, and the function exits.
 4. The function checks if the nickname is already in use by another client.
    - If it is in use, a response is sent indicating that the nickname is unavailable.
    - Otherwise, the client's nickname is updated, and a confirmation message is logged.
+   - A rename is announced to the client and everyone sharing a channel with it.
+   The registry and the nickname change together under clientsLock, which
+   is released before the announcement takes both locks shared.
 5. Updates the output buffer to include the appropriate response for further communication. */
 
-void CommandHandler::handleNick(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " NICK :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleNick(int clientSocket, const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("NICK").send();
+        shard.markDirty(client);
         return;
     }
-    std::string nickname = input.substr(5);
-    while (!nickname.empty() && (nickname[0] == ' ' || nickname[nickname.length() - 1] == ' ')) {
-        if (nickname[0] == ' ') nickname.erase(0, 1);
-        if (!nickname.empty() && nickname[nickname.length() - 1] == ' ') nickname.erase(nickname.length() - 1);
-    }
+    std::string nickname = msg.param(0);
     if (nickname.empty()) {
-        std::string response = ":server@localhost 431 " + client.getNickname() + " :No nickname given\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NONICKNAMEGIVEN).send();
+        shard.markDirty(client);
     } else {
-        bool nickInUse = false;
-        for (std::map<int, Client>::iterator it = server.m_clients.begin(); it != server.m_clients.end(); ++it) {
-            if (it->second.getNickname() == nickname && it->first != clientSocket) {
-                nickInUse = true;
-                break;
-            }
+        std::string oldNick = client.getNickname();
+        bool renamed;
+        {
+            WriteGuard guard(server.clientsLock);
+            renamed = server.nicks.rename(clientSocket, oldNick, nickname);
+            if (renamed)
+                client.setNickname(nickname);
         }
-        if (nickInUse) {
-            std::string response = ":server@localhost 433 * " + nickname + " :Nickname is already in use\r\n";
-            client.appendOutputBuffer(response);
-            fds[i].events |= POLLOUT;
+        if (!renamed) {
+            Reply(client, ERR_NICKNAMEINUSE, "*").param(nickname).send();
+            shard.markDirty(client);
         } else {
-            std::string oldNick = client.getNickname();
-            client.setNickname(nickname);
-            std::cout << "Client set nickname: " + nickname + "\n";
+            LOG_INFO("Client set nickname: " << nickname);
             if (oldNick.empty()) {
-                std::string response = ":server@localhost 001 " + nickname + " :Good NickName ✨\r\n";
-                client.appendOutputBuffer(response);
+                Reply(client, RPL_WELCOME, nickname).send("Good NickName ✨");
             } else {
-                std::string response = ":" + oldNick + "!" + client.getUsername() + "@localhost NICK " + nickname + "\r\n";
-                broadcastMessage(clientSocket, "NICK " + nickname, fds);
-                client.appendOutputBuffer(response);
+                ReadGuard channelsGuard(server.channelsLock);
+                ReadGuard clientsGuard(server.clientsLock);
+                router.route(Event::nickChange(clientSocket, oldNick, nickname));
             }
-            fds[i].events |= POLLOUT;
+            shard.markDirty(client);
         }
     }
 }
 
 /* The `handleUser` function processes the `USER` command sent by a client.
 It performs the following steps:
-1. If the input length is less than or equal to 5, a response is sent to the client indicating 
+1. If no parameter was given, a response is sent to the client indicating 
    that there are not enough parameters, and the function exits.
-2. Extracts the username and real name from the input:
-   - If the input format is incorrect (e.g., missing spaces or colon), a syntax error response is sent.
+2. Takes the username from the first parameter and the real name from the last one:
+   - If there is no real name parameter, a syntax error response is sent.
    - Trims any leading spaces from the real name.
 3. Sets the client's username using the extracted value.
 4. Based on the client's current status:
@@ -174,59 +164,48 @@ It performs the following steps:
    - If the nickname is missing, a response is sent instructing the client to set a nickname first.
 5. Updates the output buffer with the appropriate response for further communication. */
 
-void CommandHandler::handleUser(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " USER :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleUser(const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("USER").send();
+        shard.markDirty(client);
         return;
     }
-    std::string userPart = input.substr(5);
-    size_t firstSpace = userPart.find(' ');
-    if (firstSpace == std::string::npos) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " USER :Syntax error\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+    if (msg.paramCount < 2) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("USER").send("Syntax error");
+        shard.markDirty(client);
         return;
     }
-    std::string username = userPart.substr(0, firstSpace);
-    size_t colonPos = userPart.find(':');
-    if (colonPos == std::string::npos) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " USER :Syntax error\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
-        return;
-    }
-    std::string realname = userPart.substr(colonPos + 1);
+    std::string username = msg.param(0);
+    std::string realname = msg.param(msg.paramCount - 1);
     while (!realname.empty() && realname[0] == ' ') {
         realname.erase(0, 1);
     }
 
-    client.setUsername(username);
-    client.setRealname(realname);
-    std::cout << "Client set username: " << username << "\n";
+    {
+        WriteGuard guard(server.clientsLock); // WHOIS on other shards reads them
+        client.setUsername(username);
+        client.setRealname(realname);
+    }
+    LOG_INFO("Client set username: " << username);
 
     // Send welcome message if password is entered, using username only
     if (client.isPasswordEntered()) {
         // Use username as the target of the 001 numeric if nickname is empty
-        std::string target = client.getNickname().empty() ? username : client.getNickname();
-        std::string response = ":server@localhost 001 " + target + " :🦋 Welcome to the IRC server🦋 " + username + "@localhost\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        const std::string& target = client.getNickname().empty() ? username : client.getNickname();
+        Reply(client, RPL_WELCOME, target).send("🦋 Welcome to the IRC server🦋 " + username + "@localhost");
+        shard.markDirty(client);
     } else {
         // If password is not entered, no welcome message is sent
-        std::string response = ":server@localhost 464 * :Password required\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_PASSWDMISMATCH, "*").send("Password required");
+        shard.markDirty(client);
     }
 }
 
 /* The `handleJoin` function processes the `JOIN` command sent by a client.
 It performs the following steps:
-1. Checks if the input length is sufficient:
+1. Checks that a channel parameter was given:
    - If not, a response is sent indicating that parameters are missing, and the function exits.
-2. Extracts and trims the channel name:
-   - Removes leading and trailing spaces from the channel name.
+2. Takes the channel name and the optional key from the parameters.
 3. Validates the channel name:
    - If the channel name is empty or does not start with a '#', a response is sent indicating 
      that the channel does not exist, and the function exits.
@@ -234,588 +213,446 @@ It performs the following steps:
    - If it exists, adds the client to the channel's member list.
    - If it does not exist, creates a new channel, adds the client as the first member, 
      and registers the channel in the server's channel list.
-5. Sends a response to the client confirming the join and logs the action.
-6. Broadcasts the join message to other members of the channel.
+   Runs under channelsLock held exclusively, from the lookup to the announcement.
+5. Announces the join to every member of the channel, the client included.
+6. Sends the channel topic to the client.
 7. Updates the output buffer to ensure the appropriate responses are sent to the client. */
 
-void CommandHandler::handleJoin(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " JOIN :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleJoin(int clientSocket, const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("JOIN").send();
+        shard.markDirty(client);
         return;
     }
 
-    // Parse parameters: JOIN <channel> [key]
-    std::string params = input.substr(5);
-    size_t spacePos = params.find(' ');
-    std::string channelName = spacePos == std::string::npos ? params : params.substr(0, spacePos);
-    std::string key = spacePos != std::string::npos ? params.substr(spacePos + 1) : "";
-
-    // Trim whitespace
-    while (!channelName.empty() && (channelName[0] == ' ' || channelName[channelName.length() - 1] == ' '))
-        channelName.erase(channelName[0] == ' ' ? 0 : channelName.length() - 1, 1);
-    while (!key.empty() && key[0] == ' ')
-        key.erase(0, 1);
+    // Parameters: JOIN <channel> [key]
+    std::string channelName = msg.param(0);
+    std::string key = msg.param(1);
 
     // Validate channel name
     if (channelName.empty() || channelName[0] != '#') {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
+    WriteGuard channelsGuard(server.channelsLock);
+    ReadGuard clientsGuard(server.clientsLock);
     // Check if channel exists
-    std::vector<Channel>::iterator channelIt = server.channels.end();
-    for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-        if (it->getName() == channelName) {
-            channelIt = it;
-            break;
-        }
-    }
+    Channel* channel = server.channels.find(channelName);
 
-    if (channelIt != server.channels.end()) {
+    if (channel) {
         // Check channel modes
-        if (channelIt->isInviteOnly() && !channelIt->isOperator(clientSocket) && !channelIt->isInvited(clientSocket)) {
-            client.appendOutputBuffer(":server@localhost 473 " + client.getNickname() + " " + channelName + " :Cannot join channel (+i)\r\n");
-            fds[i].events |= POLLOUT;
+        if (channel->isInviteOnly() && !channel->isOperator(clientSocket) && !channel->isInvited(clientSocket)) {
+            Reply(client, ERR_INVITEONLYCHAN).param(channelName).send();
+            shard.markDirty(client);
             return;
         }
-        if (!channelIt->getKey().empty() && key != channelIt->getKey()) {
-            client.appendOutputBuffer(":server@localhost 475 " + client.getNickname() + " " + channelName + " :Cannot join channel (+k)\r\n");
-            fds[i].events |= POLLOUT;
+        if (!channel->getKey().empty() && key != channel->getKey()) {
+            Reply(client, ERR_BADCHANNELKEY).param(channelName).send();
+            shard.markDirty(client);
             return;
         }
-        if (channelIt->getUserLimit() > 0 && static_cast<int>(channelIt->getMembers().size()) >= channelIt->getUserLimit()) {
-            client.appendOutputBuffer(":server@localhost 471 " + client.getNickname() + " " + channelName + " :Cannot join channel (+l)\r\n");
-            fds[i].events |= POLLOUT;
+        if (channel->getUserLimit() > 0 && static_cast<int>(channel->getMemberCount()) >= channel->getUserLimit()) {
+            Reply(client, ERR_CHANNELISFULL).param(channelName).send();
+            shard.markDirty(client);
             return;
         }
 
         // Join existing channel
-        channelIt->join(clientSocket);
+        server.channels.join(channel, clientSocket);
     } else {
-        // Create new channel
-        Channel newChannel(channelName);
-        newChannel.join(clientSocket);
-        newChannel.setOperator(clientSocket, true); // First member becomes operator
-        server.channels.push_back(newChannel);
-        channelIt = server.channels.end() - 1;
+        // Create new channel, the first member becomes operator
+        channel = server.channels.create(channelName);
+        server.channels.join(channel, clientSocket);
     }
 
-    // Send JOIN message
-    std::string joinMessage = ":" + client.getNickname() + "!" + client.getUsername() + "@localhost JOIN " + channelName + "\r\n";
-    client.appendOutputBuffer(joinMessage);
-    broadcastMessage(clientSocket, joinMessage, fds);
+    // Announce the JOIN, to the client as well
+    router.route(Event::join(clientSocket, channel));
 
     // Send channel topic if set
-    std::string topic = channelIt->getTopic();
+    const std::string& topic = channel->getTopic();
     if (!topic.empty()) {
-        client.appendOutputBuffer(":server@localhost 332 " + client.getNickname() + " " + channelName + " :" + topic + "\r\n");
+        Reply(client, RPL_TOPIC).param(channelName).send(topic);
     } else {
-        client.appendOutputBuffer(":server@localhost 331 " + client.getNickname() + " " + channelName + " :No topic is set\r\n");
+        Reply(client, RPL_NOTOPIC).param(channelName).send();
     }
 
-    fds[i].events |= POLLOUT;
+    shard.markDirty(client);
 }
 
 /* The `handlePrivmsg` function processes the `PRIVMSG` command sent by a client.
 It performs the following actions:
-1. Checks if the input length is sufficient:
+1. Checks that parameters were given:
    - If not, a response is sent indicating that the parameters are missing, and the function exits.
-2. Extracts the target (recipient) and the message:
-   - The target and message are separated by a space and a colon, respectively.
-   - Leading and trailing spaces in the target are removed.
+2. Takes the target (recipient) and the message:
+   - The target is the first parameter, the message is the second (usually the trailing one).
 3. Validates the input format:
-   - If the format is correct, the message is broadcast to the target.
+   - If the format is correct, the message is routed to the channel members or to the nick,
+     with both shared locks held: PRIVMSG on different shards runs in parallel.
    - A confirmation response is added to the client's output buffer.
    - Logs the private message for debugging purposes.
 4. Handles incorrect input:
    - If the recipient or message is missing, a response is sent indicating the error.
 5. Updates the output buffer to ensure the appropriate response is sent back to the client. */
 
-void CommandHandler::handlePrivmsg(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        std::string response = ":server 461 " + client.getNickname() + " PRIVMSG :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handlePrivmsg(int clientSocket, const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("PRIVMSG").send();
+        shard.markDirty(client);
         return;
     }
-    size_t spacePos = input.find(' ');
-    size_t colonPos = input.find(':');
-    if (spacePos != std::string::npos && colonPos != std::string::npos && colonPos > spacePos) {
-        std::string target = input.substr(spacePos + 1, colonPos - spacePos - 1);
-        while (!target.empty() && (target[0] == ' ' || target[target.length() - 1] == ' ')) {
-            if (target[0] == ' ') target.erase(0, 1);
-            if (!target.empty() && target[target.length() - 1] == ' ') target.erase(target.length() - 1);
-        }
-        std::string message = input.substr(colonPos + 1);
-        std::cout << "Received private message to " << target << ": " << message << "\n";
+    if (msg.paramCount >= 2 && msg.params[0].length > 0) {
+        std::string target = msg.param(0);
+        std::string message = msg.param(1);
+        LOG_DEBUG("Received private message to " << target << ": " << message);
 
+        ReadGuard channelsGuard(server.channelsLock);
+        ReadGuard clientsGuard(server.clientsLock);
+        Channel* channel = NULL;
         if (target[0] == '#') {
             bool isMember = false;
-            for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-                if (it->getName() == target) {
-                    std::map<int, bool> members = it->getMembers();
-                    std::cout << "Checking if socket " << clientSocket << " is in channel " << target << ", members: " << members.size() << std::endl;
-                    if (members.find(clientSocket) != members.end()) {
-                        isMember = true;
-                        std::cout << "Socket " << clientSocket << " is a member of " << target << std::endl;
-                    } else {
-                        std::cout << "Socket " << clientSocket << " is NOT a member of " << target << std::endl;
-                    }
-                    break;
+            channel = server.channels.find(target);
+            if (channel) {
+                LOG_DEBUG("Checking if socket " << clientSocket << " is in channel " << target << ", members: " << channel->getMemberCount());
+                if (channel->hasMember(clientSocket)) {
+                    isMember = true;
+                    LOG_DEBUG("Socket " << clientSocket << " is a member of " << target);
+                } else {
+                    LOG_DEBUG("Socket " << clientSocket << " is NOT a member of " << target);
                 }
             }
             if (!isMember) {
-                std::string response = ":server 404 " + client.getNickname() + " " + target + " :Cannot send to channel\r\n";
-                client.appendOutputBuffer(response);
-                fds[i].events |= POLLOUT;
+                Reply(client, ERR_CANNOTSENDTOCHAN).param(target).send();
+                shard.markDirty(client);
                 return;
             }
         }
 
-        broadcastMessage(clientSocket, "PRIVMSG " + target + " :" + message, fds);
-        std::string response = ":server 001 " + client.getNickname() + " :Message sent\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        if (channel) {
+            router.route(Event::channelMessage(clientSocket, channel, message));
+        } else {
+            router.route(Event::userMessage(clientSocket, server.nicks.find(target), target, message));
+        }
+        Reply(client, RPL_WELCOME).send("Message sent");
+        shard.markDirty(client);
     } else {
-        std::string response = ":server 401 " + client.getNickname() + " :No recipient or message\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NOSUCHNICK).send("No recipient or message");
+        shard.markDirty(client);
     }
 }
 
-void CommandHandler::handleWhois(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 6) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " WHOIS :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleWhois(const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("WHOIS").send();
+        shard.markDirty(client);
         return;
     }
-    std::string targetNick = input.substr(6);
-    while (!targetNick.empty() && (targetNick[0] == ' ' || targetNick[targetNick.length() - 1] == ' '))
-        targetNick.erase(targetNick[0] == ' ' ? 0 : targetNick.length() - 1, 1);
-
-    for (std::map<int, Client>::iterator it = server.m_clients.begin(); it != server.m_clients.end(); ++it) {
-        if (it->second.getNickname() == targetNick) {
-            std::string response = ":server@localhost 311 " + client.getNickname() + " " + targetNick + " " + 
-                                  it->second.getUsername() + " localhost * :" + it->second.getRealname() + "\r\n";
-            client.appendOutputBuffer(response);
-            response = ":server@localhost 318 " + client.getNickname() + " " + targetNick + " :End of /WHOIS list\r\n";
-            client.appendOutputBuffer(response);
-            fds[i].events |= POLLOUT;
-            return;
-        }
-    }
-    std::string response = ":server@localhost 401 " + client.getNickname() + " " + targetNick + " :No such nick/channel\r\n";
-    client.appendOutputBuffer(response);
-    fds[i].events |= POLLOUT;
-}
+    std::string targetNick = msg.param(0);
 
-void CommandHandler::handleMode(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
+    ReadGuard guard(server.clientsLock); // `target` may belong to another shard
+    Client* target = server.findClientByNick(targetNick);
+    if (target) {
+        Reply(client, RPL_WHOISUSER).param(targetNick).param(target->getUsername()).param("localhost").param("*").send(target->getRealname());
+        Reply(client, RPL_ENDOFWHOIS).param(targetNick).send();
+        shard.markDirty(client);
         return;
     }
+    Reply(client, ERR_NOSUCHNICK).param(targetNick).send();
+    shard.markDirty(client);
+}
 
-    // Parse parameters: MODE <channel> [+-]<mode> [args]
-    std::string params = input.substr(5);
-    size_t spacePos = params.find(' ');
-    if (spacePos == std::string::npos) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleMode(int clientSocket, const Message& msg, Client& client) {
+    // Parameters: MODE <channel> [+-]<mode> [args]
+    if (msg.paramCount < 2) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send();
+        shard.markDirty(client);
         return;
     }
 
-    std::string channelName = params.substr(0, spacePos);
-    std::string modeStr = params.substr(spacePos + 1);
-    while (!channelName.empty() && (channelName[0] == ' ' || channelName[channelName.length() - 1] == ' '))
-        channelName.erase(channelName[0] == ' ' ? 0 : channelName.length() - 1, 1);
-    while (!modeStr.empty() && modeStr[0] == ' ')
-        modeStr.erase(0, 1);
+    std::string channelName = msg.param(0);
+    std::string modeStr = msg.param(1);
 
     // Validate channel
-    if (channelName.empty() || channelName[0] != '#') {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName);
+    if (channelName[0] != '#') {
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
-    // Find channel
-    std::vector<Channel>::iterator channelIt = server.channels.end();
-    for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-        if (it->getName() == channelName) {
-            channelIt = it;
-            break;
-        }
-    }
+    // Find channel; modes change under the channel's own lock, the directory stays shared
+    ReadGuard channelsGuard(server.channelsLock);
+    ReadGuard clientsGuard(server.clientsLock);
+    Channel* channel = server.channels.find(channelName);
 
-    if (channelIt == server.channels.end()) {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel) {
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
+    MutexGuard channelGuard(channel->getLock());
 
     // Check if sender is an operator
-    if (!channelIt->isOperator(clientSocket)) {
-        client.appendOutputBuffer(":server@localhost 482 " + client.getNickname() + " " + channelName + " :You're not channel operator\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel->isOperator(clientSocket)) {
+        Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
     // Parse mode string
     if (modeStr.length() < 2 || (modeStr[0] != '+' && modeStr[0] != '-')) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Invalid mode format\r\n");
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send("Invalid mode format");
+        shard.markDirty(client);
         return;
     }
 
     bool addMode = (modeStr[0] == '+');
     char mode = modeStr[1];
-    std::string arg = modeStr.length() > 2 ? modeStr.substr(3) : "";
-    while (!arg.empty() && arg[0] == ' ')
-        arg.erase(0, 1);
+    std::string arg = msg.param(2);
 
+    std::string modes = addMode ? "+" : "-";
+    modes += mode;
     switch (mode) {
         case 'i':
-            channelIt->setInviteOnly(addMode);
-            broadcastMessage(clientSocket, "MODE " + channelName + " " + (addMode ? "+i" : "-i"), fds);
+            channel->setInviteOnly(addMode);
             break;
         case 't': // Topic restriction
-            channelIt->setTopicRestricted(addMode);
-            broadcastMessage(clientSocket, "MODE " + channelName + " " + (addMode ? "+t" : "-t"), fds);
+            channel->setTopicRestricted(addMode);
             break;
         case 'k': // Channel key (password)
             if (addMode && arg.empty()) {
-                client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Key required for +k\r\n");
-                fds[i].events |= POLLOUT;
+                Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send("Key required for +k");
+                shard.markDirty(client);
                 return;
             }
-            channelIt->setKey(addMode ? arg : "");
-            broadcastMessage(clientSocket, "MODE " + channelName + " " + (addMode ? "+k " + arg : "-k"), fds);
+            channel->setKey(addMode ? arg : "");
+            if (addMode)
+                modes += " " + arg;
             break;
         case 'o': // Operator privilege
         {
             if (arg.empty()) {
-                client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Nickname required for +o/-o\r\n");
-                fds[i].events |= POLLOUT;
+                Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send("Nickname required for +o/-o");
+                shard.markDirty(client);
                 return;
             }
-            int targetSocket = -1;
-            for (std::map<int, Client>::iterator it = server.m_clients.begin(); it != server.m_clients.end(); ++it) {
-                if (it->second.getNickname() == arg) {
-                    targetSocket = it->first;
-                    break;
-                }
-            }
-            if (targetSocket == -1 || channelIt->getMembers().find(targetSocket) == channelIt->getMembers().end()) {
-                client.appendOutputBuffer(":server@localhost 441 " + client.getNickname() + " " + arg + " " + channelName + " :They aren't on that channel\r\n");
-                fds[i].events |= POLLOUT;
+            int targetSocket = server.nicks.find(arg);
+            if (targetSocket == -1 || !channel->hasMember(targetSocket)) {
+                Reply(client, ERR_USERNOTINCHANNEL).param(arg).param(channelName).send();
+                shard.markDirty(client);
                 return;
             }
-            int opAmount = 0;
-            std::map<int, bool> members = channelIt->getMembers();
-            for (std::map<int, bool>::iterator it = members.begin(); it != members.end(); ++it) {
-                if (it->second == true) {
-                    opAmount += 1;
-                }
-            }
-            if (addMode == false && opAmount == 1 && channelIt->isOperator(targetSocket)) {
-                std::cout << "Last one operator " << std::endl;
-                client.appendOutputBuffer(":server@localhost 482 " + client.getNickname() + " " + channelName + " :Cannot remove last operator\r\n");
-                fds[i].events |= POLLOUT;
+            if (addMode == false && channel->getOperatorCount() == 1 && channel->isOperator(targetSocket)) {
+                LOG_DEBUG("Last one operator ");
+                Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send("Cannot remove last operator");
+                shard.markDirty(client);
                 return;
             }
-            if (!channelIt->isOperator(targetSocket) || addMode == false) {
-                channelIt->setOperator(targetSocket, addMode);
+            if (!channel->isOperator(targetSocket) || addMode == false) {
+                channel->setOperator(targetSocket, addMode);
             }
-            broadcastMessage(clientSocket, "MODE " + channelName + " " + (addMode ? "+o " : "-o ") + arg, fds);
+            modes += " " + arg;
             break;
         }
         case 'l': // User limit
             if (addMode && arg.empty()) {
-                client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Limit required for +l\r\n");
-                fds[i].events |= POLLOUT;
+                Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send("Limit required for +l");
+                shard.markDirty(client);
                 return;
             }
             if (addMode) {
                 int limit = atoi(arg.c_str());
                 if (limit <= 0) {
-                    client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " MODE :Invalid limit for +l\r\n");
-                    fds[i].events |= POLLOUT;
+                    Reply(client, ERR_NEEDMOREPARAMS).param("MODE").send("Invalid limit for +l");
+                    shard.markDirty(client);
                     return;
                 }
-                channelIt->setUserLimit(limit);
-                broadcastMessage(clientSocket, "MODE " + channelName + " +l " + arg, fds);
+                channel->setUserLimit(limit);
+                modes += " " + arg;
             } else {
-                channelIt->setUserLimit(0);
-                broadcastMessage(clientSocket, "MODE " + channelName + " -l", fds);
+                channel->setUserLimit(0);
             }
             break;
         default:
-            client.appendOutputBuffer(":server@localhost 472 " + client.getNickname() + " " + mode + " :Unknown mode character\r\n");
-            fds[i].events |= POLLOUT;
+            Reply(client, ERR_UNKNOWNMODE).param(&mode, 1).send();
+            shard.markDirty(client);
             return;
     }
 
-    fds[i].events |= POLLOUT;
+    router.route(Event::modeChange(clientSocket, channel, modes));
+    shard.markDirty(client);
 }
 
-void CommandHandler::handlePing(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) { // "PING " = 5 символов
-        std::string response = ":server 461 " + client.getNickname() + " PING :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handlePing(const Message& msg, Client& client) {
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("PING").send();
+        shard.markDirty(client);
         return;
     }
-    std::string token = input.substr(5);
+    std::string token = msg.param(0);
     std::string response = ":server PONG server :" + token + "\r\n";
     client.appendOutputBuffer(response);
-    fds[i].events |= POLLOUT;
+    shard.markDirty(client);
 }
 
-void CommandHandler::handleKick(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 5) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " KICK :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleKick(int clientSocket, const Message& msg, Client& client) {
+    // Parameters: KICK <channel> <nick> [:reason]
+    if (msg.paramCount < 2) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("KICK").send();
+        shard.markDirty(client);
         return;
     }
 
-    // Parse parameters
-    std::string params = input.substr(5);
-    size_t spacePos = params.find(' ');
-    if (spacePos == std::string::npos) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " KICK :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
-        return;
-    }
-
-    std::string channelName = params.substr(0, spacePos);
-    std::string rest = params.substr(spacePos + 1);
-    size_t colonPos = rest.find(':');
-    std::string targetNick = colonPos != std::string::npos ? rest.substr(0, colonPos) : rest;
-    std::string reason = colonPos != std::string::npos && colonPos + 1 < rest.length() ? rest.substr(colonPos + 1) : "Kicked by operator";
-
-    // Trim whitespace
-    while (!channelName.empty() && (channelName[0] == ' ' || channelName[channelName.length() - 1] == ' '))
-        channelName.erase(channelName[0] == ' ' ? 0 : channelName.length() - 1, 1);
-    while (!targetNick.empty() && (targetNick[0] == ' ' || targetNick[targetNick.length() - 1] == ' '))
-        targetNick.erase(targetNick[0] == ' ' ? 0 : targetNick.length() - 1, 1);
+    std::string channelName = msg.param(0);
+    std::string targetNick = msg.param(1);
+    std::string reason = msg.param(2);
     while (!reason.empty() && reason[0] == ' ') reason.erase(0, 1);
+    if (reason.empty())
+        reason = "Kicked by operator";
 
     // Validate channel
     if (channelName.empty() || channelName[0] != '#') {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
-    // Find channel
-    std::vector<Channel>::iterator channelIt = server.channels.end();
-    for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-        if (it->getName() == channelName) {
-            channelIt = it;
-            break;
-        }
-    }
+    // Find channel; the kick changes its members
+    WriteGuard channelsGuard(server.channelsLock);
+    ReadGuard clientsGuard(server.clientsLock);
+    Channel* channel = server.channels.find(channelName);
 
-    if (channelIt == server.channels.end()) {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel) {
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
     // Check if sender is an operator
-    if (!channelIt->isOperator(clientSocket)) {
-        client.appendOutputBuffer(":server@localhost 482 " + client.getNickname() + " " + channelName + " :You're not channel operator\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel->isOperator(clientSocket)) {
+        Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
     // Find target client by nickname
-    int targetSocket = -1;
-    for (std::map<int, Client>::iterator it = server.m_clients.begin(); it != server.m_clients.end(); ++it) {
-        if (it->second.getNickname() == targetNick) {
-            targetSocket = it->first;
-            break;
-        }
-    }
+    int targetSocket = server.nicks.find(targetNick);
 
     if (targetSocket == -1) {
-        client.appendOutputBuffer(":server@localhost 401 " + client.getNickname() + " " + targetNick + " :No such nick\r\n");
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NOSUCHNICK).param(targetNick).send();
+        shard.markDirty(client);
         return;
     }
 
     // Check if target is in the channel
-    if (channelIt->getMembers().find(targetSocket) == channelIt->getMembers().end()) {
-        client.appendOutputBuffer(":server@localhost 441 " + client.getNickname() + " " + targetNick + " " + channelName + " :They aren't on that channel\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel->hasMember(targetSocket)) {
+        Reply(client, ERR_USERNOTINCHANNEL).param(targetNick).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
     // Remove target from channel
-    channelIt->removeMember(targetSocket);
-    // Send KICK message to all channel members, including the kicked client
-    std::string kickMessage = ":" + client.getNickname() + "!" + client.getUsername() + "@localhost KICK " + channelName + " " + targetNick + " :" + reason + "\r\n";
-    // Store the members map to avoid temporary objects
-    const std::map<int, bool> members = channelIt->getMembers();
-    for (std::map<int, bool>::const_iterator memberIt = members.begin(); memberIt != members.end(); ++memberIt) {
-        server.m_clients[memberIt->first].appendOutputBuffer(kickMessage);
-        for (size_t j = 0; j < fds.size(); ++j) {
-            if (fds[j].fd == memberIt->first) {
-                fds[j].events |= POLLOUT;
-                break;
-            }
-        }
-    }
+    server.channels.leave(channel, targetSocket);
+    // Announce the KICK to the remaining members and to the kicked client
+    router.route(Event::kick(clientSocket, channel, targetSocket, targetNick, reason));
 
-    // Ensure the kicked client receives the KICK message
-    server.m_clients[targetSocket].appendOutputBuffer(kickMessage);
-    for (size_t j = 0; j < fds.size(); ++j) {
-        if (fds[j].fd == targetSocket) {
-            fds[j].events |= POLLOUT;
-            break;
-        }
-    }
-
-    fds[i].events |= POLLOUT;
+    shard.markDirty(client);
+    // An operator kicking themselves out of a channel may leave it empty
+    server.channels.reclaimIfEmpty(channel);
 }
 
-void CommandHandler::handleInvite(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    if (input.length() <= 7) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " INVITE :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleInvite(int clientSocket, const Message& msg, Client& client) {
+    // Parameters: INVITE <nick> <channel>
+    if (msg.paramCount < 2) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("INVITE").send();
+        shard.markDirty(client);
         return;
     }
-    std::string params = input.substr(7);
-    size_t spacePos = params.find(' ');
-    if (spacePos == std::string::npos) {
-        std::string response = ":server@localhost 461 " + client.getNickname() + " INVITE :Not enough parameters\r\n";
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
-        return;
-    }
-    std::string targetNick = params.substr(0, spacePos);
-    std::string channelName = params.substr(spacePos + 1);
-    while (!targetNick.empty() && targetNick[0] == ' ') targetNick.erase(0, 1);
-    while (!channelName.empty() && (channelName[0] == ' ' || channelName[channelName.length() - 1] == ' '))
-        channelName.erase(channelName[0] == ' ' ? 0 : channelName.length() - 1, 1);
-
-    for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-        if (it->getName() == channelName) {
-            if (!it->isOperator(clientSocket)) {
-                std::string response = ":server@localhost 482 " + client.getNickname() + " " + channelName + " :You're not channel operator\r\n";
-                client.appendOutputBuffer(response);
-                fds[i].events |= POLLOUT;
-                return;
-            }
-            int targetSocket = -1;
-            for (std::map<int, Client>::iterator clientIt = server.m_clients.begin(); clientIt != server.m_clients.end(); ++clientIt) {
-                if (clientIt->second.getNickname() == targetNick) {
-                    targetSocket = clientIt->first;
-                    break;
-                }
-            }
-            if (targetSocket == -1) {
-                std::string response = ":server@localhost 401 " + client.getNickname() + " " + targetNick + " :No such nick/channel\r\n";
-                client.appendOutputBuffer(response);
-                fds[i].events |= POLLOUT;
-                return;
-            }
-            it->invite(targetSocket);
-            std::map<int, Client>::iterator targetIt = server.m_clients.find(targetSocket);
-            if (targetIt != server.m_clients.end()) {
-                std::string response = ":" + client.getNickname() + "!" + client.getUsername() + "@localhost INVITE " + targetNick + " :" + channelName + "\r\n";
-                targetIt->second.appendOutputBuffer(response);
-                client.appendOutputBuffer(":server@localhost 341 " + client.getNickname() + " " + targetNick + " " + channelName + "\r\n");
-                fds[i].events |= POLLOUT;
-                for (size_t j = 0; j < fds.size(); ++j) {
-                    if (fds[j].fd == targetSocket) {
-                        fds[j].events |= POLLOUT;
-                        break;
-                    }
-                }
-            }
+    std::string targetNick = msg.param(0);
+    std::string channelName = msg.param(1);
+
+    WriteGuard channelsGuard(server.channelsLock); // the invite list
+    ReadGuard clientsGuard(server.clientsLock);
+    Channel* channel = server.channels.find(channelName);
+    if (channel) {
+        if (!channel->isOperator(clientSocket)) {
+            Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send();
+            shard.markDirty(client);
             return;
         }
+        int targetSocket = server.nicks.find(targetNick);
+        if (targetSocket == -1) {
+            Reply(client, ERR_NOSUCHNICK).param(targetNick).send();
+            shard.markDirty(client);
+            return;
+        }
+        server.channels.invite(channel, targetSocket);
+        std::map<int, Client*>::iterator targetIt = server.m_clients.find(targetSocket);
+        if (targetIt != server.m_clients.end()) {
+            std::string response = ":" + client.getNickname() + "!" + client.getUsername() + "@localhost INVITE " + targetNick + " :" + channelName + "\r\n";
+            shard.deliver(targetSocket, response);
+            Reply(client, RPL_INVITING).param(targetNick).param(channelName).send();
+            shard.markDirty(client);
+        }
+        return;
     }
-    std::string response = ":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n";
-    client.appendOutputBuffer(response);
-    fds[i].events |= POLLOUT;
+    Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+    shard.markDirty(client);
 }
 
-void CommandHandler::handleTopic(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    // Parse input: TOPIC <channel> [:<topic>]
-    std::string params = input.substr(6); // Skip "TOPIC "
-    if (params.empty()) {
-        client.appendOutputBuffer(":server@localhost 461 " + client.getNickname() + " TOPIC :Not enough parameters\r\n");
-        fds[i].events |= POLLOUT;
+void CommandHandler::handleTopic(int clientSocket, const Message& msg, Client& client) {
+    // Parameters: TOPIC <channel> [:<topic>]
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("TOPIC").send();
+        shard.markDirty(client);
         return;
     }
 
-    // Extract channel name and optional topic
-    std::string channelName;
-    std::string newTopic;
-    size_t colonPos = params.find(':');
-    if (colonPos == std::string::npos) {
-        channelName = params;
-    } else {
-        channelName = params.substr(0, colonPos);
-        newTopic = params.substr(colonPos + 1);
-    }
-
-    // Trim whitespace from channel name
-    while (!channelName.empty() && (channelName[0] == ' ' || channelName[channelName.length() - 1] == ' '))
-        channelName.erase(channelName[0] == ' ' ? 0 : channelName.length() - 1, 1);
+    // A second parameter, even an empty ":", sets the topic
+    std::string channelName = msg.param(0);
+    bool setTopic = msg.paramCount >= 2;
+    std::string newTopic = msg.param(1);
 
     // Validate channel name
     if (channelName.empty() || channelName[0] != '#') {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
-    // Find channel
-    std::vector<Channel>::iterator channelIt = server.channels.end();
-    for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-        if (it->getName() == channelName) {
-            channelIt = it;
-            break;
-        }
-    }
+    // Find channel; the topic changes under the channel's own lock, the directory stays shared
+    ReadGuard channelsGuard(server.channelsLock);
+    ReadGuard clientsGuard(server.clientsLock);
+    Channel* channel = server.channels.find(channelName);
 
-    if (channelIt == server.channels.end()) {
-        client.appendOutputBuffer(":server@localhost 403 " + client.getNickname() + " " + channelName + " :No such channel\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel) {
+        Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
-    std::map<int, bool> members = channelIt->getMembers();
+    MutexGuard channelGuard(channel->getLock());
     // Check if client is a member of the channel
-    if (channelIt->getMembers().find(clientSocket) == channelIt->getMembers().end()) {
-        client.appendOutputBuffer(":server@localhost 442 " + client.getNickname() + " " + channelName + " :You're not on that channel\r\n");
-        fds[i].events |= POLLOUT;
+    if (!channel->hasMember(clientSocket)) {
+        Reply(client, ERR_NOTONCHANNEL).param(channelName).send();
+        shard.markDirty(client);
         return;
     }
 
     // Handle topic viewing or setting
-    if (colonPos == std::string::npos) {
+    if (!setTopic) {
         // View topic
-        std::string topic = channelIt->getTopic();
-        std::string response;
+        const std::string& topic = channel->getTopic();
         if (topic.empty()) {
-            response = ":server@localhost 331 " + client.getNickname() + " " + channelName + " :No topic is set\r\n";
+            Reply(client, RPL_NOTOPIC).param(channelName).send();
         } else {
-            response = ":server@localhost 332 " + client.getNickname() + " " + channelName + " :" + topic + "\r\n";
+            Reply(client, RPL_TOPIC).param(channelName).send(topic);
         }
-        client.appendOutputBuffer(response);
-        fds[i].events |= POLLOUT;
+        shard.markDirty(client);
     } else {
         // Set topic
-        if (channelIt->isTopicRestricted() && !channelIt->isOperator(clientSocket)) {
-            client.appendOutputBuffer(":server@localhost 482 " + client.getNickname() + " " + channelName + " :You're not channel operator\r\n");
-            fds[i].events |= POLLOUT;
+        if (channel->isTopicRestricted() && !channel->isOperator(clientSocket)) {
+            Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send();
+            shard.markDirty(client);
             return;
         }
 
@@ -824,225 +661,128 @@ void CommandHandler::handleTopic(int clientSocket, const std::string& input, Cli
             newTopic.erase(newTopic.length() - 1, 1);
 
         // Set the new topic
-        channelIt->setTopic(newTopic);
-
-        // Broadcast topic change to all channel members
-        std::string message = ":" + client.getNickname() + "!" + client.getUsername() + "@localhost TOPIC " + channelName + " :" + newTopic + "\r\n";
-        for (std::map<int, bool>::const_iterator it = members.begin(); it != members.end(); ++it) {
-            server.m_clients[it->first].appendOutputBuffer(message);
-            for (size_t j = 0; j < fds.size(); ++j) {
-                if (fds[j].fd == it->first) {
-                    fds[j].events |= POLLOUT;
-                    break;
-                }
-            }
-        }
-        fds[i].events |= POLLOUT;
+        channel->setTopic(newTopic);
+
+        // Announce the topic change to all channel members
+        router.route(Event::topicChange(clientSocket, channel, newTopic));
+        shard.markDirty(client);
     }
 }
 
-void CommandHandler::handleUnknownCommand(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i) {
-    std::string response = ":server 421 " + client.getNickname() + " " + input + " :Unknown command\r\n";
-    client.appendOutputBuffer(response);
-    fds[i].events |= POLLOUT;
+/* OPER <name> <password>: the name is not checked, there is one password
+for everybody (`oper_password`); without it OPER is refused outright. */
+
+void CommandHandler::handleOper(const Message& msg, Client& client) {
+    const std::string& password = server.config.getOperPassword();
+    if (password.empty()) {
+        Reply(client, ERR_NOOPERHOST).send();
+    } else if (msg.paramCount < 2) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("OPER").send();
+    } else if (!msg.paramEquals(1, password.c_str())) {
+        LOG_WARN("Failed OPER attempt from " << client.getNickname());
+        Reply(client, ERR_PASSWDMISMATCH).send();
+    } else {
+        client.setOper(true);
+        LOG_INFO(client.getNickname() << " is now an operator");
+        Reply(client, RPL_YOUREOPER).send();
+    }
+    shard.markDirty(client);
 }
 
-void CommandHandler::processCommand(int clientSocket, const std::string& input, std::vector<pollfd>& fds, size_t i) {
-    Client* client;
-    if (!checkClient(clientSocket, fds, client)) {
+/* STATS m: lines received per command (212).
+   STATS z: the metrics text the admin socket serves, one 249 per sample.
+   Other letters only get the end-of-report reply. Operators only. */
+
+void CommandHandler::handleStats(const Message& msg, Client& client) {
+    if (!client.isOper()) {
+        Reply(client, ERR_NOPRIVILEGES).send();
+        shard.markDirty(client);
         return;
     }
-
-    if (!client->isPasswordEntered()) {
-        handlePassword(clientSocket, input, *client, fds, i);
-    } else {
-        if (input == server.config.getPassword()) {
-            std::cout << "Ignoring repeated password input: " << input << "\n";
-            return;
+    if (msg.paramCount == 0) {
+        Reply(client, ERR_NEEDMOREPARAMS).param("STATS").send();
+        shard.markDirty(client);
+        return;
+    }
+    std::string query = msg.param(0);
+    if (query == "m") {
+        ShardMetrics total;
+        for (size_t i = 0; i < server.shards.size(); ++i) {
+            total.accumulate(server.shards[i]->getMetrics());
         }
-        if (input.rfind("CAP LS", 0) == 0) {
-            std::string response = ":server CAP * LS :\r\n"; /* иначе ирсси ругаеца */
-            client->appendOutputBuffer(response);
-            fds[i].events |= POLLOUT;
-            return;
+        for (size_t i = 0; i < CMD_COUNT; ++i) {
+            if (total.linesIn[i] == 0)
+                continue;
+            char count[24];
+            snprintf(count, sizeof(count), "%lu", total.linesIn[i]);
+            Reply(client, RPL_STATSCOMMANDS).param(commandName(static_cast<CommandId>(i))).param(count).send();
         }
-        if (strncmp(input.c_str(), "QUIT", 4) == 0) {
-            handleQuit(clientSocket, *client, fds);
-        } else if (input.rfind("NICK", 0) == 0) {
-            handleNick(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("USER", 0) == 0) {
-            handleUser(input, *client, fds, i); 
-        } else if (input.rfind("JOIN", 0) == 0) {
-            handleJoin(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("PRIVMSG", 0) == 0) {
-            handlePrivmsg(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("WHOIS", 0) == 0) { /* иначе ирсси ругаеца */
-            handleWhois(input, *client, fds, i);
-        } else if (input.rfind("MODE ", 0) == 0) {
-            handleMode(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("PING", 0) == 0) {
-            handlePing(input, *client, fds, i);
-        } else if (input.rfind("KICK", 0) == 0) {
-            handleKick(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("INVITE", 0) == 0) {
-            handleInvite(clientSocket, input, *client, fds, i);
-        } else if (input.rfind("TOPIC", 0) == 0) {
-            handleTopic(clientSocket, input, *client, fds, i);
-        } else {
-            handleUnknownCommand(input, *client, fds, i);
+    } else if (query == "z") {
+        std::string text;
+        MetricsExporter::render(server, text);
+        size_t begin = 0;
+        while (begin < text.size()) {
+            size_t end = text.find('\n', begin);
+            if (text[begin] != '#')
+                Reply(client, RPL_STATSDEBUG).send(text.substr(begin, end - begin));
+            begin = end + 1;
         }
     }
+    Reply(client, RPL_ENDOFSTATS).param(query).send();
+    shard.markDirty(client);
 }
 
-void CommandHandler::broadcastMessage(int senderSocket, const std::string& message, std::vector<pollfd>& fds) {
-    std::string command, target, text, kickedNick;
-    size_t firstSpace = message.find(' ');
-
-    if (message[0] == ':' && firstSpace != std::string::npos) {
-        size_t commandStart = message.find(' ', firstSpace + 1); 
-        if (commandStart != std::string::npos) {
-            command = message.substr(firstSpace + 1, commandStart - firstSpace - 1); 
-            size_t secondSpace = message.find(' ', commandStart + 1);
-            if (command == "JOIN" || command == "MODE") {
-                target = message.substr(commandStart + 1); 
-            } else if (command == "PRIVMSG") {
-                if (secondSpace == std::string::npos) return;
-                target = message.substr(commandStart + 1, secondSpace - commandStart - 1); 
-                size_t colonPos = message.find(':');
-                if (colonPos == std::string::npos) return;
-                text = message.substr(colonPos + 1); 
-            } else if (command == "KICK") {
-                if (secondSpace == std::string::npos) return;
-                size_t thirdSpace = message.find(' ', secondSpace + 1);
-                if (thirdSpace == std::string::npos) return;
-                target = message.substr(commandStart + 1, secondSpace - commandStart - 1);
-                kickedNick = message.substr(secondSpace + 1, thirdSpace - secondSpace - 1);
-                size_t colonPos = message.find(':');
-                text = (colonPos != std::string::npos && colonPos + 1 < message.length() && message.substr(colonPos + 1).find_first_not_of(" \r\n") != std::string::npos) ? message.substr(colonPos + 1) : "Kicked by operator";
-            }
-        } else {
-            return;
-        }
-    } else {
-        if (firstSpace == std::string::npos) return;
-        command = message.substr(0, firstSpace);
-        size_t secondSpace = message.find(' ', firstSpace + 1);
-        if (secondSpace == std::string::npos && command != "JOIN" && command != "MODE" && command != "KICK") return;
-        if (command == "JOIN" || command == "MODE") {
-            target = message.substr(firstSpace + 1);
-        } else if (command == "PRIVMSG") {
-            target = message.substr(firstSpace + 1, secondSpace - firstSpace - 1);
-            size_t colonPos = message.find(':');
-            if (colonPos == std::string::npos) return;
-            text = message.substr(colonPos + 1);
-        } else if (command == "KICK") {
-            size_t thirdSpace = message.find(' ', secondSpace + 1);
-            if (thirdSpace == std::string::npos) return;
-            target = message.substr(firstSpace + 1, secondSpace - firstSpace - 1);
-            kickedNick = message.substr(secondSpace + 1, thirdSpace - secondSpace - 1);
-            size_t colonPos = message.find(':');
-            text = (colonPos != std::string::npos && colonPos + 1 < message.length() && message.substr(colonPos + 1).find_first_not_of(" \r\n") != std::string::npos) ? message.substr(colonPos + 1) : "Kicked by operator";
-        }
+void CommandHandler::handleUnknownCommand(const Message& msg, Client& client) {
+    Reply(client, ERR_UNKNOWNCOMMAND).param(msg.raw.data, msg.raw.length).send();
+    shard.markDirty(client);
+}
+
+/* The shard parses each line once into a Message whose parts point into
+it; the handlers read their parameters from there. Dispatch is a switch on
+the command id that `lookupCommand` resolved during parsing. */
+
+void CommandHandler::processCommand(int clientSocket, const Message& msg) {
+    Client* client;
+    if (!checkClient(clientSocket, client)) {
+        return;
     }
 
-    std::string senderNick = server.m_clients[senderSocket].getNickname();
-    std::string senderUser = server.m_clients[senderSocket].getUsername();
+    if (msg.id != CMD_PING && msg.id != CMD_PONG) {
+        client->setLastCommand(shard.now()); /* keepalive traffic does not count against idle_timeout */
+    }
 
-    if (command == "PRIVMSG") {
-        if (target[0] == '#') {
-            for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-                if (it->getName() == target) {
-                    std::map<int, bool> members = it->getMembers();
-                    for (std::map<int, bool>::iterator memberIt = members.begin(); memberIt != members.end(); ++memberIt) {
-                        if (memberIt->first != senderSocket) {
-                            std::string response = ":" + senderNick + "!" + senderUser + "@localhost PRIVMSG " + target + " :" + text + "\r\n";
-                            server.m_clients[memberIt->first].appendOutputBuffer(response);
-                            for (size_t i = 0; i < fds.size(); ++i) {
-                                if (fds[i].fd == memberIt->first) {
-                                    fds[i].events |= POLLOUT;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    return; 
-                }
-            }
-        } else {
-            for (std::map<int, Client>::iterator it = server.m_clients.begin(); it != server.m_clients.end(); ++it) {
-                if (it->second.getNickname() == target && it->first != senderSocket) {
-                    std::string response = ":" + senderNick + "!" + senderUser + "@localhost PRIVMSG " + target + " :" + text + "\r\n";
-                    server.m_clients[it->first].appendOutputBuffer(response);
-                    for (size_t i = 0; i < fds.size(); ++i) {
-                        if (fds[i].fd == it->first) {
-                            fds[i].events |= POLLOUT;
-                            break;
-                        }
-                    }
-                    return;
-                }
-            }
-        }
-    } else if (command == "JOIN") {
-        std::cout << "Broadcasting JOIN for channel: " << target << std::endl;
-        for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-            if (it->getName() == target) {
-                std::map<int, bool> members = it->getMembers();
-                std::cout << "Channel " << target << " has " << members.size() << " members" << std::endl;
-                for (std::map<int, bool>::iterator memberIt = members.begin(); memberIt != members.end(); ++memberIt) {
-                    if (memberIt->first != senderSocket) {
-                        std::string response = ":" + senderNick + "!" + senderUser + "@localhost JOIN " + target + "\r\n";
-                        server.m_clients[memberIt->first].appendOutputBuffer(response);
-                        for (size_t i = 0; i < fds.size(); ++i) {
-                            if (fds[i].fd == memberIt->first) {
-                                fds[i].events |= POLLOUT;
-                                break;
-                            }
-                        }
-                    }
-                }
-                break;
-            }
-        }
-    } else if (command == "MODE") {
-        size_t spacePos = target.find(' ');
-        if (spacePos == std::string::npos) return;
-        std::string channelName = target.substr(0, spacePos);
-        for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-            if (it->getName() == channelName) {
-                std::map<int, bool> members = it->getMembers();
-                for (std::map<int, bool>::iterator memberIt = members.begin(); memberIt != members.end(); ++memberIt) {
-                    if (memberIt->first != senderSocket) {
-                        std::string response = ":" + senderNick + "!" + senderUser + "@localhost MODE " + target + "\r\n";
-                        server.m_clients[memberIt->first].appendOutputBuffer(response);
-                        for (size_t i = 0; i < fds.size(); ++i) {
-                            if (fds[i].fd == memberIt->first) {
-                                fds[i].events |= POLLOUT;
-                                break;
-                            }
-                        }
-                    }
-                }
-                break;
-            }
-        }
-    } else if (command == "KICK") {
-        for (std::vector<Channel>::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
-            if (it->getName() == target) {
-                std::map<int, bool> members = it->getMembers();
-                std::string response = ":" + senderNick + "!" + senderUser + "@localhost KICK " + target + " " + kickedNick + " :" + text + "\r\n";
-                for (std::map<int, bool>::iterator memberIt = members.begin(); memberIt != members.end(); ++memberIt) {
-                    std::cout << "Sending KICK to member: " << memberIt->first << std::endl;
-                    server.m_clients[memberIt->first].appendOutputBuffer(response);
-                    for (size_t i = 0; i < fds.size(); ++i) {
-                        if (fds[i].fd == memberIt->first) {
-                            fds[i].events |= POLLOUT;
-                            break;
-                        }
-                    }
-                }
-                break; 
+    if (!client->isPasswordEntered()) {
+        handlePassword(clientSocket, msg, *client);
+        return;
+    }
+    const std::string& password = server.config.getPassword();
+    if (msg.raw.length == password.length() && password.compare(0, password.length(), msg.raw.data, msg.raw.length) == 0) {
+        LOG_DEBUG("Ignoring repeated password input: " << password);
+        return;
+    }
+
+    switch (msg.id) {
+        case CMD_CAP:
+            if (msg.paramEquals(0, "LS")) {
+                std::string response = ":server CAP * LS :\r\n"; /* иначе ирсси ругаеца */
+                client->appendOutputBuffer(response);
+                shard.markDirty(*client);
             }
-        }
+            break;
+        case CMD_QUIT:    handleQuit(clientSocket, *client); break;
+        case CMD_NICK:    handleNick(clientSocket, msg, *client); break;
+        case CMD_USER:    handleUser(msg, *client); break;
+        case CMD_JOIN:    handleJoin(clientSocket, msg, *client); break;
+        case CMD_PRIVMSG: handlePrivmsg(clientSocket, msg, *client); break;
+        case CMD_WHOIS:   handleWhois(msg, *client); break; /* иначе ирсси ругаеца */
+        case CMD_MODE:    handleMode(clientSocket, msg, *client); break;
+        case CMD_PING:    handlePing(msg, *client); break;
+        case CMD_PONG:    break; /* the read itself already counted as activity */
+        case CMD_KICK:    handleKick(clientSocket, msg, *client); break;
+        case CMD_INVITE:  handleInvite(clientSocket, msg, *client); break;
+        case CMD_TOPIC:   handleTopic(clientSocket, msg, *client); break;
+        case CMD_OPER:    handleOper(msg, *client); break;
+        case CMD_STATS:   handleStats(msg, *client); break;
+        default:          handleUnknownCommand(msg, *client); break;
     }
 }
@@ -2,33 +2,39 @@
 
 #include <string>
 #include <vector>
-#include <poll.h>
 #include "Client.hpp"
+#include "LineFramer.hpp"
+#include "Message.hpp"
+#include "EventRouter.hpp"
 
 class Server;
 class Channel;
+class Shard;
 
 class CommandHandler {
 public:
-    CommandHandler(Server& s);
-    void processCommand(int clientSocket, const std::string& input, std::vector<pollfd>& fds, size_t i);
-    void broadcastMessage(int senderSocket, const std::string& message, std::vector<pollfd>& fds);
+    CommandHandler(Server& s, Shard& sh);
+    void processCommand(int clientSocket, const Message& msg);
 
 private:
     Server& server;
+    Shard& shard; /* the shard whose thread runs this handler */
+    EventRouter router;
 
-    bool checkClient(int clientSocket, std::vector<pollfd>& fds, Client*& client);
-    void handlePassword(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleQuit(int clientSocket, Client& client, std::vector<pollfd>& fds);
-    void handleNick(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleUser(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i); // убрал clientSocket
-    void handleJoin(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handlePrivmsg(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleWhois(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleMode(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handlePing(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleKick(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleInvite(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleTopic(int clientSocket, const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
-    void handleUnknownCommand(const std::string& input, Client& client, std::vector<pollfd>& fds, size_t i);
+    bool checkClient(int clientSocket, Client*& client);
+    void handlePassword(int clientSocket, const Message& msg, Client& client);
+    void handleQuit(int clientSocket, Client& client);
+    void handleNick(int clientSocket, const Message& msg, Client& client);
+    void handleUser(const Message& msg, Client& client); // убрал clientSocket
+    void handleJoin(int clientSocket, const Message& msg, Client& client);
+    void handlePrivmsg(int clientSocket, const Message& msg, Client& client);
+    void handleWhois(const Message& msg, Client& client);
+    void handleMode(int clientSocket, const Message& msg, Client& client);
+    void handlePing(const Message& msg, Client& client);
+    void handleKick(int clientSocket, const Message& msg, Client& client);
+    void handleInvite(int clientSocket, const Message& msg, Client& client);
+    void handleTopic(int clientSocket, const Message& msg, Client& client);
+    void handleOper(const Message& msg, Client& client);
+    void handleStats(const Message& msg, Client& client);
+    void handleUnknownCommand(const Message& msg, Client& client);
 };
@@ -1,18 +1,31 @@
 #include "Config.hpp"
-#include <iostream>
+#include "Log.hpp"
 #include <stdexcept>
 #include <cstdlib>
 #include <fstream>
 #include <sstream> 
+#include <sys/un.h>
 
 /* Definition of static constants */
 const int Config::MIN_PORT = 1;
 const int Config::MAX_PORT = 65535;
 const size_t Config::MIN_PASSWORD_LENGTH = 4;
+const int Config::MAX_THREADS = 64;
+const int Config::MAX_LISTEN_BACKLOG = 65535;
+const int Config::MAX_TIMEOUT = 7 * 24 * 3600;
+const int Config::MAX_FLOOD_BURST = 10000;
+const int Config::MAX_FLOOD_RATE = 100000;
+const long Config::MIN_QUEUE_LIMIT = 1024;
+const long Config::MAX_QUEUE_LIMIT = 1L << 30;
+const long Config::MIN_READ_BUDGET = 512;
+const int Config::MAX_COMMAND_BUDGET = 100000;
 
 /* Constructor initializes Config object with a port number and password.
    Validates port and password before assignment. */
-Config::Config(int p, const std::string& pw) {
+Config::Config(int p, const std::string& pw) : reactorBackend("epoll"), threads(1), listenBacklog(1024), logLevel(LOG_LEVEL_INFO),
+      registrationTimeout(60), pingInterval(120), pingTimeout(60), idleTimeout(0),
+      floodBurst(20), floodRate(4), sendQueueLimit(262144), recvQueueLimit(8192),
+      readBudget(16384), commandBudget(256) {
     validatePort(p);
     validatePassword(pw);
     port = p;
@@ -29,6 +42,217 @@ std::string Config::getPassword() const {
     return password;
 }
 
+/* Returns the event loop backend ("uring", "epoll" or "poll") */
+std::string Config::getReactorBackend() const {
+    return reactorBackend;
+}
+
+void Config::setReactorBackend(const std::string& backend) {
+    if (backend != "uring" && backend != "epoll" && backend != "poll") {
+        throw std::runtime_error("Reactor backend must be 'uring', 'epoll' or 'poll'");
+    }
+    reactorBackend = backend;
+}
+
+/* Returns the number of reactor threads (shards) */
+int Config::getThreads() const {
+    return threads;
+}
+
+void Config::setThreads(int count) {
+    if (count < 1 || count > MAX_THREADS) {
+        std::ostringstream oss;
+        oss << "Threads must be between 1 and " << MAX_THREADS;
+        throw std::runtime_error(oss.str());
+    }
+    threads = count;
+}
+
+/* Connections waiting for accept() on each shard's socket; the kernel drops
+   SYNs past that, and the client only retries after a second or more */
+int Config::getListenBacklog() const {
+    return listenBacklog;
+}
+
+void Config::setListenBacklog(int connections) {
+    if (connections < 1 || connections > MAX_LISTEN_BACKLOG) {
+        std::ostringstream oss;
+        oss << "Listen backlog must be between 1 and " << MAX_LISTEN_BACKLOG;
+        throw std::runtime_error(oss.str());
+    }
+    listenBacklog = connections;
+}
+
+/* Returns the lowest level the log writes; DEBUG adds per-read and per-send lines */
+LogLevel Config::getLogLevel() const {
+    return logLevel;
+}
+
+void Config::setLogLevel(LogLevel level) {
+    logLevel = level;
+}
+
+/* Seconds a new connection gets to send PASS, NICK and USER */
+int Config::getRegistrationTimeout() const {
+    return registrationTimeout;
+}
+
+void Config::setRegistrationTimeout(int seconds) {
+    validateTimeout("Registration timeout", seconds, 1);
+    registrationTimeout = seconds;
+}
+
+/* Seconds of silence after which a registered client is sent a PING */
+int Config::getPingInterval() const {
+    return pingInterval;
+}
+
+void Config::setPingInterval(int seconds) {
+    validateTimeout("Ping interval", seconds, 1);
+    pingInterval = seconds;
+}
+
+/* Seconds the client has to answer that PING */
+int Config::getPingTimeout() const {
+    return pingTimeout;
+}
+
+void Config::setPingTimeout(int seconds) {
+    validateTimeout("Ping timeout", seconds, 1);
+    pingTimeout = seconds;
+}
+
+/* Seconds without a command other than PING/PONG before a client is dropped, 0 never */
+int Config::getIdleTimeout() const {
+    return idleTimeout;
+}
+
+void Config::setIdleTimeout(int seconds) {
+    validateTimeout("Idle timeout", seconds, 0);
+    idleTimeout = seconds;
+}
+
+/* Tokens a client may spend at once before its commands are delayed */
+int Config::getFloodBurst() const {
+    return floodBurst;
+}
+
+void Config::setFloodBurst(int tokens) {
+    if (tokens < 1 || tokens > MAX_FLOOD_BURST) {
+        std::ostringstream oss;
+        oss << "Flood burst must be between 1 and " << MAX_FLOOD_BURST;
+        throw std::runtime_error(oss.str());
+    }
+    floodBurst = tokens;
+}
+
+/* Tokens per second given back to each client; 0 disables flood control */
+int Config::getFloodRate() const {
+    return floodRate;
+}
+
+void Config::setFloodRate(int tokensPerSecond) {
+    if (tokensPerSecond < 0 || tokensPerSecond > MAX_FLOOD_RATE) {
+        std::ostringstream oss;
+        oss << "Flood rate must be between 0 and " << MAX_FLOOD_RATE;
+        throw std::runtime_error(oss.str());
+    }
+    floodRate = tokensPerSecond;
+}
+
+/* Bytes that may wait to be sent to one client ("SendQ exceeded" past that) */
+size_t Config::getSendQueueLimit() const {
+    return sendQueueLimit;
+}
+
+void Config::setSendQueueLimit(long bytes) {
+    validateQueueLimit("SendQ limit", bytes);
+    sendQueueLimit = static_cast<size_t>(bytes);
+}
+
+/* Bytes received from one client but not yet run as commands, including parked ones */
+size_t Config::getRecvQueueLimit() const {
+    return recvQueueLimit;
+}
+
+void Config::setRecvQueueLimit(long bytes) {
+    validateQueueLimit("RecvQ limit", bytes);
+    recvQueueLimit = static_cast<size_t>(bytes);
+}
+
+/* Bytes read from one client per loop iteration before the shard moves on
+   (never more than its RecvQ has room for) */
+size_t Config::getReadBudget() const {
+    return readBudget;
+}
+
+void Config::setReadBudget(long bytes) {
+    if (bytes < MIN_READ_BUDGET || bytes > MAX_QUEUE_LIMIT) {
+        std::ostringstream oss;
+        oss << "Read budget must be between " << MIN_READ_BUDGET << " and " << MAX_QUEUE_LIMIT << " bytes";
+        throw std::runtime_error(oss.str());
+    }
+    readBudget = static_cast<size_t>(bytes);
+}
+
+/* Commands run for one client per loop iteration; the rest wait for the next one */
+int Config::getCommandBudget() const {
+    return commandBudget;
+}
+
+void Config::setCommandBudget(int commands) {
+    if (commands < 1 || commands > MAX_COMMAND_BUDGET) {
+        std::ostringstream oss;
+        oss << "Command budget must be between 1 and " << MAX_COMMAND_BUDGET;
+        throw std::runtime_error(oss.str());
+    }
+    commandBudget = commands;
+}
+
+/* Path of the admin Unix socket serving metrics; it must fit in sun_path */
+const std::string& Config::getAdminSocket() const {
+    return adminSocket;
+}
+
+void Config::setAdminSocket(const std::string& path) {
+    struct sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::ostringstream oss;
+        oss << "Admin socket path must be shorter than " << sizeof(address.sun_path) << " characters";
+        throw std::runtime_error(oss.str());
+    }
+    adminSocket = path;
+}
+
+/* Password checked by OPER; the same length rule as the server password */
+const std::string& Config::getOperPassword() const {
+    return operPassword;
+}
+
+void Config::setOperPassword(const std::string& pw) {
+    validatePassword(pw);
+    operPassword = pw;
+}
+
+/* Throws an exception if a queue limit is out of range. The lower bound
+   leaves room for a couple of full-length lines. */
+void Config::validateQueueLimit(const char* name, long bytes) {
+    if (bytes < MIN_QUEUE_LIMIT || bytes > MAX_QUEUE_LIMIT) {
+        std::ostringstream oss;
+        oss << name << " must be between " << MIN_QUEUE_LIMIT << " and " << MAX_QUEUE_LIMIT << " bytes";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+/* Throws an exception if a timeout is out of range (`min`..one week). */
+void Config::validateTimeout(const char* name, int seconds, int min) {
+    if (seconds < min || seconds > MAX_TIMEOUT) {
+        std::ostringstream oss;
+        oss << name << " must be between " << min << " and " << MAX_TIMEOUT << " seconds";
+        throw std::runtime_error(oss.str());
+    }
+}
+
 /* Validates the port number.
    Throws an exception if the port is not within the allowed range (1-65535). */
 void Config::validatePort(int p) const {
@@ -68,14 +292,14 @@ void Config::validatePassword(const std::string& pw) const {
 bool Config::loadFromFile(const std::string& filename) {
     std::ifstream file(filename.c_str());
     if (!file.is_open()) {
-        std::cerr << "Warning: Could not open config file " << filename << std::endl;
+        LOG_WARN("Could not open config file " << filename);
         return false;
     }
 
     int newPort;
     std::string newPassword;
     if (!(file >> newPort >> newPassword)) {
-        std::cerr << "Warning: Invalid config file format" << std::endl;
+        LOG_WARN("Invalid config file format");
         file.close();
         return false;
     }
@@ -86,7 +310,7 @@ bool Config::loadFromFile(const std::string& filename) {
         port = newPort;
         password = newPassword;
     } catch (const std::runtime_error& e) {
-        std::cerr << "Config file error: " << e.what() << std::endl;
+        LOG_ERROR("Config file error: " << e.what());
         file.close();
         return false;
     }
@@ -94,3 +318,70 @@ bool Config::loadFromFile(const std::string& filename) {
     file.close();
     return true;
 }
+
+/* Loads optional tuning settings from a file.
+   Each non-empty line is "<key> <value>", lines starting with '#' are comments.
+   Unknown keys and invalid values are reported and skipped.
+   Returns false only if the file cannot be opened. */
+bool Config::loadOptions(const std::string& filename) {
+    std::ifstream file(filename.c_str());
+    if (!file.is_open()) {
+        LOG_WARN("Could not open options file " << filename);
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string key, value;
+        if (!(iss >> key) || key[0] == '#')
+            continue;
+        if (!(iss >> value)) {
+            LOG_WARN("Missing value for option " << key);
+            continue;
+        }
+        try {
+            if (key == "reactor") {
+                setReactorBackend(value);
+            } else if (key == "threads") {
+                setThreads(atoi(value.c_str()));
+            } else if (key == "listen_backlog") {
+                setListenBacklog(atoi(value.c_str()));
+            } else if (key == "log_level") {
+                LogLevel level;
+                if (!Log::parseLevel(value, level))
+                    throw std::runtime_error("Invalid log level '" + value + "', expected debug, info, warn or error");
+                setLogLevel(level);
+            } else if (key == "registration_timeout") {
+                setRegistrationTimeout(atoi(value.c_str()));
+            } else if (key == "ping_interval") {
+                setPingInterval(atoi(value.c_str()));
+            } else if (key == "ping_timeout") {
+                setPingTimeout(atoi(value.c_str()));
+            } else if (key == "idle_timeout") {
+                setIdleTimeout(atoi(value.c_str()));
+            } else if (key == "flood_burst") {
+                setFloodBurst(atoi(value.c_str()));
+            } else if (key == "flood_rate") {
+                setFloodRate(atoi(value.c_str()));
+            } else if (key == "sendq") {
+                setSendQueueLimit(atol(value.c_str()));
+            } else if (key == "recvq") {
+                setRecvQueueLimit(atol(value.c_str()));
+            } else if (key == "read_budget") {
+                setReadBudget(atol(value.c_str()));
+            } else if (key == "command_budget") {
+                setCommandBudget(atoi(value.c_str()));
+            } else if (key == "admin_socket") {
+                setAdminSocket(value);
+            } else if (key == "oper_password") {
+                setOperPassword(value);
+            } else {
+                LOG_WARN("Unknown option " << key);
+            }
+        } catch (const std::runtime_error& e) {
+            LOG_ERROR("Options file error: " << e.what());
+        }
+    }
+    return true;
+}
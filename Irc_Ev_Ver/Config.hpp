@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "Log.hpp"
 
 class Config {
 public:
@@ -8,16 +9,83 @@ public:
     int getPort() const;
     std::string getPassword() const;
     bool loadFromFile(const std::string& filename); /* optional */
+    bool loadOptions(const std::string& filename); /* optional tuning file, "key value" per line */
+    std::string getReactorBackend() const;
+    void setReactorBackend(const std::string& backend);
+    int getThreads() const;
+    void setThreads(int count);
+    /* Pending connections the kernel queues per listening socket (capped by net.core.somaxconn). */
+    int getListenBacklog() const;
+    void setListenBacklog(int connections);
+    LogLevel getLogLevel() const;
+    void setLogLevel(LogLevel level);
+    /* Timeouts in seconds, see Shard::handleTimeout(). */
+    int getRegistrationTimeout() const;
+    void setRegistrationTimeout(int seconds);
+    int getPingInterval() const;
+    void setPingInterval(int seconds);
+    int getPingTimeout() const;
+    void setPingTimeout(int seconds);
+    int getIdleTimeout() const;
+    void setIdleTimeout(int seconds);
+    /* Flood control, see Shard::admit(): bucket size in tokens and refill in tokens per second, 0 turns it off. */
+    int getFloodBurst() const;
+    void setFloodBurst(int tokens);
+    int getFloodRate() const;
+    void setFloodRate(int tokensPerSecond);
+    /* Per-client queue limits in bytes; a client that goes past one is disconnected. */
+    size_t getSendQueueLimit() const;
+    void setSendQueueLimit(long bytes);
+    size_t getRecvQueueLimit() const;
+    void setRecvQueueLimit(long bytes);
+    /* Fairness per event loop iteration, see Shard::handleClientData(): bytes read from and commands run for one client. */
+    size_t getReadBudget() const;
+    void setReadBudget(long bytes);
+    int getCommandBudget() const;
+    void setCommandBudget(int commands);
+    /* Unix socket path the Prometheus exporter listens on, empty for none. */
+    const std::string& getAdminSocket() const;
+    void setAdminSocket(const std::string& path);
+    /* Password for OPER, empty disables it. */
+    const std::string& getOperPassword() const;
+    void setOperPassword(const std::string& pw);
 
 private:
     int port;
     std::string password;
+    std::string reactorBackend;
+    int threads;
+    int listenBacklog;
+    LogLevel logLevel;
+    int registrationTimeout;
+    int pingInterval;
+    int pingTimeout;
+    int idleTimeout;
+    int floodBurst;
+    int floodRate;
+    size_t sendQueueLimit;
+    size_t recvQueueLimit;
+    size_t readBudget;
+    int commandBudget;
+    std::string adminSocket;
+    std::string operPassword;
 
     void validatePort(int p) const;
     void validatePassword(const std::string& pw) const;
+    static void validateTimeout(const char* name, int seconds, int min);
+    static void validateQueueLimit(const char* name, long bytes);
 
     static const int MIN_PORT;
     static const int MAX_PORT;
     static const size_t MIN_PASSWORD_LENGTH;
+    static const int MAX_THREADS;
+    static const int MAX_LISTEN_BACKLOG;
+    static const int MAX_TIMEOUT;
+    static const int MAX_FLOOD_BURST;
+    static const int MAX_FLOOD_RATE;
+    static const long MIN_QUEUE_LIMIT;
+    static const long MAX_QUEUE_LIMIT;
+    static const long MIN_READ_BUDGET;
+    static const int MAX_COMMAND_BUDGET;
 };
 
@@ -0,0 +1,198 @@
+#include "EventRouter.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "Channel.hpp"
+#include "Pool.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const size_t MAX_PARTS = 12; /* the longest line, KICK: mask (5), 6 more and CR LF */
+
+void add(LineView* parts, size_t& count, const char* text, size_t length) {
+    parts[count].data = text;
+    parts[count].length = length;
+    ++count;
+}
+
+void add(LineView* parts, size_t& count, const char* text) {
+    add(parts, count, text, strlen(text));
+}
+
+void add(LineView* parts, size_t& count, const std::string& text) {
+    add(parts, count, text.data(), text.size());
+}
+
+Event makeEvent(Event::Type type, int source, Channel* channel) {
+    Event event;
+    event.type = type;
+    event.source = source;
+    event.channel = channel;
+    event.target = -1;
+    event.targetName = NULL;
+    event.text = NULL;
+    event.oldNick = NULL;
+    return event;
+}
+
+}
+
+Event Event::channelMessage(int source, Channel* channel, const std::string& text) {
+    Event event = makeEvent(CHANNEL_MESSAGE, source, channel);
+    event.text = &text;
+    return event;
+}
+
+Event Event::userMessage(int source, int target, const std::string& targetNick, const std::string& text) {
+    Event event = makeEvent(USER_MESSAGE, source, NULL);
+    event.target = target;
+    event.targetName = &targetNick;
+    event.text = &text;
+    return event;
+}
+
+Event Event::join(int source, Channel* channel) {
+    return makeEvent(MEMBER_JOIN, source, channel);
+}
+
+Event Event::kick(int source, Channel* channel, int target, const std::string& targetNick, const std::string& reason) {
+    Event event = makeEvent(MEMBER_KICK, source, channel);
+    event.target = target;
+    event.targetName = &targetNick;
+    event.text = &reason;
+    return event;
+}
+
+Event Event::nickChange(int source, const std::string& oldNick, const std::string& newNick) {
+    Event event = makeEvent(NICK_CHANGE, source, NULL);
+    event.oldNick = &oldNick;
+    event.text = &newNick;
+    return event;
+}
+
+Event Event::modeChange(int source, Channel* channel, const std::string& modes) {
+    Event event = makeEvent(MODE_CHANGE, source, channel);
+    event.text = &modes;
+    return event;
+}
+
+Event Event::topicChange(int source, Channel* channel, const std::string& topic) {
+    Event event = makeEvent(TOPIC_CHANGE, source, channel);
+    event.text = &topic;
+    return event;
+}
+
+EventRouter::EventRouter(Server& s, Shard& sh) : server(s), shard(sh) {}
+
+void EventRouter::route(const Event& event) {
+    Client* source = shard.findClient(event.source);
+    if (!source)
+        return;
+    BufferRef line = render(event, *source, shard.getBufferPool());
+    switch (event.type) {
+        case Event::CHANNEL_MESSAGE:
+        case Event::MODE_CHANGE:
+            toChannel(*event.channel, line, event.source);
+            break;
+        case Event::MEMBER_JOIN:
+        case Event::TOPIC_CHANGE:
+            toChannel(*event.channel, line, -1);
+            break;
+        case Event::MEMBER_KICK:
+            /* the victim has already left the channel */
+            toChannel(*event.channel, line, -1);
+            shard.deliver(event.target, line);
+            break;
+        case Event::USER_MESSAGE:
+            if (event.target != -1 && event.target != event.source)
+                shard.deliver(event.target, line);
+            break;
+        case Event::NICK_CHANGE:
+            toNeighbours(event.source, line);
+            break;
+    }
+    shard.flushPosted();
+}
+
+/* One line per event, prefixed with the source's mask. The pieces are
+   copied once, straight into a buffer from the shard's pool. */
+BufferRef EventRouter::render(const Event& event, const Client& source, BufferPool& pool) {
+    const std::string& nick = event.oldNick ? *event.oldNick : source.getNickname();
+    LineView parts[MAX_PARTS];
+    size_t count = 0;
+    add(parts, count, ":");
+    add(parts, count, nick);
+    add(parts, count, "!");
+    add(parts, count, source.getUsername());
+    add(parts, count, "@localhost ");
+    switch (event.type) {
+        case Event::CHANNEL_MESSAGE:
+            add(parts, count, "PRIVMSG ");
+            add(parts, count, event.channel->getName());
+            add(parts, count, " :");
+            add(parts, count, *event.text);
+            break;
+        case Event::USER_MESSAGE:
+            add(parts, count, "PRIVMSG ");
+            add(parts, count, *event.targetName);
+            add(parts, count, " :");
+            add(parts, count, *event.text);
+            break;
+        case Event::MEMBER_JOIN:
+            add(parts, count, "JOIN ");
+            add(parts, count, event.channel->getName());
+            break;
+        case Event::MEMBER_KICK:
+            add(parts, count, "KICK ");
+            add(parts, count, event.channel->getName());
+            add(parts, count, " ");
+            add(parts, count, *event.targetName);
+            add(parts, count, " :");
+            add(parts, count, *event.text);
+            break;
+        case Event::NICK_CHANGE:
+            add(parts, count, "NICK ");
+            add(parts, count, *event.text);
+            break;
+        case Event::MODE_CHANGE:
+            add(parts, count, "MODE ");
+            add(parts, count, event.channel->getName());
+            add(parts, count, " ");
+            add(parts, count, *event.text);
+            break;
+        case Event::TOPIC_CHANGE:
+            add(parts, count, "TOPIC ");
+            add(parts, count, event.channel->getName());
+            add(parts, count, " :");
+            add(parts, count, *event.text);
+            break;
+    }
+    add(parts, count, "\r\n");
+    return BufferRef(parts, count, &pool);
+}
+
+void EventRouter::toChannel(const Channel& channel, const BufferRef& line, int except) {
+    const Channel::Members& members = channel.getMembers();
+    for (Channel::Members::const_iterator it = members.begin(); it != members.end(); ++it) {
+        if (it->socket != except)
+            shard.deliver(it->socket, line);
+    }
+}
+
+/* Every client that shares a channel with `clientSocket`, plus the client
+   itself, gets the line exactly once. */
+void EventRouter::toNeighbours(int clientSocket, const BufferRef& line) {
+    recipients.clear();
+    recipients.push_back(clientSocket);
+    const ChannelDirectory::ChannelList& joined = server.channels.channelsOf(clientSocket);
+    for (size_t i = 0; i < joined.size(); ++i) {
+        const Channel::Members& members = joined[i]->getMembers();
+        for (Channel::Members::const_iterator member = members.begin(); member != members.end(); ++member)
+            recipients.push_back(member->socket);
+    }
+    std::sort(recipients.begin(), recipients.end());
+    recipients.erase(std::unique(recipients.begin(), recipients.end()), recipients.end());
+    for (size_t i = 0; i < recipients.size(); ++i)
+        shard.deliver(recipients[i], line);
+}
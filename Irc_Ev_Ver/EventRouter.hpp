@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SharedBuffer.hpp"
+
+class Server;
+class Shard;
+class Channel;
+class Client;
+
+/* Something a client did that other clients have to hear about. Handlers
+   build one with the factory matching what happened and hand it to
+   EventRouter::route(). Events are routed synchronously, so the string
+   pointers only refer to the caller's values and are never stored. */
+struct Event {
+    enum Type {
+        CHANNEL_MESSAGE, /* PRIVMSG to a channel */
+        USER_MESSAGE,    /* PRIVMSG to a nick */
+        MEMBER_JOIN,
+        MEMBER_KICK,
+        NICK_CHANGE,
+        MODE_CHANGE,
+        TOPIC_CHANGE
+    };
+
+    Type type;
+    int source;                   /* fd of the client the event comes from */
+    Channel* channel;             /* channel events */
+    int target;                   /* USER_MESSAGE recipient, MEMBER_KICK victim */
+    const std::string* targetName;
+    const std::string* text;      /* message, kick reason, mode string, topic or new nick */
+    const std::string* oldNick;   /* NICK_CHANGE: the prefix the others still know */
+
+    static Event channelMessage(int source, Channel* channel, const std::string& text);
+    static Event userMessage(int source, int target, const std::string& targetNick, const std::string& text);
+    static Event join(int source, Channel* channel);
+    static Event kick(int source, Channel* channel, int target, const std::string& targetNick, const std::string& reason);
+    static Event nickChange(int source, const std::string& oldNick, const std::string& newNick);
+    static Event modeChange(int source, Channel* channel, const std::string& modes);
+    static Event topicChange(int source, Channel* channel, const std::string& topic);
+};
+
+/* Turns events into lines: works out who receives an event, renders its
+   line once into a shared buffer and delivers that buffer to every
+   recipient through the shard. Recipients on other shards are batched, so
+   an event costs one mailbox post per shard rather than per member.
+   Recipients per type:
+       CHANNEL_MESSAGE, MODE_CHANGE                 channel members but the source
+       MEMBER_JOIN, TOPIC_CHANGE                    all channel members
+       MEMBER_KICK                                  all channel members and the victim
+       USER_MESSAGE                                 the target, unless it is the source
+       NICK_CHANGE                                  the source and everyone sharing a channel with it
+   The caller holds Server::clientsLock shared for the delivery, and
+   channelsLock for channel events and NICK_CHANGE. */
+class EventRouter {
+public:
+    EventRouter(Server& s, Shard& sh);
+    void route(const Event& event);
+
+private:
+    Server& server;
+    Shard& shard;
+    std::vector<int> recipients; /* scratch list, reused between events */
+
+    static BufferRef render(const Event& event, const Client& source, BufferPool& pool);
+    void toChannel(const Channel& channel, const BufferRef& line, int except);
+    void toNeighbours(int clientSocket, const BufferRef& line);
+
+    EventRouter(const EventRouter&);
+    EventRouter& operator=(const EventRouter&);
+};
@@ -0,0 +1,68 @@
+#include "FloodControl.hpp"
+
+unsigned commandCost(CommandId id) {
+    switch (id) {
+        case CMD_QUIT:
+        case CMD_PONG:
+            return 0;
+        case CMD_NICK:    /* goes to every channel neighbour */
+        case CMD_JOIN:
+        case CMD_MODE:
+        case CMD_KICK:
+        case CMD_TOPIC:
+        case CMD_INVITE:
+            return 2;
+        case CMD_WHOIS:
+        case CMD_STATS:   /* walks every shard and channel */
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+TokenBucket::TokenBucket() : milliTokens(0), stamp(0) {}
+
+void TokenBucket::reset(unsigned long now, unsigned burst) {
+    milliTokens = burst * 1000UL;
+    stamp = now;
+}
+
+bool TokenBucket::take(unsigned cost, unsigned long now, unsigned burst, unsigned rate) {
+    unsigned long capacity = burst * 1000UL;
+    unsigned long elapsed = now - stamp;
+    if (milliTokens >= capacity || (rate > 0 && elapsed > (capacity - milliTokens) / rate))
+        milliTokens = capacity;
+    else
+        milliTokens += elapsed * rate;
+    stamp = now;
+    unsigned long needed = cost * 1000UL;
+    if (milliTokens < needed)
+        return false;
+    milliTokens -= needed;
+    return true;
+}
+
+unsigned long TokenBucket::delayFor(unsigned cost, unsigned rate) const {
+    unsigned long needed = cost * 1000UL;
+    if (milliTokens >= needed || rate == 0)
+        return 0;
+    return (needed - milliTokens + rate - 1) / rate;
+}
+
+unsigned TokenBucket::available() const {
+    return static_cast<unsigned>(milliTokens / 1000);
+}
+
+TickBudget::TickBudget() : tick(0), spent(0) {}
+
+bool TickBudget::available(unsigned long now, unsigned limit) {
+    if (now != tick) {
+        tick = now;
+        spent = 0;
+    }
+    return spent < limit;
+}
+
+void TickBudget::spend() {
+    ++spent;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Message.hpp"
+
+/* Tokens a command takes from the sender's flood budget. Commands that fan
+   out or search shared state cost more than a plain message; QUIT and PONG
+   are free so a throttled client can still leave or answer a PING. */
+unsigned commandCost(CommandId id);
+
+/* Token bucket for one client's commands. Kept in thousandths of a token
+   so a refill rate in tokens per second is the refill in those units per
+   millisecond. Times are TimerWheel::now() milliseconds. */
+class TokenBucket {
+public:
+    TokenBucket();
+    /* Full bucket as of `now`. */
+    void reset(unsigned long now, unsigned burst);
+    /* Refills for the time since the last call, then takes `cost` tokens if
+       they are there. `rate` is tokens per second. */
+    bool take(unsigned cost, unsigned long now, unsigned burst, unsigned rate);
+    /* Milliseconds until `cost` tokens are there, as of the last take(). */
+    unsigned long delayFor(unsigned cost, unsigned rate) const;
+    /* Whole tokens left as of the last take(). */
+    unsigned available() const;
+
+private:
+    unsigned long milliTokens;
+    unsigned long stamp;
+};
+
+/* Commands one client may run in one event loop iteration, so a client with
+   a long pipelined burst takes turns with the rest of its shard instead of
+   holding the loop. Ticks are Shard loop iteration numbers. */
+class TickBudget {
+public:
+    TickBudget();
+    /* True while fewer than `limit` commands were spent in `tick`. */
+    bool available(unsigned long tick, unsigned limit);
+    void spend();
+
+private:
+    unsigned long tick;
+    unsigned spent;
+};
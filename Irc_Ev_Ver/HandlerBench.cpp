@@ -0,0 +1,522 @@
+#include "HandlerBench.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "CommandHandler.hpp"
+#include "LineFramer.hpp"
+#include "Reply.hpp"
+#include <sstream>
+#include <cstring>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+namespace {
+
+const int FIRST_SOCKET = 16;
+const unsigned long TARGET_NS = 200000000UL; /* timed work per handler and scale */
+const unsigned long MIN_OPS = 16;
+const unsigned long MAX_OPS = 1000000;
+const size_t BATCH_LINES = 65536;            /* queued lines allowed to pile up between drains */
+const size_t STREAM_BYTES = 1 << 20;         /* input replayed by the micro-benchmarks */
+const unsigned long SLOW_READER_MAX_LINES = 100000; /* gives up on a reader that is never dropped */
+
+unsigned long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+/* What reading the clock twice costs, taken off every timed command. */
+unsigned long timerOverhead() {
+    static unsigned long overhead = 0;
+    static bool measured = false;
+    if (!measured) {
+        const int rounds = 100000;
+        unsigned long total = 0;
+        for (int i = 0; i < rounds; ++i) {
+            unsigned long start = nowNs();
+            total += nowNs() - start;
+        }
+        overhead = total / rounds;
+        measured = true;
+    }
+    return overhead;
+}
+
+}
+
+const char* const HandlerBench::CHANNEL = "#bench";
+
+/* The outsider gets the lowest descriptor, as a new connection usually
+   does once earlier ones have closed; its JOIN then lands in front of
+   every member. Member 0 created the channel and is its operator. */
+HandlerBench::HandlerBench(size_t memberCount, size_t shardCount)
+    : server(NULL), shard(NULL), handler(NULL), channel(NULL), members(memberCount), outsider(FIRST_SOCKET) {
+    server = new Server(Config(6667, "jopa"));
+    for (size_t s = 0; s < (shardCount ? shardCount : 1); ++s)
+        server->shards.push_back(new Shard(*server, s));
+    shard = server->shards[0];
+    handler = new CommandHandler(*server, *shard);
+    addClient(*server, *shard, outsider, "outsider");
+    channel = server->channels.create(CHANNEL);
+    for (size_t i = 0; i < members; ++i) {
+        Shard& owner = i < 2 ? *shard : *server->shards[i % server->shards.size()];
+        addClient(*server, owner, socketOf(i), nickOf(i));
+        server->channels.join(channel, socketOf(i));
+    }
+}
+
+/* Mailboxes hold items from shard 0's pool, which goes first. */
+HandlerBench::~HandlerBench() {
+    drainAll();
+    delete handler;
+    delete server;
+}
+
+HandlerBench::Result HandlerBench::join() {
+    return measure("JOIN", outsider, std::string("JOIN ") + CHANNEL, std::string("JOIN ") + CHANNEL, LEAVE, outsider);
+}
+
+HandlerBench::Result HandlerBench::channelMessage() {
+    std::string line = std::string("PRIVMSG ") + CHANNEL + " :hello everyone";
+    return measure("PRIVMSG #channel", socketOf(1), line, line, NOTHING, -1);
+}
+
+HandlerBench::Result HandlerBench::privateMessage() {
+    std::string line = "PRIVMSG " + nickOf(2) + " :hello you";
+    return measure("PRIVMSG nick", socketOf(1), line, line, NOTHING, -1);
+}
+
+HandlerBench::Result HandlerBench::mode() {
+    std::string target = nickOf(members - 1);
+    return measure("MODE +o/-o", socketOf(0), std::string("MODE ") + CHANNEL + " +o " + target,
+                   std::string("MODE ") + CHANNEL + " -o " + target, NOTHING, -1);
+}
+
+HandlerBench::Result HandlerBench::kick() {
+    std::string line = std::string("KICK ") + CHANNEL + " " + nickOf(members - 1) + " :bye";
+    return measure("KICK", socketOf(0), line, line, REJOIN, socketOf(members - 1));
+}
+
+HandlerBench::Result HandlerBench::whois() {
+    std::string line = "WHOIS " + nickOf(members - 1);
+    return measure("WHOIS", socketOf(1), line, line, NOTHING, -1);
+}
+
+int HandlerBench::socketOf(size_t index) {
+    return FIRST_SOCKET + 1 + static_cast<int>(index);
+}
+
+std::string HandlerBench::nickOf(size_t index) {
+    std::ostringstream oss;
+    oss << "u" << index;
+    return oss.str();
+}
+
+void HandlerBench::addClient(Server& server, Shard& shard, int clientSocket, const std::string& nick) {
+    Client& client = shard.clients.insert(std::make_pair(clientSocket, Client(clientSocket, server.nextClientId++, shard.index))).first->second;
+    server.m_clients[clientSocket] = &client;
+    client.setSendQueue(0, &shard.metrics.queues); // as Shard::acceptClient() does
+    client.setQueuePools(&shard.chunkPool, &shard.segmentPool);
+    client.setPasswordEntered(true);
+    client.setNickname(nick);
+    client.setUsername("bench");
+    client.setRealname("handler bench");
+    server.nicks.rename(clientSocket, "", nick);
+}
+
+unsigned long HandlerBench::drainAll() {
+    unsigned long bytes = 0;
+    for (size_t s = 0; s < server->shards.size(); ++s) {
+        server->shards[s]->drainMailbox();
+        bytes += drainOutput(*server->shards[s]);
+    }
+    return bytes;
+}
+
+/* Empties every queue that got output, the way a completed send would. */
+unsigned long HandlerBench::drainOutput(Shard& shard) {
+    unsigned long bytes = 0;
+    for (size_t i = 0; i < shard.dirtyClients.size(); ++i) {
+        Shard::ClientMap::iterator it = shard.clients.find(shard.dirtyClients[i]);
+        if (it == shard.clients.end())
+            continue;
+        bytes += it->second.getOutputSize();
+        it->second.eraseOutputBuffer(it->second.getOutputSize());
+        it->second.setDirty(false);
+    }
+    shard.dirtyClients.clear();
+    return bytes;
+}
+
+HandlerBench::Result HandlerBench::measure(const char* name, int clientSocket, const std::string& first,
+                                           const std::string& second, Restore restore, int restoreSocket) {
+    Message messages[2];
+    LineView firstLine = { first.data(), first.size() };
+    LineView secondLine = { second.data(), second.size() };
+    messages[0].parse(firstLine);
+    messages[1].parse(secondLine);
+
+    size_t batch = BATCH_LINES / (members + 1);
+    if (batch == 0)
+        batch = 1;
+    unsigned long overhead = timerOverhead();
+    unsigned long elapsed = 0;
+    unsigned long allocations = 0;
+    unsigned long bytes = 0;
+    unsigned long ops = 0;
+    drainAll();
+    while ((elapsed < TARGET_NS || ops < MIN_OPS) && ops < MAX_OPS) {
+        for (size_t i = 0; i < batch; ++i, ++ops) {
+            unsigned long allocated = allocationCount();
+            unsigned long start = nowNs();
+            handler->processCommand(clientSocket, messages[ops % 2]);
+            unsigned long took = nowNs() - start;
+            elapsed += took > overhead ? took - overhead : 0;
+            allocations += allocationCount() - allocated;
+            if (restore == LEAVE)
+                server->channels.leave(channel, restoreSocket);
+            else if (restore == REJOIN)
+                server->channels.join(channel, restoreSocket);
+        }
+        bytes += drainAll();
+    }
+
+    Result result;
+    result.name = name;
+    result.ops = ops;
+    result.nsPerOp = static_cast<double>(elapsed) / ops;
+    result.allocsPerOp = static_cast<double>(allocations) / ops;
+    result.allocations = allocations;
+    result.bytesPerOp = static_cast<double>(bytes) / ops;
+    return result;
+}
+
+/* What a client in a busy channel sends: mostly short messages, now and
+   then a long one, keepalives and the odd mode change. */
+HandlerBench::Result HandlerBench::framer() {
+    const char* const mix[] = {
+        "PRIVMSG #bench :hello everyone\r\n",
+        "PRIVMSG u2 :are you there?\r\n",
+        "PING :irc.example.net\r\n",
+        "MODE #bench +o u3\r\n",
+        "NOTICE #bench :the quick brown fox jumps over the lazy dog, the quick brown fox jumps over the lazy dog\r\n",
+    };
+    const size_t count = sizeof(mix) / sizeof(mix[0]);
+    std::string stream;
+    std::string longLine = "PRIVMSG #bench :" + std::string(400, 'x') + "\r\n";
+    for (size_t i = 0; stream.size() < STREAM_BYTES; ++i)
+        stream += i % 16 == 15 ? longLine : std::string(mix[i % count]);
+
+    const size_t block = 4096;
+    LineFramer framer;
+    unsigned long bytes = 0;
+    unsigned long ops = 0;
+    unsigned long allocated = allocationCount();
+    unsigned long start = nowNs();
+    unsigned long elapsed = 0;
+    while (elapsed < TARGET_NS) {
+        for (size_t pos = 0; pos < stream.size(); pos += block) {
+            framer.feed(stream.data() + pos, stream.size() - pos < block ? stream.size() - pos : block);
+            LineView line;
+            while (framer.next(line)) {
+                bytes += line.length;
+                ++ops;
+            }
+        }
+        elapsed = nowNs() - start;
+    }
+
+    Result result;
+    result.name = "LineFramer";
+    result.ops = ops;
+    result.nsPerOp = static_cast<double>(elapsed) / ops;
+    result.allocations = allocationCount() - allocated;
+    result.allocsPerOp = static_cast<double>(result.allocations) / ops;
+    result.bytesPerOp = static_cast<double>(bytes) / ops;
+    return result;
+}
+
+/* Roughly the share of each command on a chat network: messages first,
+   then keepalives, channel traffic and the rest. The switch stands in for
+   the one in CommandHandler::processCommand(), without the handlers. */
+HandlerBench::Result HandlerBench::parse() {
+    const char* const mix[] = {
+        "PRIVMSG #bench :hello everyone",
+        "PRIVMSG u2 :are you there?",
+        "privmsg #bench :lower case works too",
+        "PING :irc.example.net",
+        "PONG :server",
+        "PRIVMSG #bench :\001ACTION waves\001",
+        "@time=2024-01-01T00:00:00.000Z PRIVMSG #bench :tagged",
+        ":u1!bench@localhost PRIVMSG #bench :with a prefix",
+        "JOIN #bench",
+        "MODE #bench +o u3",
+        "TOPIC #bench :a new topic for everyone",
+        "WHOIS u2",
+        "NICK u1_away",
+        "KICK #bench u4 :bye",
+        "USER bench 0 * :Handler Bench",
+        "NOTICE #bench :not a command this server knows",
+    };
+    const size_t count = sizeof(mix) / sizeof(mix[0]);
+    std::vector<LineView> lines(count);
+    for (size_t i = 0; i < count; ++i) {
+        lines[i].data = mix[i];
+        lines[i].length = strlen(mix[i]);
+    }
+
+    unsigned long seen[CMD_COUNT] = { 0 };
+    unsigned long bytes = 0;
+    unsigned long ops = 0;
+    unsigned long allocated = allocationCount();
+    unsigned long start = nowNs();
+    unsigned long elapsed = 0;
+    while (elapsed < TARGET_NS) {
+        for (size_t round = 0; round < 4096; ++round) {
+            const LineView& line = lines[ops++ % count];
+            Message message;
+            if (!message.parse(line))
+                continue;
+            bytes += line.length;
+            switch (message.id) {
+                case CMD_PRIVMSG: ++seen[CMD_PRIVMSG]; break;
+                case CMD_PING:    ++seen[CMD_PING]; break;
+                case CMD_PONG:    ++seen[CMD_PONG]; break;
+                case CMD_JOIN:    ++seen[CMD_JOIN]; break;
+                case CMD_MODE:    ++seen[CMD_MODE]; break;
+                case CMD_TOPIC:   ++seen[CMD_TOPIC]; break;
+                case CMD_WHOIS:   ++seen[CMD_WHOIS]; break;
+                case CMD_NICK:    ++seen[CMD_NICK]; break;
+                case CMD_KICK:    ++seen[CMD_KICK]; break;
+                case CMD_USER:    ++seen[CMD_USER]; break;
+                default:          ++seen[CMD_UNKNOWN]; break;
+            }
+        }
+        elapsed = nowNs() - start;
+    }
+
+    unsigned long allocations = allocationCount() - allocated;
+    unsigned long dispatched = 0;
+    for (size_t i = 0; i < CMD_COUNT; ++i)
+        dispatched += seen[i];
+
+    Result result;
+    result.name = "Message::parse";
+    result.ops = dispatched;
+    result.nsPerOp = static_cast<double>(elapsed) / dispatched;
+    result.allocations = allocations;
+    result.allocsPerOp = static_cast<double>(allocations) / dispatched;
+    result.bytesPerOp = static_cast<double>(bytes) / dispatched;
+    return result;
+}
+
+/* Error replies for bad input, the JOIN/WHOIS/TOPIC answers and the
+   "Message sent" notice, with the parameters the handlers pass. */
+HandlerBench::Result HandlerBench::replies() {
+    FixedPool chunkPool(SendQueue::CHUNK_SIZE, 16);
+    FixedPool segmentPool(SendQueue::segmentSize(), 256);
+    Client client(FIRST_SOCKET);
+    client.setQueuePools(&chunkPool, &segmentPool);
+    client.setNickname(nickOf(1));
+    const std::string channelName = CHANNEL;
+    const std::string nick = nickOf(2);
+    const std::string topic = "a new topic for everyone";
+
+    unsigned long bytes = 0;
+    unsigned long ops = 0;
+    unsigned long allocated = allocationCount();
+    unsigned long start = nowNs();
+    unsigned long elapsed = 0;
+    while (elapsed < TARGET_NS) {
+        for (size_t round = 0; round < 512; ++round, ops += 8) {
+            Reply(client, ERR_NEEDMOREPARAMS).param("JOIN").send();
+            Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+            Reply(client, ERR_NOSUCHNICK).param(nick).send();
+            Reply(client, ERR_CHANOPRIVSNEEDED).param(channelName).send();
+            Reply(client, RPL_TOPIC).param(channelName).send(topic);
+            Reply(client, RPL_WHOISUSER).param(nick).param("bench").param("localhost").param("*").send("handler bench");
+            Reply(client, RPL_ENDOFWHOIS).param(nick).send();
+            Reply(client, RPL_WELCOME).send("Message sent");
+        }
+        bytes += client.getOutputSize();
+        client.eraseOutputBuffer(client.getOutputSize());
+        elapsed = nowNs() - start;
+    }
+
+    Result result;
+    result.name = "Reply";
+    result.ops = ops;
+    result.nsPerOp = static_cast<double>(elapsed) / ops;
+    result.allocations = allocationCount() - allocated;
+    result.allocsPerOp = static_cast<double>(result.allocations) / ops;
+    result.bytesPerOp = static_cast<double>(bytes) / ops;
+    return result;
+}
+
+/* Both clients sit on nonblocking socketpairs, so their descriptors are
+   real and the drop's close() closes the right one. The sender reads what
+   it gets (a "Message sent" per line) every round, as a normal client
+   would, and its queue is empty by the end. The ERROR line of the drop
+   stays in the queue of a full socket and goes with the client. */
+HandlerBench::SlowReader HandlerBench::slowReader(size_t sendQueueLimit) {
+    Config config(6667, "jopa");
+    config.setSendQueueLimit(static_cast<long>(sendQueueLimit));
+    Server* server = new Server(config);
+    Shard* shard = new Shard(*server, 0);
+    server->shards.push_back(shard);
+    shard->reactor = Reactor::create("poll");
+    Channel* channel = server->channels.create(CHANNEL);
+
+    SlowReader result;
+    result.lines = 0;
+    result.dropped = false;
+    int readerPair[2], senderPair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, readerPair) < 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, senderPair) < 0) {
+        delete server;
+        result.peak = result.queued = result.chunks = result.segments = result.buffers = 0;
+        return result;
+    }
+    int reader = readerPair[0];
+    int sender = senderPair[0];
+    int small = 4096;
+    setsockopt(reader, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    fcntl(reader, F_SETFL, O_NONBLOCK);
+    fcntl(sender, F_SETFL, O_NONBLOCK);
+    fcntl(senderPair[1], F_SETFL, O_NONBLOCK);
+    shard->reactor->addConnection(reader);
+    shard->reactor->addConnection(sender);
+    addClient(*server, *shard, sender, nickOf(0));
+    addClient(*server, *shard, reader, nickOf(1));
+    shard->clients.find(reader)->second.setSendQueue(sendQueueLimit, &shard->metrics.queues);
+    server->channels.join(channel, sender);
+    server->channels.join(channel, reader);
+
+    std::string line = std::string("PRIVMSG ") + CHANNEL + " :" + std::string(400, 'x');
+    LineView view = { line.data(), line.size() };
+    Message message;
+    message.parse(view);
+    CommandHandler handler(*server, *shard);
+    Client& talker = shard->clients.find(sender)->second;
+    char discard[4096];
+    while (shard->clients.count(reader) && result.lines < SLOW_READER_MAX_LINES) {
+        handler.processCommand(sender, message);
+        shard->flushDirtyClients();
+        ++result.lines;
+        while (read(senderPair[1], discard, sizeof(discard)) > 0) {
+        }
+    }
+    for (int round = 0; talker.hasPendingOutput() && round < 64; ++round) {
+        shard->sendPending(talker);
+        while (read(senderPair[1], discard, sizeof(discard)) > 0) {
+        }
+    }
+
+    result.dropped = !shard->clients.count(reader) && !server->findClient(reader) && !channel->hasMember(reader);
+    shard->bufferPool.collect();
+    result.peak = shard->metrics.queues.peak;
+    result.queued = shard->metrics.queues.bytes;
+    result.chunks = shard->chunkPool.getStats().inUse;
+    result.segments = shard->segmentPool.getStats().inUse;
+    result.buffers = 0;
+    for (size_t i = 0; i < BufferPool::CLASSES; ++i)
+        result.buffers += shard->bufferPool.getStats(i).inUse;
+
+    if (!result.dropped)
+        close(reader);
+    close(readerPair[1]);
+    close(sender);
+    close(senderPair[1]);
+    delete server;
+    return result;
+}
+
+/* Client k of shard s has descriptor FIRST_SOCKET + s * members + k and
+   joins channel s (local) or channel (s + k) % threads (spread); either
+   way client 0 of shard s is in channel s and every channel has `members`
+   members. */
+HandlerBench::Scaling HandlerBench::scaling(size_t threads, size_t members, bool spread, double seconds) {
+    Server* server = new Server(Config(6667, "jopa"));
+    std::vector<Channel*> channels;
+    for (size_t s = 0; s < threads; ++s) {
+        server->shards.push_back(new Shard(*server, s));
+        std::ostringstream name;
+        name << CHANNEL << s;
+        channels.push_back(server->channels.create(name.str()));
+    }
+    for (size_t s = 0; s < threads; ++s) {
+        for (size_t k = 0; k < members; ++k) {
+            int clientSocket = FIRST_SOCKET + static_cast<int>(s * members + k);
+            addClient(*server, *server->shards[s], clientSocket, nickOf(s * members + k));
+            server->channels.join(channels[spread ? (s + k) % threads : s], clientSocket);
+        }
+    }
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, static_cast<unsigned>(threads + 1));
+    std::vector<Worker> workers(threads);
+    std::vector<pthread_t> ids(threads);
+    for (size_t s = 0; s < threads; ++s) {
+        Worker& worker = workers[s];
+        worker.shard = server->shards[s];
+        worker.handler = new CommandHandler(*server, *worker.shard);
+        worker.sender = FIRST_SOCKET + static_cast<int>(s * members);
+        worker.line = "PRIVMSG " + channels[s]->getName() + " :hello everyone";
+        worker.start = &start;
+        worker.ops = 0;
+        pthread_create(&ids[s], NULL, runWorker, &worker);
+    }
+    unsigned long began = nowNs();
+    for (size_t s = 0; s < threads; ++s)
+        workers[s].deadline = began + static_cast<unsigned long>(seconds * 1e9);
+    pthread_barrier_wait(&start); // publishes the deadlines too
+
+    Scaling result;
+    result.threads = threads;
+    result.ops = 0;
+    unsigned long ended = began;
+    for (size_t s = 0; s < threads; ++s) {
+        pthread_join(ids[s], NULL);
+        result.ops += workers[s].ops;
+        if (workers[s].finished > ended)
+            ended = workers[s].finished;
+    }
+    /* Mailboxes hold buffers from the other shards' pools: empty all of
+       them before the first shard goes. */
+    unsigned long lines = 0;
+    for (size_t s = 0; s < threads; ++s) {
+        server->shards[s]->drainMailbox();
+        drainOutput(*server->shards[s]);
+        lines += server->shards[s]->metrics.queues.lines;
+        delete workers[s].handler;
+    }
+    double wall = static_cast<double>(ended - began) / 1e9;
+    result.opsPerSec = result.ops / wall;
+    result.linesPerSec = lines / wall;
+    pthread_barrier_destroy(&start);
+    delete server;
+    return result;
+}
+
+/* Sends in batches, then does what the shard's loop would: drains its
+   mailbox into its clients' queues and empties them. */
+void* HandlerBench::runWorker(void* arg) {
+    Worker& worker = *static_cast<Worker*>(arg);
+    Message message;
+    LineView line = { worker.line.data(), worker.line.size() };
+    message.parse(line);
+    size_t batch = BATCH_LINES / worker.shard->clients.size();
+    if (batch == 0)
+        batch = 1;
+    pthread_barrier_wait(worker.start);
+    while (nowNs() < worker.deadline) {
+        for (size_t i = 0; i < batch; ++i, ++worker.ops)
+            worker.handler->processCommand(worker.sender, message);
+        worker.shard->drainMailbox();
+        drainOutput(*worker.shard);
+    }
+    worker.finished = nowNs();
+    return NULL;
+}
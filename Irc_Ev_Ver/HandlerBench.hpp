@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <pthread.h>
+#include "Message.hpp"
+
+class Server;
+class Shard;
+class CommandHandler;
+class Channel;
+
+/* Allocations made so far by operator new on the calling thread; defined
+   by the harness binary. */
+unsigned long allocationCount();
+
+/* Runs CommandHandler::processCommand() in-process, without sockets or a
+   reactor: a Server with one or more Shards whose clients are plain entries
+   with made-up descriptors, all registered and joined to one channel.
+   Commands run on shard 0; output lands in the clients' send queues, or in
+   the other shards' mailboxes, as usual and is delivered, counted and
+   dropped between batches, outside the timed part. */
+class HandlerBench {
+public:
+    struct Result {
+        const char* name;
+        unsigned long ops;
+        double nsPerOp;
+        double allocsPerOp;
+        unsigned long allocations; /* in all ops together */
+        double bytesPerOp; /* queued for all recipients together */
+    };
+
+    /* PRIVMSG from every shard at once, each shard on its own thread. */
+    struct Scaling {
+        size_t threads;
+        unsigned long ops;
+        double opsPerSec;   /* all threads together, over the wall time */
+        double linesPerSec; /* lines queued to recipients, mailboxes drained */
+    };
+
+    /* What slowReader() saw; every count after the drop should be 0. */
+    struct SlowReader {
+        unsigned long lines;    /* channel lines sent until the reader was dropped */
+        bool dropped;           /* gone from the shard, the directory and the channel */
+        unsigned long peak;     /* QueueAccount::peak */
+        unsigned long queued;   /* QueueAccount::bytes after the drop */
+        unsigned long chunks;   /* chunk, segment and broadcast buffer pool objects still in use */
+        unsigned long segments;
+        unsigned long buffers;
+    };
+
+    /* `members` clients in CHANNEL, plus one client outside it that JOIN uses.
+       With several shards, members 0 and 1 (who send) and the outsider stay
+       on shard 0 and the other members go round the shards. */
+    explicit HandlerBench(size_t members, size_t shards = 1);
+    ~HandlerBench();
+
+    Result join();
+    Result channelMessage();
+    Result privateMessage();
+    Result mode();
+    Result kick();
+    Result whois();
+
+    /* `threads` shards with `members` clients each and one channel per shard;
+       each shard's client 0 sends PRIVMSG to its channel for `seconds`.
+       Local: a channel's members are all on its shard. Spread: every
+       channel has members on every shard, so most lines go through the
+       other shards' mailboxes, which each thread drains between batches. */
+    static Scaling scaling(size_t threads, size_t members, bool spread, double seconds);
+
+    /* Pieces of the input and output path timed on their own, for about
+       0.2 s each; `bytesPerOp` is what one op handled. */
+    /* LineFramer over a mixed client stream fed in 4 KiB blocks, so some
+       lines are cut by a block end; one op is one line. */
+    static Result framer();
+    /* Message::parse() and the switch on the command id over a mix of what
+       clients send, prefixes, tags and unknown commands included; one op is
+       one line. */
+    static Result parse();
+    /* Reply over the numerics the handlers send most, into one client's
+       pooled send queue that is emptied between batches; one op is one reply. */
+    static Result replies();
+
+    /* A reader that never reads, on a real socket with a small send buffer
+       and a poll reactor, in a channel someone keeps talking to until its
+       queue passes `sendQueueLimit` and flushDirtyClients() drops it. */
+    static SlowReader slowReader(size_t sendQueueLimit);
+
+    static const char* const CHANNEL;
+
+private:
+    /* Undoes what one timed command changed, untimed. */
+    enum Restore { NOTHING, LEAVE, REJOIN };
+
+    Server* server;
+    Shard* shard;
+    CommandHandler* handler;
+    Channel* channel;
+    size_t members;
+    int outsider;
+
+    struct Worker {
+        Shard* shard;
+        CommandHandler* handler;
+        int sender;
+        std::string line;
+        unsigned long deadline;
+        pthread_barrier_t* start;
+        unsigned long ops;
+        unsigned long finished;
+    };
+
+    static int socketOf(size_t index);
+    /* Delivers what shard 0 posted and empties every queue; bytes queued. */
+    unsigned long drainAll();
+    static std::string nickOf(size_t index);
+    static void addClient(Server& server, Shard& shard, int clientSocket, const std::string& nick);
+    static unsigned long drainOutput(Shard& shard);
+    static void* runWorker(void* arg);
+    /* Runs `first` and `second` in turns from `clientSocket` for about
+       TARGET_NS of timed work, or at most MAX_OPS commands. */
+    Result measure(const char* name, int clientSocket, const std::string& first, const std::string& second,
+                   Restore restore, int restoreSocket);
+
+    HandlerBench(const HandlerBench&);
+    HandlerBench& operator=(const HandlerBench&);
+};
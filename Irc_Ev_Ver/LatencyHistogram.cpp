@@ -0,0 +1,96 @@
+#include "LatencyHistogram.hpp"
+
+LatencyHistogram::LatencyHistogram(unsigned long maxValue)
+    : counts(indexOf(maxValue) + 1, 0), limit(maxValue), total(0), lowest(0), highest(0), sum(0) {}
+
+void LatencyHistogram::record(unsigned long value) {
+    if (value > limit)
+        value = limit;
+    ++counts[indexOf(value)];
+    if (total == 0 || value < lowest)
+        lowest = value;
+    if (value > highest)
+        highest = value;
+    ++total;
+    sum += static_cast<double>(value);
+}
+
+/* Both sides must have been built with the same maxValue. */
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.total == 0)
+        return;
+    for (size_t i = 0; i < counts.size() && i < other.counts.size(); ++i)
+        counts[i] += other.counts[i];
+    if (total == 0 || other.lowest < lowest)
+        lowest = other.lowest;
+    if (other.highest > highest)
+        highest = other.highest;
+    total += other.total;
+    sum += other.sum;
+}
+
+void LatencyHistogram::clear() {
+    for (size_t i = 0; i < counts.size(); ++i)
+        counts[i] = 0;
+    total = 0;
+    lowest = 0;
+    highest = 0;
+    sum = 0;
+}
+
+unsigned long LatencyHistogram::count() const { return total; }
+
+unsigned long LatencyHistogram::min() const { return lowest; }
+
+unsigned long LatencyHistogram::max() const { return highest; }
+
+double LatencyHistogram::mean() const { return total ? sum / static_cast<double>(total) : 0; }
+
+unsigned long LatencyHistogram::percentile(double percent) const {
+    if (total == 0)
+        return 0;
+    unsigned long rank = static_cast<unsigned long>(percent / 100.0 * static_cast<double>(total) + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+    unsigned long seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            unsigned long value = bucketLow(i) + bucketWidth(i) / 2;
+            /* the exact extremes are known, never report past them */
+            if (value < lowest)
+                value = lowest;
+            if (value > highest)
+                value = highest;
+            return value;
+        }
+    }
+    return highest;
+}
+
+/* Bucket i < 2 * SUB_BUCKETS holds the value i. Past that, the top SUB_BITS + 1
+   bits of the value pick the bucket and `shift` lower bits are dropped. */
+size_t LatencyHistogram::indexOf(unsigned long value) {
+    if (value < 2UL * SUB_BUCKETS)
+        return value;
+    int top = 0;
+    for (unsigned long v = value; v > 1; v >>= 1)
+        ++top;
+    int shift = top - SUB_BITS;
+    return static_cast<size_t>(shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+unsigned long LatencyHistogram::bucketLow(size_t index) {
+    if (index < 2UL * SUB_BUCKETS)
+        return index;
+    size_t shift = index / SUB_BUCKETS - 1;
+    return (static_cast<unsigned long>(index % SUB_BUCKETS) + SUB_BUCKETS) << shift;
+}
+
+unsigned long LatencyHistogram::bucketWidth(size_t index) {
+    if (index < 2UL * SUB_BUCKETS)
+        return 1;
+    return 1UL << (index / SUB_BUCKETS - 1);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/* Log-linear histogram in the style of HdrHistogram. Values below
+   2 * SUB_BUCKETS are counted exactly. Above that, every power of two is
+   split into SUB_BUCKETS equal buckets, so a reported percentile is off by
+   less than 1 / SUB_BUCKETS of the value (under 0.8%). Memory is fixed at
+   construction and record() never allocates. Units are the caller's; the
+   benchmark records microseconds. */
+class LatencyHistogram {
+public:
+    enum { SUB_BITS = 7, SUB_BUCKETS = 1 << SUB_BITS };
+
+    /* Values above `maxValue` are counted as `maxValue`. */
+    explicit LatencyHistogram(unsigned long maxValue = 1UL << 36);
+    void record(unsigned long value);
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    unsigned long count() const;
+    unsigned long min() const;
+    unsigned long max() const;
+    double mean() const;
+    /* The smallest value with at least `percent` of the samples at or below
+       it, rounded to the middle of its bucket; 0 when empty. */
+    unsigned long percentile(double percent) const;
+
+private:
+    std::vector<unsigned long> counts;
+    unsigned long limit;
+    unsigned long total;
+    unsigned long lowest;
+    unsigned long highest;
+    double sum;
+
+    static size_t indexOf(unsigned long value);
+    static unsigned long bucketLow(size_t index);
+    static unsigned long bucketWidth(size_t index);
+};
@@ -0,0 +1,138 @@
+#include "LineFramer.hpp"
+#include <cstring>
+
+LineFramer::LineFramer()
+    : block(NULL), blockLength(0), pos(0), partialLength(0), partialReturned(false), heldPos(0) {}
+
+void LineFramer::feed(const char* data, size_t length) {
+    if (partialReturned) {
+        partialLength = 0;
+        partialReturned = false;
+    }
+    compactHeld();
+    if (!held.empty()) {
+        held.append(data, length);
+        block = NULL;
+        blockLength = 0;
+        pos = 0;
+        return;
+    }
+    block = data;
+    blockLength = length;
+    pos = 0;
+}
+
+bool LineFramer::next(LineView& line) {
+    if (partialReturned) {
+        partialLength = 0;
+        partialReturned = false;
+    }
+    compactHeld();
+    if (!held.empty())
+        return nextHeld(line);
+    while (pos < blockLength) {
+        const char* start = block + pos;
+        size_t left = blockLength - pos;
+        const char* lf = static_cast<const char*>(memchr(start, '\n', left));
+        if (!lf) {
+            stash(start, left);
+            pos = blockLength;
+            return false;
+        }
+        size_t length = lf - start;
+        pos += length + 1;
+        if (partialLength > 0) {
+            stash(start, length);
+            line = trim(partial, partialLength);
+            partialReturned = true;
+        } else {
+            line = trim(start, length);
+        }
+        if (line.length > 0)
+            return true;
+    }
+    return false;
+}
+
+/* A line handed out from `held` is only rewound to. Otherwise the line and
+   the unread rest of the block become `held`, and `partial` is emptied:
+   its contents were the start of that line. */
+void LineFramer::park(const LineView& line) {
+    if (!held.empty() && line.data >= held.data() && line.data < held.data() + held.size()) {
+        heldPos = line.data - held.data();
+        return;
+    }
+    held.assign(line.data, line.length);
+    held += '\n';
+    held.append(block + pos, blockLength - pos);
+    heldPos = 0;
+    pos = blockLength;
+    partialLength = 0;
+    partialReturned = false;
+}
+
+size_t LineFramer::pending() const { return partialLength; }
+
+const char* LineFramer::pendingData() const { return partial; }
+
+size_t LineFramer::parked() const { return held.size() - heldPos; }
+
+/* Only called when no view into `held` is out: drops what was handed out. */
+void LineFramer::compactHeld() {
+    if (heldPos == 0)
+        return;
+    if (heldPos == held.size()) {
+        held.clear();
+        heldPos = 0;
+    } else if (heldPos >= held.size() / 2) {
+        held.erase(0, heldPos);
+        heldPos = 0;
+    }
+}
+
+/* Like the loop in next(), over `held`. Once no complete line is left the
+   remainder moves to `partial` and the framer is back to handing out lines
+   in place. */
+bool LineFramer::nextHeld(LineView& line) {
+    while (heldPos < held.size()) {
+        const char* start = held.data() + heldPos;
+        size_t left = held.size() - heldPos;
+        const char* lf = static_cast<const char*>(memchr(start, '\n', left));
+        if (!lf) {
+            stash(start, left);
+            held.clear();
+            heldPos = 0;
+            return false;
+        }
+        size_t length = lf - start;
+        heldPos += length + 1;
+        line = trim(start, length);
+        if (line.length > 0)
+            return true;
+    }
+    return false;
+}
+
+/* Keeps at most MAX_LINE - 2 bytes of a line: a longer line keeps its head,
+   which is still delivered once the LF shows up. */
+void LineFramer::stash(const char* data, size_t length) {
+    size_t room = MAX_LINE - 2 - partialLength;
+    if (length > room) {
+        memcpy(partial + partialLength, data, room);
+        partialLength += room;
+        return;
+    }
+    memcpy(partial + partialLength, data, length);
+    partialLength += length;
+}
+
+LineView LineFramer::trim(const char* data, size_t length) {
+    if (length > 0 && data[length - 1] == '\r')
+        --length;
+    if (length > MAX_LINE - 2)
+        length = MAX_LINE - 2;
+    LineView line;
+    line.data = data;
+    line.length = length;
+    return line;
+}
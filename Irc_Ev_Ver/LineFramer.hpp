@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/* Non-owning view of one received line, without the CR/LF. */
+struct LineView {
+    const char* data;
+    size_t length;
+};
+
+/* Splits a client's byte stream into IRC lines without allocating.
+   Lines that arrive whole inside a received block are handed out in place;
+   only a line cut by the end of a block is copied, into a fixed buffer of
+   MAX_LINE bytes. Lines longer than the RFC 1459 limit (512 bytes with the
+   CR LF) are truncated to MAX_LINE - 2 and the rest is dropped.
+
+   Usage, for every received block:
+       framer.feed(data, length);
+       while (framer.next(line)) ... ;
+   next() must run until it returns false before the block goes away: that
+   is when the unterminated tail gets copied. A returned view is valid until
+   the next call to next() or feed().
+
+   A caller that has to stop early calls park() with the line it is not
+   taking yet. The rest of the stream is then copied aside, blocks fed
+   afterwards are queued behind it, and next() hands the lines out again
+   once the caller resumes. */
+class LineFramer {
+public:
+    enum { MAX_LINE = 512 };
+
+    LineFramer();
+    void feed(const char* data, size_t length);
+    bool next(LineView& line);
+    /* Gives `line`, just returned by next(), back along with everything after it. */
+    void park(const LineView& line);
+    /* Bytes of an incomplete line waiting for the rest of it. */
+    size_t pending() const;
+    const char* pendingData() const;
+    /* Bytes given back by park() or queued behind them, not handed out yet. */
+    size_t parked() const;
+
+private:
+    const char* block;
+    size_t blockLength;
+    size_t pos;
+    char partial[MAX_LINE];
+    size_t partialLength;
+    bool partialReturned; /* `partial` was handed out, clear it on the next call */
+    std::string held;     /* parked bytes; lines are handed out from here while it is not empty */
+    size_t heldPos;
+
+    void compactHeld();
+    bool nextHeld(LineView& line);
+
+    void stash(const char* data, size_t length);
+    static LineView trim(const char* data, size_t length);
+};
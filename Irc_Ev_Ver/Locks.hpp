@@ -0,0 +1,43 @@
+#pragma once
+
+#include <pthread.h>
+
+/* Scoped holders for the locks around what the shards share; Server.hpp
+   lists what each lock covers and the order they are taken in. None of
+   them is recursive: a thread never takes a lock it already holds. */
+
+class ReadGuard {
+public:
+    explicit ReadGuard(pthread_rwlock_t& l) : lock(l) { pthread_rwlock_rdlock(&lock); }
+    ~ReadGuard() { pthread_rwlock_unlock(&lock); }
+
+private:
+    pthread_rwlock_t& lock;
+
+    ReadGuard(const ReadGuard&);
+    ReadGuard& operator=(const ReadGuard&);
+};
+
+class WriteGuard {
+public:
+    explicit WriteGuard(pthread_rwlock_t& l) : lock(l) { pthread_rwlock_wrlock(&lock); }
+    ~WriteGuard() { pthread_rwlock_unlock(&lock); }
+
+private:
+    pthread_rwlock_t& lock;
+
+    WriteGuard(const WriteGuard&);
+    WriteGuard& operator=(const WriteGuard&);
+};
+
+class MutexGuard {
+public:
+    explicit MutexGuard(pthread_mutex_t& m) : mutex(m) { pthread_mutex_lock(&mutex); }
+    ~MutexGuard() { pthread_mutex_unlock(&mutex); }
+
+private:
+    pthread_mutex_t& mutex;
+
+    MutexGuard(const MutexGuard&);
+    MutexGuard& operator=(const MutexGuard&);
+};
@@ -0,0 +1,315 @@
+#include "Log.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+# include <sys/eventfd.h>
+#endif
+
+namespace {
+
+struct Slot {
+    size_t sequence;  /* == position: free for that producer; == position + 1: holds a line */
+    LogLevel level;
+    time_t seconds;
+    long millis;
+    size_t length;
+    char text[Log::LINE_SIZE];
+};
+
+/* Bounded multi-producer queue (one sequence number per slot, Vyukov
+   style). The writer thread is the only consumer. */
+struct Ring {
+    Slot slots[Log::RING_SIZE];
+    size_t tail;      /* next position producers claim */
+    size_t head;      /* next position the writer reads, writer only */
+    unsigned long dropped;
+    int level;
+    int signalled;
+    int readFd;
+    int writeFd;
+    int running;
+    pthread_t thread;
+
+    Ring() : tail(0), head(0), dropped(0), level(LOG_LEVEL_INFO), signalled(0), readFd(-1), writeFd(-1), running(0) {
+        for (size_t i = 0; i < Log::RING_SIZE; ++i)
+            slots[i].sequence = i;
+    }
+};
+
+Ring ring;
+
+const char* const levelNames[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+/* How long the busy writer lets lines pile up; RING_SIZE lines per delay is the sustained ceiling. */
+const long BATCH_DELAY_NS = 2 * 1000 * 1000;
+
+bool pop(Slot*& slot) {
+    Slot& candidate = ring.slots[ring.head & (Log::RING_SIZE - 1)];
+    if (__atomic_load_n(&candidate.sequence, __ATOMIC_ACQUIRE) != ring.head + 1)
+        return false;
+    slot = &candidate;
+    return true;
+}
+
+void release(Slot& slot) {
+    __atomic_store_n(&slot.sequence, ring.head + Log::RING_SIZE, __ATOMIC_RELEASE);
+    ++ring.head;
+}
+
+/* Output buffer for one stream, flushed when full and after each batch. */
+struct Sink {
+    int fd;
+    char data[64 * 1024];
+    size_t length;
+
+    explicit Sink(int f) : fd(f), length(0) {}
+
+    void flush() {
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = write(fd, data + done, length - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        length = 0;
+    }
+
+    void put(const char* text, size_t size) {
+        if (length + size > sizeof(data))
+            flush();
+        memcpy(data + length, text, size);
+        length += size;
+    }
+};
+
+/* "HH:MM:SS.mmm LEVEL text\n"; the clock part is only redone when the second changes. */
+void format(Sink& sink, const Slot& slot) {
+    static time_t cachedSeconds = -1;
+    static char clock[16];
+    if (slot.seconds != cachedSeconds) {
+        struct tm local;
+        localtime_r(&slot.seconds, &local);
+        snprintf(clock, sizeof(clock), "%02d:%02d:%02d", local.tm_hour, local.tm_min, local.tm_sec);
+        cachedSeconds = slot.seconds;
+    }
+    char stamp[32];
+    int n = snprintf(stamp, sizeof(stamp), "%s.%03ld %-5s ", clock, slot.millis, levelNames[slot.level]);
+    sink.put(stamp, n);
+    sink.put(slot.text, slot.length);
+    sink.put("\n", 1);
+}
+
+/* Takes everything queued so far; returns whether there was anything. */
+bool drainOnce(Sink& out, Sink& err, unsigned long& reportedDrops) {
+    bool any = false;
+    Slot* slot;
+    while (pop(slot)) {
+        format(slot->level >= LOG_LEVEL_WARN ? err : out, *slot);
+        release(*slot);
+        any = true;
+    }
+    unsigned long drops = __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+    if (drops != reportedDrops) {
+        char note[64];
+        int n = snprintf(note, sizeof(note), "log: %lu lines dropped, ring full\n", drops - reportedDrops);
+        err.put(note, n);
+        reportedDrops = drops;
+        any = true;
+    }
+    out.flush();
+    err.flush();
+    return any;
+}
+
+void* writerMain(void*) {
+    /* Signals are for the shard threads. */
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    static Sink out(1);
+    static Sink err(2);
+    unsigned long reportedDrops = 0;
+    while (__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE)) {
+        /* While lines keep coming, poll the ring every BATCH_DELAY and leave
+           `signalled` set so producers skip the wakeup syscall. */
+        if (drainOnce(out, err, reportedDrops)) {
+            struct timespec delay = { 0, BATCH_DELAY_NS };
+            nanosleep(&delay, NULL);
+            continue;
+        }
+        /* Idle: clear the flag, look once more, then sleep until a producer
+           (or stop()) signals; no timeout, an idle server stays asleep. */
+        __atomic_store_n(&ring.signalled, 0, __ATOMIC_SEQ_CST);
+        if (drainOnce(out, err, reportedDrops))
+            continue;
+        struct pollfd pfd;
+        pfd.fd = ring.readFd;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, -1);
+        char buf[64];
+        while (read(ring.readFd, buf, sizeof(buf)) > 0) {
+        }
+    }
+    while (drainOnce(out, err, reportedDrops)) {
+    }
+    return NULL;
+}
+
+}
+
+void Log::start() {
+    if (ring.running)
+        return;
+#ifdef __linux__
+    ring.readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ring.writeFd = ring.readFd;
+#else
+    int p[2];
+    if (pipe(p) == 0) {
+        fcntl(p[0], F_SETFL, O_NONBLOCK);
+        fcntl(p[1], F_SETFL, O_NONBLOCK);
+        ring.readFd = p[0];
+        ring.writeFd = p[1];
+    }
+#endif
+    if (ring.readFd == -1)
+        return;
+    __atomic_store_n(&ring.running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&ring.thread, NULL, writerMain, NULL) != 0) {
+        __atomic_store_n(&ring.running, 0, __ATOMIC_RELEASE);
+        perror("log: unable to start writer thread");
+    }
+}
+
+void Log::stop() {
+    if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_store_n(&ring.running, 0, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    ssize_t ret = write(ring.writeFd, &one, sizeof(one));
+    (void)ret;
+    pthread_join(ring.thread, NULL);
+    if (ring.writeFd != ring.readFd)
+        close(ring.writeFd);
+    close(ring.readFd);
+    ring.readFd = -1;
+    ring.writeFd = -1;
+}
+
+void Log::setLevel(LogLevel level) { __atomic_store_n(&ring.level, static_cast<int>(level), __ATOMIC_RELAXED); }
+
+LogLevel Log::level() { return static_cast<LogLevel>(__atomic_load_n(&ring.level, __ATOMIC_RELAXED)); }
+
+bool Log::enabled(LogLevel level) { return static_cast<int>(level) >= __atomic_load_n(&ring.level, __ATOMIC_RELAXED); }
+
+bool Log::parseLevel(const std::string& name, LogLevel& level) {
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_ERROR; ++i) {
+        if (strcasecmp(name.c_str(), levelNames[i]) == 0) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long Log::dropped() { return __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED); }
+
+void Log::submit(LogLevel level, const char* text, size_t length) {
+    size_t pos = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+    Slot* slot;
+    for (;;) {
+        slot = &ring.slots[pos & (RING_SIZE - 1)];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring.tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&ring.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    struct timespec now;
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    slot->level = level;
+    slot->seconds = now.tv_sec;
+    slot->millis = now.tv_nsec / 1000000;
+    if (length > LINE_SIZE)
+        length = LINE_SIZE;
+    memcpy(slot->text, text, length);
+    slot->length = length;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    /* Only the first line after the writer went idle pays for the wakeup syscall. */
+    if (ring.writeFd != -1 && __atomic_exchange_n(&ring.signalled, 1, __ATOMIC_ACQ_REL) == 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(ring.writeFd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+LogLine::LogLine(LogLevel l) : level(l), length(0) {}
+
+LogLine::~LogLine() { Log::submit(level, text, length); }
+
+void LogLine::append(const char* data, size_t size) {
+    size_t room = Log::LINE_SIZE - length;
+    if (size > room)
+        size = room;
+    memcpy(text + length, data, size);
+    length += size;
+}
+
+LogLine& LogLine::operator<<(const char* value) {
+    append(value, strlen(value));
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& value) {
+    append(value.data(), value.size());
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const LogBytes& bytes) {
+    append(bytes.data, bytes.length);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(char c) {
+    append(&c, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(int value) { return *this << static_cast<long>(value); }
+
+LogLine& LogLine::operator<<(unsigned int value) { return *this << static_cast<unsigned long>(value); }
+
+LogLine& LogLine::operator<<(long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%ld", value);
+    append(digits, n);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(unsigned long value) {
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%lu", value);
+    append(digits, n);
+    return *this;
+}
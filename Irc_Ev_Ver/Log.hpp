@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO = 1,
+    LOG_LEVEL_WARN = 2,
+    LOG_LEVEL_ERROR = 3
+};
+
+/* Statements below this level are compiled out entirely, e.g.
+   `make re LOG_LEVEL=1` drops every LOG_DEBUG. */
+#ifndef LOG_COMPILED_LEVEL
+# define LOG_COMPILED_LEVEL 0
+#endif
+
+/* Usage: LOG_INFO("Client " << fd << " removed");
+   The operands are only evaluated when the level is enabled. */
+#define LOG_AT(level, expr) \
+    do { \
+        if ((level) >= LOG_COMPILED_LEVEL && Log::enabled(level)) { \
+            LogLine logLine_(level); \
+            logLine_ << expr; \
+        } \
+    } while (0)
+#define LOG_DEBUG(expr) LOG_AT(LOG_LEVEL_DEBUG, expr)
+#define LOG_INFO(expr) LOG_AT(LOG_LEVEL_INFO, expr)
+#define LOG_WARN(expr) LOG_AT(LOG_LEVEL_WARN, expr)
+#define LOG_ERROR(expr) LOG_AT(LOG_LEVEL_ERROR, expr)
+
+/* Process-wide asynchronous log. Any thread hands a finished line to a
+   preallocated ring with one CAS and never blocks: when the ring is full
+   the line is dropped and counted. A background thread started by start()
+   takes lines off the ring, stamps them with their time and writes them in
+   batches, WARN and ERROR to stderr, the rest to stdout. */
+class Log {
+public:
+    enum { LINE_SIZE = 512, RING_SIZE = 2048 };
+
+    static void start();
+    /* Writes out whatever is queued and joins the writer. */
+    static void stop();
+    static void setLevel(LogLevel level);
+    static LogLevel level();
+    static bool enabled(LogLevel level);
+    /* "debug", "info", "warn" or "error". */
+    static bool parseLevel(const std::string& name, LogLevel& level);
+    /* Lines lost to a full ring since startup. */
+    static unsigned long dropped();
+
+    static void submit(LogLevel level, const char* text, size_t length);
+};
+
+/* Raw bytes to log as they are, e.g. part of a received block. */
+struct LogBytes {
+    LogBytes(const char* d, size_t n) : data(d), length(n) {}
+    const char* data;
+    size_t length;
+};
+
+/* One line under construction in a fixed buffer; it is submitted when the
+   object goes away. Anything past Log::LINE_SIZE is cut. */
+class LogLine {
+public:
+    explicit LogLine(LogLevel level);
+    ~LogLine();
+
+    LogLine& operator<<(const char* text);
+    LogLine& operator<<(const std::string& text);
+    LogLine& operator<<(const LogBytes& bytes);
+    LogLine& operator<<(char c);
+    LogLine& operator<<(int value);
+    LogLine& operator<<(unsigned int value);
+    LogLine& operator<<(long value);
+    LogLine& operator<<(unsigned long value);
+
+private:
+    LogLevel level;
+    char text[Log::LINE_SIZE];
+    size_t length;
+
+    void append(const char* data, size_t size);
+    LogLine(const LogLine&);
+    LogLine& operator=(const LogLine&);
+};
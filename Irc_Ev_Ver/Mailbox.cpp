@@ -0,0 +1,118 @@
+#include "Mailbox.hpp"
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+# include <sys/eventfd.h>
+#endif
+
+namespace {
+
+const size_t ITEMS_PER_SLAB = 32;
+
+}
+
+Mailbox::Mailbox() : head(NULL), signalled(0), readFd(-1), writeFd(-1) {
+#ifdef __linux__
+    readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    writeFd = readFd;
+#else
+    int p[2];
+    if (pipe(p) == 0) {
+        fcntl(p[0], F_SETFL, O_NONBLOCK);
+        fcntl(p[1], F_SETFL, O_NONBLOCK);
+        readFd = p[0];
+        writeFd = p[1];
+    }
+#endif
+}
+
+Mailbox::~Mailbox() {
+    Item* item = drain();
+    while (item) {
+        Item* next = item->next;
+        item->pool->release(item);
+        item = next;
+    }
+    if (writeFd != -1 && writeFd != readFd)
+        close(writeFd);
+    if (readFd != -1)
+        close(readFd);
+}
+
+bool Mailbox::isValid() const { return readFd != -1; }
+
+int Mailbox::fd() const { return readFd; }
+
+void Mailbox::post(Item* first, Item* last) {
+    Item* old = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    do {
+        last->next = old;
+    } while (!__atomic_compare_exchange_n(&head, &old, first, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    wake();
+}
+
+/* Only the first wakeup after a drain pays for the syscall. */
+void Mailbox::wake() {
+    if (__atomic_exchange_n(&signalled, 1, __ATOMIC_ACQ_REL) == 0) {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t ret = write(writeFd, &one, sizeof(one));
+#else
+        char one = 1;
+        ssize_t ret = write(writeFd, &one, sizeof(one));
+#endif
+        (void)ret;
+    }
+}
+
+Mailbox::Item* Mailbox::drain() {
+    char buf[64];
+    while (read(readFd, buf, sizeof(buf)) > 0) {
+    }
+    /* Clear the flag before taking the list: a post racing with us either
+       lands in this batch or triggers a fresh wakeup. */
+    __atomic_store_n(&signalled, 0, __ATOMIC_SEQ_CST);
+    Item* list = __atomic_exchange_n(&head, static_cast<Item*>(NULL), __ATOMIC_ACQUIRE);
+
+    Item* fifo = NULL;
+    while (list) {
+        Item* next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    return fifo;
+}
+
+MailPool::MailPool() : items(sizeof(Mailbox::Item), ITEMS_PER_SLAB), returned(NULL) {}
+
+Mailbox::Item* MailPool::allocate() {
+    if (metricRead(items.getStats().free) == 0)
+        collect();
+    Mailbox::Item* item = new (items.allocate()) Mailbox::Item;
+    item->count = 0;
+    item->pool = this;
+    item->next = NULL;
+    return item;
+}
+
+/* The line goes first: its last reference may be the one in this item. */
+void MailPool::release(Mailbox::Item* item) {
+    item->~Item();
+    Returned* node = reinterpret_cast<Returned*>(item);
+    node->next = __atomic_load_n(&returned, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&returned, &node->next, node, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+void MailPool::collect() {
+    Returned* node = __atomic_exchange_n(&returned, static_cast<Returned*>(NULL), __ATOMIC_ACQUIRE);
+    while (node) {
+        Returned* next = node->next;
+        items.release(node);
+        node = next;
+    }
+}
+
+const PoolStats& MailPool::getStats() const { return items.getStats(); }
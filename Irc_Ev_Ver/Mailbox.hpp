@@ -0,0 +1,81 @@
+#pragma once
+
+#include "SharedBuffer.hpp"
+#include "Pool.hpp"
+
+class MailPool;
+
+/* Multi-producer / single-consumer queue used to hand lines to clients
+   owned by another shard. Producers push with a CAS on `head` and never
+   block; the owning shard takes the whole list at once, so there is no ABA.
+   `fd()` becomes readable when something was posted and is meant to be
+   registered with the owner's reactor. */
+class Mailbox {
+public:
+    enum { BATCH = 30 }; /* recipients per item: the item fits in 512 bytes */
+
+    struct Recipient {
+        int clientSocket;
+        unsigned long clientId; /* guards against the fd being reused before delivery */
+    };
+
+    /* One line for up to BATCH clients of the owning shard. */
+    struct Item {
+        BufferRef line;
+        size_t count;
+        Recipient to[BATCH];
+        MailPool* pool; /* the posting shard's, the item goes back there once delivered */
+        Item* next;
+    };
+
+    Mailbox();
+    ~Mailbox();
+    bool isValid() const;
+    int fd() const;
+
+    /* Any thread: `first` to `last`, linked through `next` newest first,
+       go in with a single CAS. */
+    void post(Item* first, Item* last);
+    /* Any thread: makes `fd()` readable without posting anything. */
+    void wake();
+    /* Owner thread only: returns posted items in FIFO order; the caller gives
+       each one back to its `pool`. */
+    Item* drain();
+
+private:
+    Item* head;
+    int signalled;
+    int readFd;
+    int writeFd;
+
+    Mailbox(const Mailbox&);
+    Mailbox& operator=(const Mailbox&);
+};
+
+/* Mailbox items posted by one shard. Only the posting shard allocates; the
+   shard that delivered an item releases it from its own thread onto a
+   lock-free list (CAS on `returned`, as in BufferPool) and the poster takes
+   the list back in collect(): when the pool runs dry and once per tick. */
+class MailPool {
+public:
+    MailPool();
+
+    /* Owner thread: an empty item whose `pool` is this one. */
+    Mailbox::Item* allocate();
+    /* Any thread: drops the item's line and hands the item back. */
+    void release(Mailbox::Item* item);
+    /* Owner thread: puts released items back in the pool. */
+    void collect();
+    const PoolStats& getStats() const;
+
+private:
+    struct Returned {
+        Returned* next;
+    };
+
+    FixedPool items;
+    Returned* returned;
+
+    MailPool(const MailPool&);
+    MailPool& operator=(const MailPool&);
+};
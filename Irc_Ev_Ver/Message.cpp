@@ -0,0 +1,153 @@
+#include "Message.hpp"
+#include <cstring>
+
+namespace {
+
+LineView makeView(const char* data, size_t length) {
+    LineView view;
+    view.data = data;
+    view.length = length;
+    return view;
+}
+
+/* Compares against an upper-case literal of the same length. */
+bool tokenIs(const char* token, const char* upper, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        char c = token[i];
+        if (c >= 'a' && c <= 'z')
+            c = static_cast<char>(c - 32);
+        if (c != upper[i])
+            return false;
+    }
+    return true;
+}
+
+/* Returns the position of the next space at or after `pos`, or `end`. */
+size_t findSpace(const char* data, size_t pos, size_t end) {
+    const char* space = static_cast<const char*>(memchr(data + pos, ' ', end - pos));
+    return space ? static_cast<size_t>(space - data) : end;
+}
+
+size_t skipSpaces(const char* data, size_t pos, size_t end) {
+    while (pos < end && data[pos] == ' ')
+        ++pos;
+    return pos;
+}
+
+/* Indexed by CommandId, keep the two in the same order. */
+const char* const commandNames[CMD_COUNT] = {
+    "UNKNOWN", "CAP", "PASS", "NICK", "USER", "QUIT", "JOIN", "PING", "PONG",
+    "MODE", "KICK", "TOPIC", "WHOIS", "INVITE", "PRIVMSG", "OPER", "STATS"
+};
+
+}
+
+const char* commandName(CommandId id) {
+    return id < CMD_COUNT ? commandNames[id] : commandNames[CMD_UNKNOWN];
+}
+
+/* Length and first letter narrow the token down to at most one candidate,
+   which is then compared in full: one switch, one comparison. */
+CommandId lookupCommand(const char* name, size_t length) {
+    if (length == 0)
+        return CMD_UNKNOWN;
+    char first = name[0];
+    if (first >= 'a' && first <= 'z')
+        first = static_cast<char>(first - 32);
+    CommandId id = CMD_UNKNOWN;
+    const char* upper = NULL;
+    switch (length) {
+        case 3:
+            if (first == 'C') { id = CMD_CAP; upper = "CAP"; }
+            break;
+        case 4:
+            switch (first) {
+                case 'P':
+                    if (name[1] == 'A' || name[1] == 'a') { id = CMD_PASS; upper = "PASS"; }
+                    else if (name[1] == 'O' || name[1] == 'o') { id = CMD_PONG; upper = "PONG"; }
+                    else { id = CMD_PING; upper = "PING"; }
+                    break;
+                case 'N': id = CMD_NICK; upper = "NICK"; break;
+                case 'U': id = CMD_USER; upper = "USER"; break;
+                case 'Q': id = CMD_QUIT; upper = "QUIT"; break;
+                case 'J': id = CMD_JOIN; upper = "JOIN"; break;
+                case 'M': id = CMD_MODE; upper = "MODE"; break;
+                case 'K': id = CMD_KICK; upper = "KICK"; break;
+                case 'O': id = CMD_OPER; upper = "OPER"; break;
+            }
+            break;
+        case 5:
+            if (first == 'T') { id = CMD_TOPIC; upper = "TOPIC"; }
+            else if (first == 'W') { id = CMD_WHOIS; upper = "WHOIS"; }
+            else if (first == 'S') { id = CMD_STATS; upper = "STATS"; }
+            break;
+        case 6:
+            if (first == 'I') { id = CMD_INVITE; upper = "INVITE"; }
+            break;
+        case 7:
+            if (first == 'P') { id = CMD_PRIVMSG; upper = "PRIVMSG"; }
+            break;
+    }
+    if (!upper || !tokenIs(name, upper, length))
+        return CMD_UNKNOWN;
+    return id;
+}
+
+bool Message::parse(const LineView& line) {
+    const char* data = line.data;
+    size_t end = line.length;
+    size_t pos = 0;
+
+    raw = line;
+    tags = makeView(data, 0);
+    prefix = makeView(data, 0);
+    paramCount = 0;
+    trailing = false;
+
+    if (pos < end && data[pos] == '@') {
+        size_t stop = findSpace(data, pos, end);
+        tags = makeView(data + pos + 1, stop - pos - 1);
+        pos = skipSpaces(data, stop, end);
+    }
+    if (pos < end && data[pos] == ':') {
+        size_t stop = findSpace(data, pos, end);
+        prefix = makeView(data + pos + 1, stop - pos - 1);
+        pos = skipSpaces(data, stop, end);
+    }
+    size_t stop = findSpace(data, pos, end);
+    command = makeView(data + pos, stop - pos);
+    if (command.length == 0) {
+        id = CMD_UNKNOWN;
+        return false;
+    }
+    id = lookupCommand(command.data, command.length);
+    pos = skipSpaces(data, stop, end);
+
+    while (pos < end) {
+        if (data[pos] == ':' || paramCount == MAX_PARAMS - 1) {
+            if (data[pos] == ':') {
+                ++pos;
+                trailing = true;
+            }
+            params[paramCount++] = makeView(data + pos, end - pos);
+            break;
+        }
+        stop = findSpace(data, pos, end);
+        params[paramCount++] = makeView(data + pos, stop - pos);
+        pos = skipSpaces(data, stop, end);
+    }
+    return true;
+}
+
+std::string Message::param(size_t index) const {
+    if (index >= paramCount)
+        return std::string();
+    return std::string(params[index].data, params[index].length);
+}
+
+bool Message::paramEquals(size_t index, const char* text) const {
+    if (index >= paramCount)
+        return false;
+    size_t length = strlen(text);
+    return params[index].length == length && memcmp(params[index].data, text, length) == 0;
+}
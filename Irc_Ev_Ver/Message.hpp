@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "LineFramer.hpp"
+
+/* Commands the server dispatches on. CMD_UNKNOWN covers everything else. */
+enum CommandId {
+    CMD_UNKNOWN,
+    CMD_CAP,
+    CMD_PASS,
+    CMD_NICK,
+    CMD_USER,
+    CMD_QUIT,
+    CMD_JOIN,
+    CMD_PING,
+    CMD_PONG,
+    CMD_MODE,
+    CMD_KICK,
+    CMD_TOPIC,
+    CMD_WHOIS,
+    CMD_INVITE,
+    CMD_PRIVMSG,
+    CMD_OPER,
+    CMD_STATS,
+    CMD_COUNT /* number of ids, not a command */
+};
+
+/* Maps a command token to its id, ignoring case. */
+CommandId lookupCommand(const char* name, size_t length);
+/* The upper-case command, "UNKNOWN" for CMD_UNKNOWN. */
+const char* commandName(CommandId id);
+
+/* One IRC line split once into its parts:
+       [@tags] [:prefix] command [param ...] [:trailing]
+   Every part is a view into the parsed line, so a Message is valid only as
+   long as that line is, and parsing never allocates. The trailing part, if
+   any, is stored as the last param with `trailing` set. Past MAX_PARAMS - 1
+   middle params the rest of the line becomes the last param, as RFC 1459
+   2.3.1 allows at most 15. */
+struct Message {
+    enum { MAX_PARAMS = 15 };
+
+    LineView raw;
+    LineView tags;    /* without the '@' */
+    LineView prefix;  /* without the ':' */
+    LineView command;
+    CommandId id;
+    LineView params[MAX_PARAMS];
+    size_t paramCount;
+    bool trailing;
+
+    /* Returns false for a line without a command token. */
+    bool parse(const LineView& line);
+    /* Copy of param `index`, or an empty string if it was not given. */
+    std::string param(size_t index) const;
+    bool paramEquals(size_t index, const char* text) const;
+};
@@ -0,0 +1,45 @@
+#include "Metrics.hpp"
+#include <cstring>
+#include <time.h>
+
+const unsigned long LOOP_BUCKET_US[LOOP_BUCKETS] = { 10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000 };
+
+unsigned long monotonicNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+ShardMetrics::ShardMetrics() {
+    memset(this, 0, sizeof(*this));
+}
+
+void ShardMetrics::recordLoop(unsigned long nanos) {
+    size_t bucket = 0;
+    while (bucket < LOOP_BUCKETS && nanos > LOOP_BUCKET_US[bucket] * 1000UL)
+        ++bucket;
+    metricAdd(loopCount[bucket], 1);
+    metricAdd(loopNanos, nanos);
+}
+
+void ShardMetrics::accumulate(const ShardMetrics& shard) {
+    accepted += metricRead(shard.accepted);
+    closed += metricRead(shard.closed);
+    registrations += metricRead(shard.registrations);
+    throttles += metricRead(shard.throttles);
+    bytesRead += metricRead(shard.bytesRead);
+    bytesWritten += metricRead(shard.bytesWritten);
+    for (size_t i = 0; i < CMD_COUNT; ++i) {
+        linesIn[i] += metricRead(shard.linesIn[i]);
+        linesOut[i] += metricRead(shard.linesOut[i]);
+    }
+    posted += metricRead(shard.posted);
+    queues.bytes += metricRead(shard.queues.bytes);
+    queues.lines += metricRead(shard.queues.lines);
+    unsigned long peak = metricRead(shard.queues.peak);
+    if (peak > queues.peak)
+        queues.peak = peak;
+    for (size_t i = 0; i <= LOOP_BUCKETS; ++i)
+        loopCount[i] += metricRead(shard.loopCount[i]);
+    loopNanos += metricRead(shard.loopNanos);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include "Message.hpp"
+
+/* Metric counters are written by one thread only, the shard that owns
+   them, and may be read by any thread for an export. A relaxed load and
+   store is all an update needs then: no lock prefix and no shared cache
+   line between shards. */
+inline void metricAdd(unsigned long& counter, unsigned long n) {
+    __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+inline void metricSub(unsigned long& counter, unsigned long n) {
+    __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) - n, __ATOMIC_RELAXED);
+}
+
+inline void metricSet(unsigned long& gauge, unsigned long value) {
+    __atomic_store_n(&gauge, value, __ATOMIC_RELAXED);
+}
+
+inline unsigned long metricRead(const unsigned long& counter) {
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+/* CLOCK_MONOTONIC in nanoseconds. */
+unsigned long monotonicNanos();
+
+/* What the send queues of one shard's clients hold, kept by SendQueue. */
+struct QueueAccount {
+    unsigned long bytes; /* queued now */
+    unsigned long lines; /* ever appended; every append is one line */
+    unsigned long peak;  /* largest single queue seen */
+};
+
+/* Upper bounds of the event loop iteration histogram, in microseconds;
+   one more bucket catches everything above the last. */
+enum { LOOP_BUCKETS = 9 };
+extern const unsigned long LOOP_BUCKET_US[LOOP_BUCKETS];
+
+/* Counters of one Shard; see MetricsExporter for what each becomes. */
+struct ShardMetrics {
+    unsigned long accepted;
+    unsigned long closed;
+    unsigned long registrations;
+    unsigned long throttles;
+    unsigned long bytesRead;
+    unsigned long bytesWritten;
+    unsigned long linesIn[CMD_COUNT];
+    unsigned long linesOut[CMD_COUNT]; /* queued while the command ran, other shards' clients included */
+    unsigned long posted;              /* lines handed to other shards' mailboxes */
+    QueueAccount queues;
+    unsigned long loopCount[LOOP_BUCKETS + 1];
+    unsigned long loopNanos;
+
+    ShardMetrics();
+    void recordLoop(unsigned long nanos);
+    /* Adds a snapshot of `shard` to this one, which no other thread may see;
+       queues.peak becomes the largest of the two. */
+    void accumulate(const ShardMetrics& shard);
+};
@@ -0,0 +1,280 @@
+#include "MetricsExporter.hpp"
+#include "Server.hpp"
+#include "Shard.hpp"
+#include "Metrics.hpp"
+#include "Pool.hpp"
+#include "Log.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const int REQUEST_WAIT_MS = 200; /* how long a client may take to say GET */
+const int SEND_TIMEOUT_S = 2;
+
+void describe(std::ostringstream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+void metric(std::ostringstream& out, const char* name, const char* type, const char* help, unsigned long value) {
+    describe(out, name, type, help);
+    out << name << " " << value << "\n";
+}
+
+/* Microseconds as seconds without exponent notation, "0.00001" rather than "1e-05". */
+std::string seconds(unsigned long micros) {
+    char text[32];
+    snprintf(text, sizeof(text), "%lu.%06lu", micros / 1000000UL, micros % 1000000UL);
+    size_t end = strlen(text);
+    while (text[end - 1] == '0')
+        --end;
+    if (text[end - 1] == '.')
+        --end;
+    return std::string(text, end);
+}
+
+bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+}
+
+MetricsExporter::MetricsExporter(Server& s) : server(s), listenFd(-1), running(false) {
+    wakeFds[0] = -1;
+    wakeFds[1] = -1;
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const std::string& path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || pipe(wakeFds) < 0) {
+        LOG_ERROR("Admin socket setup failed, reason: " << strerror(errno));
+        closeFds();
+        return false;
+    }
+    fcntl(wakeFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wakeFds[1], F_SETFD, FD_CLOEXEC);
+    unlink(path.c_str()); // A socket file left by a previous run would make bind() fail
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 8) < 0) {
+        LOG_ERROR("Admin socket " << path << " unavailable, reason: " << strerror(errno));
+        closeFds();
+        return false;
+    }
+    socketPath = path;
+    chmod(path.c_str(), S_IRUSR | S_IWUSR); // Only the server's user may read the metrics
+    if (pthread_create(&thread, NULL, MetricsExporter::threadMain, this) != 0) {
+        LOG_ERROR("unable to start the metrics exporter");
+        unlink(socketPath.c_str());
+        closeFds();
+        return false;
+    }
+    running = true;
+    LOG_INFO("Metrics exported on " << path);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    if (!running) {
+        return;
+    }
+    char byte = 0;
+    while (write(wakeFds[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+    pthread_join(thread, NULL);
+    running = false;
+    unlink(socketPath.c_str());
+    closeFds();
+}
+
+void MetricsExporter::closeFds() {
+    int* fds[] = { &listenFd, &wakeFds[0], &wakeFds[1] };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        if (*fds[i] != -1) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+void* MetricsExporter::threadMain(void* arg) {
+    static_cast<MetricsExporter*>(arg)->serve();
+    return NULL;
+}
+
+/* One scraper at a time is plenty; the next one waits in the backlog. */
+void MetricsExporter::serve() {
+    struct pollfd fds[2];
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFds[0];
+    fds[1].events = POLLIN;
+    for (;;) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Metrics exporter poll failed with errno " << errno);
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            int connection = accept(listenFd, NULL, NULL);
+            if (connection >= 0) {
+                answer(connection);
+                close(connection);
+            }
+        }
+    }
+}
+
+/* Waits briefly for a request so HTTP clients can be told apart, writes the
+   snapshot, then reads whatever is left of the request before closing:
+   closing with unread input would reset the connection under the reply. */
+void MetricsExporter::answer(int connection) {
+    struct timeval timeout;
+    timeout.tv_sec = SEND_TIMEOUT_S;
+    timeout.tv_usec = 0;
+    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct pollfd pfd;
+    pfd.fd = connection;
+    pfd.events = POLLIN;
+    char request[1024];
+    ssize_t received = 0;
+    if (poll(&pfd, 1, REQUEST_WAIT_MS) > 0) {
+        received = recv(connection, request, sizeof(request), MSG_DONTWAIT);
+    }
+
+    std::string body;
+    render(server, body);
+    std::string reply;
+    if (received >= 3 && memcmp(request, "GET", 3) == 0) {
+        std::ostringstream header;
+        header << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size()
+               << "\r\nConnection: close\r\n\r\n";
+        reply = header.str();
+    }
+    reply += body;
+    if (!sendAll(connection, reply.data(), reply.size())) {
+        LOG_WARN("Metrics scrape cut short, reason: " << strerror(errno));
+        return;
+    }
+    shutdown(connection, SHUT_WR);
+    while (poll(&pfd, 1, REQUEST_WAIT_MS) > 0 && recv(connection, request, sizeof(request), MSG_DONTWAIT) > 0) {
+    }
+}
+
+/* Shard counters are summed into one snapshot, except the loop histogram,
+   which is labelled per shard: one slow event loop is what it is there to
+   show. Counters only grow; a reader may see one shard a little later than
+   another, which rate() does not mind. */
+void MetricsExporter::render(Server& server, std::string& out) {
+    size_t connections;
+    size_t channelCount;
+    size_t largestChannel = 0;
+    {
+        ReadGuard channelsGuard(server.channelsLock);
+        ReadGuard clientsGuard(server.clientsLock);
+        connections = server.m_clients.size();
+        channelCount = server.channels.size();
+        for (ChannelDirectory::iterator it = server.channels.begin(); it != server.channels.end(); ++it) {
+            if (it->second->getMemberCount() > largestChannel)
+                largestChannel = it->second->getMemberCount();
+        }
+    }
+    ShardMetrics total;
+    const size_t poolCount = 4 + BufferPool::CLASSES;
+    PoolStats pools[poolCount]; /* clients, segments, chunks, mailbox items, then the buffer classes */
+    for (size_t i = 0; i < server.shards.size(); ++i) {
+        const Shard& shard = *server.shards[i];
+        total.accumulate(shard.getMetrics());
+        pools[0].accumulate(shard.getClientPool().getStats());
+        pools[1].accumulate(shard.getSegmentPool().getStats());
+        pools[2].accumulate(shard.getChunkPool().getStats());
+        pools[3].accumulate(shard.getMailPool().getStats());
+        for (size_t c = 0; c < BufferPool::CLASSES; ++c) {
+            pools[4 + c].accumulate(shard.getBufferPool().getStats(c));
+        }
+    }
+
+    std::ostringstream oss;
+    metric(oss, "ircserv_connections", "gauge", "Clients connected now.", connections);
+    metric(oss, "ircserv_connections_total", "counter", "Connections accepted.", total.accepted);
+    metric(oss, "ircserv_registrations_total", "counter", "Clients that completed PASS, NICK and USER.", total.registrations);
+    describe(oss, "ircserv_lines_in_total", "counter", "Lines received, by command.");
+    for (size_t i = 0; i < CMD_COUNT; ++i) {
+        oss << "ircserv_lines_in_total{command=\"" << commandName(static_cast<CommandId>(i)) << "\"} " << total.linesIn[i] << "\n";
+    }
+    describe(oss, "ircserv_lines_out_total", "counter", "Lines queued to any client while a command ran, by that command.");
+    for (size_t i = 0; i < CMD_COUNT; ++i) {
+        oss << "ircserv_lines_out_total{command=\"" << commandName(static_cast<CommandId>(i)) << "\"} " << total.linesOut[i] << "\n";
+    }
+    metric(oss, "ircserv_lines_queued_total", "counter", "Lines appended to send queues, whatever queued them.", total.queues.lines);
+    metric(oss, "ircserv_lines_posted_total", "counter", "Lines handed to another shard's mailbox.", total.posted);
+    metric(oss, "ircserv_read_bytes_total", "counter", "Bytes received from clients.", total.bytesRead);
+    metric(oss, "ircserv_written_bytes_total", "counter", "Bytes sent to clients.", total.bytesWritten);
+    metric(oss, "ircserv_sendq_bytes", "gauge", "Bytes waiting in all send queues.", total.queues.bytes);
+    metric(oss, "ircserv_sendq_max_bytes", "gauge", "Largest single send queue since start.", total.queues.peak);
+    metric(oss, "ircserv_flood_throttles_total", "counter", "Times a client ran out of flood budget.", total.throttles);
+    metric(oss, "ircserv_channels", "gauge", "Channels that exist now.", channelCount);
+    metric(oss, "ircserv_channel_members_max", "gauge", "Members of the largest channel.", largestChannel);
+
+    std::string poolNames[poolCount] = { "clients", "sendq_segments", "sendq_chunks", "mailbox_items" };
+    for (size_t c = 0; c < BufferPool::CLASSES; ++c) {
+        std::ostringstream name;
+        name << "buffers_" << BufferPool::CLASS_SIZE[c];
+        poolNames[4 + c] = name.str();
+    }
+    describe(oss, "ircserv_pool_objects", "gauge", "Objects carved from the shards' allocation pools, by pool and state.");
+    for (size_t i = 0; i < poolCount; ++i) {
+        oss << "ircserv_pool_objects{pool=\"" << poolNames[i] << "\",state=\"in_use\"} " << pools[i].inUse << "\n";
+        oss << "ircserv_pool_objects{pool=\"" << poolNames[i] << "\",state=\"free\"} " << pools[i].free << "\n";
+    }
+    describe(oss, "ircserv_pool_objects_high_water", "gauge", "Most objects in use at once, summed over shards.");
+    for (size_t i = 0; i < poolCount; ++i) {
+        oss << "ircserv_pool_objects_high_water{pool=\"" << poolNames[i] << "\"} " << pools[i].highWater << "\n";
+    }
+
+    oss.precision(9);
+    describe(oss, "ircserv_loop_iteration_seconds", "histogram", "Event loop iterations, from wakeup to the end of the flush.");
+    for (size_t i = 0; i < server.shards.size(); ++i) {
+        const ShardMetrics& shard = server.shards[i]->getMetrics();
+        unsigned long cumulative = 0;
+        for (size_t b = 0; b <= LOOP_BUCKETS; ++b) {
+            cumulative += metricRead(shard.loopCount[b]);
+            oss << "ircserv_loop_iteration_seconds_bucket{shard=\"" << i << "\",le=\""
+                << (b < LOOP_BUCKETS ? seconds(LOOP_BUCKET_US[b]) : std::string("+Inf")) << "\"} " << cumulative << "\n";
+        }
+        oss << "ircserv_loop_iteration_seconds_sum{shard=\"" << i << "\"} " << metricRead(shard.loopNanos) / 1e9 << "\n";
+        oss << "ircserv_loop_iteration_seconds_count{shard=\"" << i << "\"} " << cumulative << "\n";
+    }
+    out += oss.str();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <pthread.h>
+
+class Server;
+
+/* Serves the shards' metrics in the Prometheus text format on a Unix
+   socket (`admin_socket`), from a thread of its own so a slow scraper
+   never holds up an event loop. Each connection gets one snapshot and is
+   closed; a request starting with "GET" gets an HTTP/1.0 response around
+   it, so both `curl --unix-socket` and a plain `socat` work. Counters are
+   read without locks (see Metrics.hpp); only the channel and connection
+   figures take Server's locks, shared, for a moment per scrape. */
+class MetricsExporter {
+public:
+    explicit MetricsExporter(Server& s);
+    ~MetricsExporter();
+
+    /* Binds `path` (replacing a stale socket file) and starts the thread. */
+    bool start(const std::string& path);
+    /* Any thread but the exporter's: stops and joins it, removes the socket. */
+    void stop();
+
+    /* Appends the metrics text to `out`; used by STATS too. */
+    static void render(Server& server, std::string& out);
+
+private:
+    Server& server;
+    std::string socketPath;
+    int listenFd;
+    int wakeFds[2]; /* self-pipe, written by stop() */
+    bool running;
+    pthread_t thread;
+
+    static void* threadMain(void* arg);
+    void serve();
+    void answer(int connection);
+    void closeFds();
+
+    MetricsExporter(const MetricsExporter&);
+    MetricsExporter& operator=(const MetricsExporter&);
+};
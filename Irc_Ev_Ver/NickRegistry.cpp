@@ -0,0 +1,32 @@
+#include "NickRegistry.hpp"
+#include "Casemap.hpp"
+
+int NickRegistry::find(const std::string& nick) const {
+    Map::const_iterator it = nicks.find(casefold(nick));
+    return it == nicks.end() ? -1 : it->second;
+}
+
+bool NickRegistry::rename(int clientSocket, const std::string& oldNick, const std::string& newNick) {
+    std::string key = casefold(newNick);
+    std::pair<Map::iterator, bool> slot = nicks.insert(std::make_pair(key, clientSocket));
+    if (!slot.second && slot.first->second != clientSocket)
+        return false;
+    if (!oldNick.empty()) {
+        std::string oldKey = casefold(oldNick);
+        if (oldKey != key)
+            release(clientSocket, oldNick);
+    }
+    return true;
+}
+
+void NickRegistry::release(int clientSocket, const std::string& nick) {
+    if (nick.empty())
+        return;
+    Map::iterator it = nicks.find(casefold(nick));
+    if (it != nicks.end() && it->second == clientSocket)
+        nicks.erase(it);
+}
+
+void NickRegistry::clear() { nicks.clear(); }
+
+size_t NickRegistry::size() const { return nicks.size(); }
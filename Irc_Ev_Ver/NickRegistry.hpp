@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <tr1/unordered_map>
+
+/* Nickname -> client socket, keyed by the casefolded nick (see Casemap.hpp).
+   Lives in Server and is guarded by clientsLock, like m_clients;
+   handlers look nicks up here instead of walking m_clients. */
+class NickRegistry {
+public:
+    /* Socket owning `nick`, or -1. */
+    int find(const std::string& nick) const;
+    /* Moves `clientSocket` from `oldNick` (may be empty) to `newNick`.
+       Fails, changing nothing, when another client holds `newNick`. */
+    bool rename(int clientSocket, const std::string& oldNick, const std::string& newNick);
+    void release(int clientSocket, const std::string& nick);
+    void clear();
+    size_t size() const;
+
+private:
+    typedef std::tr1::unordered_map<std::string, int> Map;
+    Map nicks;
+};
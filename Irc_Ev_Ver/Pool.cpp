@@ -0,0 +1,122 @@
+#include "Pool.hpp"
+
+namespace {
+
+/* Enough for any type a pool holds, as with malloc(). */
+const size_t ALIGN = 2 * sizeof(void*) > sizeof(long double) ? 2 * sizeof(void*) : sizeof(long double);
+
+const size_t BUFFER_SLAB_BYTES = 16384;
+
+size_t alignUp(size_t n) {
+    return (n + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+}
+
+PoolStats::PoolStats() : inUse(0), free(0), highWater(0) {}
+
+void PoolStats::accumulate(const PoolStats& pool) {
+    inUse += metricRead(pool.inUse);
+    free += metricRead(pool.free);
+    highWater += metricRead(pool.highWater);
+}
+
+FixedPool::FixedPool(size_t objectSize, size_t objectsPerSlab)
+    : size(alignUp(objectSize ? objectSize : 1)), perSlab(objectsPerSlab ? objectsPerSlab : 1), slabs(NULL),
+      freeList(NULL) {}
+
+FixedPool::~FixedPool() {
+    while (slabs) {
+        Slab* next = slabs->next;
+        ::operator delete(slabs);
+        slabs = next;
+    }
+}
+
+void* FixedPool::allocate() {
+    if (!freeList)
+        grow();
+    FreeObject* object = freeList;
+    freeList = object->next;
+    unsigned long inUse = stats.inUse + 1;
+    metricSet(stats.inUse, inUse);
+    metricSet(stats.free, stats.free - 1);
+    if (inUse > stats.highWater)
+        metricSet(stats.highWater, inUse);
+    return object;
+}
+
+void FixedPool::release(void* object) {
+    FreeObject* node = static_cast<FreeObject*>(object);
+    node->next = freeList;
+    freeList = node;
+    metricSet(stats.inUse, stats.inUse - 1);
+    metricSet(stats.free, stats.free + 1);
+}
+
+size_t FixedPool::objectSize() const { return size; }
+
+const PoolStats& FixedPool::getStats() const { return stats; }
+
+/* Threads the new slab's objects onto the free list in address order. */
+void FixedPool::grow() {
+    size_t header = alignUp(sizeof(Slab));
+    char* raw = static_cast<char*>(::operator new(header + perSlab * size));
+    Slab* slab = reinterpret_cast<Slab*>(raw);
+    slab->next = slabs;
+    slabs = slab;
+    for (size_t i = perSlab; i > 0; --i) {
+        FreeObject* object = reinterpret_cast<FreeObject*>(raw + header + (i - 1) * size);
+        object->next = freeList;
+        freeList = object;
+    }
+    metricSet(stats.free, stats.free + perSlab);
+}
+
+/* The largest class fits a full 512-byte line and the SharedBuffer header. */
+const size_t BufferPool::CLASS_SIZE[BufferPool::CLASSES] = { 64, 128, 256, 576 };
+
+BufferPool::BufferPool() : returned(NULL) {
+    for (size_t i = 0; i < CLASSES; ++i)
+        classes[i] = new FixedPool(CLASS_SIZE[i], BUFFER_SLAB_BYTES / CLASS_SIZE[i]);
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < CLASSES; ++i)
+        delete classes[i];
+}
+
+size_t BufferPool::classFor(size_t bytes) {
+    size_t i = 0;
+    while (i < CLASSES && bytes > CLASS_SIZE[i])
+        ++i;
+    return i;
+}
+
+void* BufferPool::allocate(size_t bytes) {
+    size_t sizeClass = classFor(bytes);
+    if (sizeClass == CLASSES)
+        return NULL;
+    if (metricRead(classes[sizeClass]->getStats().free) == 0)
+        collect();
+    return classes[sizeClass]->allocate();
+}
+
+void BufferPool::release(void* object, size_t bytes) {
+    Returned* node = static_cast<Returned*>(object);
+    node->sizeClass = classFor(bytes);
+    node->next = __atomic_load_n(&returned, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&returned, &node->next, node, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+void BufferPool::collect() {
+    Returned* node = __atomic_exchange_n(&returned, static_cast<Returned*>(NULL), __ATOMIC_ACQUIRE);
+    while (node) {
+        Returned* next = node->next;
+        classes[node->sizeClass]->release(node);
+        node = next;
+    }
+}
+
+const PoolStats& BufferPool::getStats(size_t sizeClass) const { return classes[sizeClass]->getStats(); }
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include "Metrics.hpp"
+
+/* Objects handed out by one pool, kept with metricSet(): only the owner
+   writes them, an exporter may read them from any thread. */
+struct PoolStats {
+    unsigned long inUse;
+    unsigned long free;      /* carved from slabs and not in use */
+    unsigned long highWater; /* most objects in use at once */
+
+    PoolStats();
+    /* Adds a snapshot of `pool` to this one, which no other thread may see. */
+    void accumulate(const PoolStats& pool);
+};
+
+/* Fixed-size objects carved from slabs of `perSlab` at a time. A released
+   object goes on an intrusive free list and is the next one handed out, so
+   connect/disconnect churn reuses the same, still cached, memory instead of
+   going through malloc. Slabs are only given back when the pool is
+   destroyed: what a pool holds is its high-water mark. One owner thread;
+   nothing here is atomic except the statistics. */
+class FixedPool {
+public:
+    FixedPool(size_t objectSize, size_t perSlab);
+    ~FixedPool();
+
+    void* allocate();
+    void release(void* object);
+    size_t objectSize() const;
+    const PoolStats& getStats() const;
+
+private:
+    struct FreeObject {
+        FreeObject* next;
+    };
+    struct Slab {
+        Slab* next;
+    };
+
+    size_t size;
+    size_t perSlab;
+    Slab* slabs;
+    FreeObject* freeList;
+    PoolStats stats;
+
+    void grow();
+
+    FixedPool(const FixedPool&);
+    FixedPool& operator=(const FixedPool&);
+};
+
+/* Standard allocator over a FixedPool, for node containers such as std::map.
+   A request for one object that fits the pool's size comes from the pool;
+   anything else, or any request without a pool, goes to operator new. */
+template <class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    explicit PoolAllocator(FixedPool* p = NULL) : pool(p) {}
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.getPool()) {}
+
+    pointer address(reference value) const { return &value; }
+    const_pointer address(const_reference value) const { return &value; }
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+    void construct(pointer p, const T& value) { new (p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+
+    pointer allocate(size_type n, const void* = NULL) {
+        if (fits(n))
+            return static_cast<pointer>(pool->allocate());
+        return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type n) {
+        if (fits(n))
+            pool->release(p);
+        else
+            ::operator delete(p);
+    }
+
+    FixedPool* getPool() const { return pool; }
+    bool operator==(const PoolAllocator& other) const { return pool == other.pool; }
+    bool operator!=(const PoolAllocator& other) const { return pool != other.pool; }
+
+private:
+    FixedPool* pool;
+
+    bool fits(size_type n) const { return pool && n == 1 && sizeof(T) <= pool->objectSize(); }
+};
+
+/* Size classes of FixedPools for SharedBuffers rendered by one shard. Only
+   the owner allocates, but the last reference to a broadcast is often
+   dropped by another shard, so every release is pushed onto a lock-free
+   list (CAS on `returned`, as in Mailbox) and the owner takes the whole
+   list back in collect(): when a size class runs dry and once per tick.
+   Until then a returned buffer still counts as in use. Buffers above the
+   largest class are not pooled. */
+class BufferPool {
+public:
+    enum { CLASSES = 4 };
+    static const size_t CLASS_SIZE[CLASSES];
+
+    BufferPool();
+    ~BufferPool();
+
+    /* Owner thread; NULL when `bytes` is above the largest class. */
+    void* allocate(size_t bytes);
+    /* Any thread: `object` came from allocate(bytes) of this pool. */
+    void release(void* object, size_t bytes);
+    /* Owner thread: puts released buffers back in their classes. */
+    void collect();
+    const PoolStats& getStats(size_t sizeClass) const;
+
+private:
+    struct Returned {
+        Returned* next;
+        size_t sizeClass;
+    };
+
+    FixedPool* classes[CLASSES];
+    Returned* returned;
+
+    static size_t classFor(size_t bytes);
+
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+};
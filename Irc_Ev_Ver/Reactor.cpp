@@ -0,0 +1,171 @@
+#include "Reactor.hpp"
+#include "UringReactor.hpp"
+#include "Log.hpp"
+#include <cerrno>
+#include <unistd.h>
+
+Reactor* Reactor::create(const std::string& backend) {
+#ifdef IRC_HAVE_URING
+    if (backend == "uring") {
+        UringReactor* reactor = new UringReactor();
+        if (reactor->isValid())
+            return reactor;
+        delete reactor;
+        LOG_WARN("io_uring unavailable, falling back to epoll");
+    }
+#endif
+#ifdef __linux__
+    if (backend == "epoll" || backend == "uring") {
+        EpollReactor* reactor = new EpollReactor();
+        if (reactor->isValid())
+            return reactor;
+        delete reactor;
+        LOG_WARN("epoll unavailable, falling back to poll");
+    }
+#endif
+    if (backend != "poll" && backend != "epoll" && backend != "uring")
+        LOG_WARN("unknown reactor backend '" << backend << "', using poll");
+    return new PollReactor();
+}
+
+/* ---------------------------------------------------------------- poll */
+
+static short toPollEvents(unsigned interest) {
+    short events = 0;
+    if (interest & REACTOR_READ) events |= POLLIN;
+    if (interest & REACTOR_WRITE) events |= POLLOUT;
+    return events;
+}
+
+bool PollReactor::add(int fd, unsigned interest) {
+    if (fd < 0)
+        return false;
+    if (static_cast<size_t>(fd) >= slotOf.size())
+        slotOf.resize(fd + 1, -1);
+    if (slotOf[fd] != -1)
+        return modify(fd, interest);
+    pollfd p;
+    p.fd = fd;
+    p.events = toPollEvents(interest);
+    p.revents = 0;
+    slotOf[fd] = static_cast<int>(fds.size());
+    fds.push_back(p);
+    return true;
+}
+
+bool PollReactor::modify(int fd, unsigned interest) {
+    if (fd < 0 || static_cast<size_t>(fd) >= slotOf.size() || slotOf[fd] == -1)
+        return false;
+    fds[slotOf[fd]].events = toPollEvents(interest);
+    return true;
+}
+
+void PollReactor::remove(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= slotOf.size() || slotOf[fd] == -1)
+        return;
+    int slot = slotOf[fd];
+    int last = static_cast<int>(fds.size()) - 1;
+    if (slot != last) {
+        fds[slot] = fds[last];
+        slotOf[fds[slot].fd] = slot;
+    }
+    fds.pop_back();
+    slotOf[fd] = -1;
+}
+
+int PollReactor::wait(std::vector<ReactorEvent>& ready, int timeoutMs) {
+    ready.clear();
+    int ret = poll(fds.data(), fds.size(), timeoutMs);
+    if (ret <= 0)
+        return ret;
+    for (size_t i = 0; i < fds.size() && static_cast<int>(ready.size()) < ret; ++i) {
+        if (fds[i].revents == 0)
+            continue;
+        ReactorEvent ev;
+        ev.fd = fds[i].fd;
+        ev.events = 0;
+        ev.result = 0;
+        ev.data = NULL;
+        if (fds[i].revents & POLLIN) ev.events |= REACTOR_READ;
+        if (fds[i].revents & POLLOUT) ev.events |= REACTOR_WRITE;
+        if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) ev.events |= REACTOR_ERROR;
+        fds[i].revents = 0;
+        ready.push_back(ev);
+    }
+    return static_cast<int>(ready.size());
+}
+
+const char* PollReactor::name() const { return "poll"; }
+
+/* --------------------------------------------------------------- epoll */
+
+#ifdef __linux__
+
+static uint32_t toEpollEvents(unsigned interest) {
+    uint32_t events = 0;
+    if (interest & REACTOR_READ) events |= EPOLLIN;
+    if (interest & REACTOR_WRITE) events |= EPOLLOUT;
+    return events;
+}
+
+EpollReactor::EpollReactor() : epfd(epoll_create1(EPOLL_CLOEXEC)), registered(0) {}
+
+EpollReactor::~EpollReactor() {
+    if (epfd != -1)
+        close(epfd);
+}
+
+bool EpollReactor::isValid() const { return epfd != -1; }
+
+bool EpollReactor::add(int fd, unsigned interest) {
+    epoll_event ev;
+    ev.events = toEpollEvents(interest);
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return false;
+    ++registered;
+    return true;
+}
+
+bool EpollReactor::modify(int fd, unsigned interest) {
+    epoll_event ev;
+    ev.events = toEpollEvents(interest);
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EpollReactor::remove(int fd) {
+    /* Closing the fd drops it from the epoll set anyway; deregister explicitly
+       so the count stays right when the fd is still open. */
+    if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) == 0 && registered > 0)
+        --registered;
+}
+
+int EpollReactor::wait(std::vector<ReactorEvent>& ready, int timeoutMs) {
+    ready.clear();
+    size_t capacity = registered > 0 ? registered : 1;
+    if (capacity > 1024)
+        capacity = 1024;
+    if (events.size() < capacity)
+        events.resize(capacity);
+
+    int ret = epoll_wait(epfd, events.data(), static_cast<int>(capacity), timeoutMs);
+    if (ret <= 0)
+        return ret;
+    for (int i = 0; i < ret; ++i) {
+        ReactorEvent ev;
+        ev.fd = events[i].data.fd;
+        ev.events = 0;
+        ev.result = 0;
+        ev.data = NULL;
+        if (events[i].events & EPOLLIN) ev.events |= REACTOR_READ;
+        if (events[i].events & EPOLLOUT) ev.events |= REACTOR_WRITE;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) ev.events |= REACTOR_ERROR;
+        ready.push_back(ev);
+    }
+    return ret;
+}
+
+const char* EpollReactor::name() const { return "epoll"; }
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/uio.h>
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+
+/* Interest / readiness flags shared by every backend. */
+enum {
+    REACTOR_READ  = 1 << 0,
+    REACTOR_WRITE = 1 << 1,
+    REACTOR_ERROR = 1 << 2, /* hangup or socket error, the owner should read() to find out */
+    /* Completion backends do the I/O themselves and report its outcome: */
+    REACTOR_ACCEPT = 1 << 3, /* `result` is the accepted socket; with REACTOR_ERROR it is
+                                -EMFILE/-ENFILE and the owner should shed the queue */
+    REACTOR_DATA   = 1 << 4, /* `result` bytes at `data` were received, 0 means EOF */
+    REACTOR_SENT   = 1 << 5  /* a send() finished, `result` bytes went out */
+};
+
+class SendQueue;
+
+struct ReactorEvent {
+    int fd;
+    unsigned events;
+    int result;
+    const char* data;
+};
+
+/* A Reactor watches a set of descriptors and reports the ready ones.
+   `wait()` only returns descriptors that actually have events, so the caller
+   does O(ready) work per tick regardless of the backend. */
+class Reactor {
+public:
+    virtual ~Reactor() {}
+    virtual bool add(int fd, unsigned interest) = 0;
+    virtual bool modify(int fd, unsigned interest) = 0;
+    virtual void remove(int fd) = 0;
+    /* Fills `ready` and returns the number of ready descriptors, 0 on timeout, -1 on error (errno set). */
+    virtual int wait(std::vector<ReactorEvent>& ready, int timeoutMs) = 0;
+    virtual const char* name() const = 0;
+
+    /* Listening and client sockets; readiness backends simply watch them for reading. */
+    virtual bool addListener(int fd) { return add(fd, REACTOR_READ); }
+    virtual bool addConnection(int fd) { return add(fd, REACTOR_READ); }
+    /* True when the backend accepts, receives and sends by itself (see REACTOR_ACCEPT/DATA/SENT). */
+    virtual bool completesIo() const { return false; }
+    /* Completion backends only: sends from `queue` in place, one send in flight per fd.
+       Until REACTOR_SENT the owner may append to `queue` but not consume it;
+       remove() takes over what is still queued, so the queue may go right after. */
+    virtual bool send(int fd, SendQueue& queue) { (void)fd; (void)queue; return false; }
+
+    /* "uring", "epoll" or "poll"; falls back to the next one if the requested backend is unavailable. */
+    static Reactor* create(const std::string& backend);
+};
+
+/* Portable backend around poll(). The kernel still scans every registered fd
+   per call, so this is meant for small deployments. Slots are indexed by fd,
+   so modify/remove are O(1) and removal swaps the last slot into the hole. */
+class PollReactor : public Reactor {
+public:
+    bool add(int fd, unsigned interest);
+    bool modify(int fd, unsigned interest);
+    void remove(int fd);
+    int wait(std::vector<ReactorEvent>& ready, int timeoutMs);
+    const char* name() const;
+
+private:
+    std::vector<pollfd> fds;
+    std::vector<int> slotOf; /* fd -> index in fds, -1 when not registered */
+};
+
+#ifdef __linux__
+/* Linux backend around epoll: registration is kept in the kernel and
+   epoll_wait() hands back only the ready descriptors. */
+class EpollReactor : public Reactor {
+public:
+    EpollReactor();
+    ~EpollReactor();
+    bool isValid() const;
+    bool add(int fd, unsigned interest);
+    bool modify(int fd, unsigned interest);
+    void remove(int fd);
+    int wait(std::vector<ReactorEvent>& ready, int timeoutMs);
+    const char* name() const;
+
+private:
+    int epfd;
+    size_t registered;
+    std::vector<epoll_event> events;
+
+    EpollReactor(const EpollReactor&);
+    EpollReactor& operator=(const EpollReactor&);
+};
+#endif
@@ -0,0 +1,125 @@
+#include "Reply.hpp"
+#include "Client.hpp"
+#include <cstring>
+
+namespace {
+
+struct ReplyInfo {
+    const char* code;
+    const char* text; /* NULL: no trailing part by default */
+};
+
+/* Indexed by ReplyId, keep the two in the same order. */
+const ReplyInfo replies[REPLY_COUNT] = {
+    { "001", "Welcome to the IRC server" },
+    { "212", NULL },
+    { "219", "End of /STATS report" },
+    { "249", NULL },
+    { "311", NULL },
+    { "318", "End of /WHOIS list" },
+    { "331", "No topic is set" },
+    { "332", NULL },
+    { "341", NULL },
+    { "381", "You are now an IRC operator" },
+    { "401", "No such nick/channel" },
+    { "403", "No such channel" },
+    { "404", "Cannot send to channel" },
+    { "421", "Unknown command" },
+    { "431", "No nickname given" },
+    { "433", "Nickname is already in use" },
+    { "441", "They aren't on that channel" },
+    { "442", "You're not on that channel" },
+    { "461", "Not enough parameters" },
+    { "464", "Password incorrect" },
+    { "471", "Cannot join channel (+l)" },
+    { "472", "Unknown mode character" },
+    { "473", "Cannot join channel (+i)" },
+    { "475", "Cannot join channel (+k)" },
+    { "481", "Permission Denied- You're not an IRC operator" },
+    { "482", "You're not channel operator" },
+    { "491", "No O-lines for your host" }
+};
+
+const char SERVER_PREFIX[] = ":server@localhost ";
+
+LineView makeView(const char* data, size_t length) {
+    LineView view;
+    view.data = data;
+    view.length = length;
+    return view;
+}
+
+/* Appends as much of `data` as fits before the CR LF reserved at the end. */
+void put(char* line, size_t& length, const char* data, size_t size) {
+    size_t room = LineFramer::MAX_LINE - 2 - length;
+    if (size > room)
+        size = room;
+    memcpy(line + length, data, size);
+    length += size;
+}
+
+}
+
+Reply::Reply(Client& c, ReplyId replyId)
+    : client(c), id(replyId), paramCount(0) {
+    const std::string& nick = c.getNickname();
+    target = makeView(nick.data(), nick.size());
+}
+
+Reply::Reply(Client& c, ReplyId replyId, const std::string& to)
+    : client(c), id(replyId), paramCount(0) {
+    target = makeView(to.data(), to.size());
+}
+
+Reply::Reply(Client& c, ReplyId replyId, const char* to)
+    : client(c), id(replyId), paramCount(0) {
+    target = makeView(to, strlen(to));
+}
+
+Reply& Reply::param(const std::string& value) {
+    return param(value.data(), value.size());
+}
+
+Reply& Reply::param(const char* value) {
+    return param(value, strlen(value));
+}
+
+Reply& Reply::param(const char* data, size_t length) {
+    if (paramCount < MAX_PARAMS)
+        params[paramCount++] = makeView(data, length);
+    return *this;
+}
+
+void Reply::send() {
+    const char* text = replies[id].text;
+    write(text, text ? strlen(text) : 0);
+}
+
+void Reply::send(const std::string& text) {
+    write(text.data(), text.size());
+}
+
+void Reply::send(const char* text) {
+    write(text, strlen(text));
+}
+
+/* `text` NULL leaves the trailing part out. */
+void Reply::write(const char* text, size_t textLength) {
+    char line[LineFramer::MAX_LINE];
+    size_t length = 0;
+    put(line, length, SERVER_PREFIX, sizeof(SERVER_PREFIX) - 1);
+    put(line, length, replies[id].code, 3);
+    put(line, length, " ", 1);
+    put(line, length, target.data, target.length);
+    for (size_t i = 0; i < paramCount; ++i) {
+        put(line, length, " ", 1);
+        put(line, length, params[i].data, params[i].length);
+    }
+    if (text) {
+        put(line, length, " :", 2);
+        put(line, length, text, textLength);
+    }
+    line[length++] = '\r';
+    line[length++] = '\n';
+    client.appendOutputBuffer(line, length);
+}
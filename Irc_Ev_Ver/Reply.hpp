@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "LineFramer.hpp"
+
+class Client;
+
+/* Numeric replies the server sends. Each one has an entry in the table in
+   Reply.cpp holding its three-digit code and its usual text. */
+enum ReplyId {
+    RPL_WELCOME,
+    RPL_STATSCOMMANDS,
+    RPL_ENDOFSTATS,
+    RPL_STATSDEBUG,
+    RPL_WHOISUSER,
+    RPL_ENDOFWHOIS,
+    RPL_NOTOPIC,
+    RPL_TOPIC,
+    RPL_INVITING,
+    RPL_YOUREOPER,
+    ERR_NOSUCHNICK,
+    ERR_NOSUCHCHANNEL,
+    ERR_CANNOTSENDTOCHAN,
+    ERR_UNKNOWNCOMMAND,
+    ERR_NONICKNAMEGIVEN,
+    ERR_NICKNAMEINUSE,
+    ERR_USERNOTINCHANNEL,
+    ERR_NOTONCHANNEL,
+    ERR_NEEDMOREPARAMS,
+    ERR_PASSWDMISMATCH,
+    ERR_CHANNELISFULL,
+    ERR_UNKNOWNMODE,
+    ERR_INVITEONLYCHAN,
+    ERR_BADCHANNELKEY,
+    ERR_NOPRIVILEGES,
+    ERR_CHANOPRIVSNEEDED,
+    ERR_NOOPERHOST,
+    REPLY_COUNT
+};
+
+/* Formats one numeric reply straight into a client's send queue:
+       :server@localhost <code> <target> [<param> ...] [:<text>]\r\n
+   The target defaults to the client's nickname. Params are only pointed
+   at until send(), which assembles the line in a stack buffer and appends
+   it to the queue in one go, so no std::string is built along the way.
+   The table text is used unless send() is given one; replies without a
+   table text (RPL_INVITING) end after the params.
+
+       Reply(client, ERR_NOSUCHCHANNEL).param(channelName).send();
+
+   Every argument must outlive the send() call. A line longer than the
+   RFC 1459 limit is cut, keeping its CR LF. */
+class Reply {
+public:
+    enum { MAX_PARAMS = 5 };
+
+    Reply(Client& client, ReplyId id);
+    Reply(Client& client, ReplyId id, const std::string& target);
+    Reply(Client& client, ReplyId id, const char* target);
+
+    Reply& param(const std::string& value);
+    Reply& param(const char* value);
+    Reply& param(const char* data, size_t length);
+    void send();
+    void send(const std::string& text);
+    void send(const char* text);
+
+private:
+    Client& client;
+    ReplyId id;
+    LineView target;
+    LineView params[MAX_PARAMS];
+    size_t paramCount;
+
+    void write(const char* text, size_t length);
+};
@@ -0,0 +1,213 @@
+#include "SendQueue.hpp"
+#include <cstring>
+#include <new>
+
+SendQueue::SendQueue()
+    : head(NULL), tail(NULL), bytes(0), limit(0), overflow(false), account(NULL), chunkPool(NULL), segmentPool(NULL) {}
+
+SendQueue::SendQueue(const SendQueue& other)
+    : head(NULL), tail(NULL), bytes(0), limit(0), overflow(false), account(NULL), chunkPool(NULL), segmentPool(NULL) {
+    copyFrom(other);
+}
+
+SendQueue& SendQueue::operator=(const SendQueue& other) {
+    if (this != &other) {
+        clear();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+SendQueue::~SendQueue() { clear(); }
+
+/* Chunks are owned, so a copy gets its own. Clients are only copied while
+   being inserted into a map, when the queue is still empty. */
+void SendQueue::copyFrom(const SendQueue& other) {
+    chunkPool = other.chunkPool;
+    segmentPool = other.segmentPool;
+    for (const Segment* it = other.head; it; it = it->next) {
+        Chunk* chunk = NULL;
+        if (it->chunk) {
+            chunk = chunkPool ? static_cast<Chunk*>(chunkPool->allocate()) : new Chunk;
+            memcpy(chunk->data + it->begin, it->chunk->data + it->begin, it->end - it->begin);
+        }
+        push(chunk, it->shared, it->begin, it->end);
+    }
+    limit = other.limit;
+    overflow = other.overflow;
+    account = other.account;
+    charge(other.bytes);
+}
+
+/* Appends a segment, taking ownership of `chunk`. */
+SendQueue::Segment* SendQueue::push(Chunk* chunk, const BufferRef& shared, size_t begin, size_t end) {
+    Segment* segment = segmentPool ? new (segmentPool->allocate()) Segment : new Segment;
+    segment->next = NULL;
+    segment->chunk = chunk;
+    segment->shared = shared;
+    segment->begin = begin;
+    segment->end = end;
+    if (tail)
+        tail->next = segment;
+    else
+        head = segment;
+    tail = segment;
+    return segment;
+}
+
+void SendQueue::pop() {
+    Segment* segment = head;
+    head = segment->next;
+    if (!head)
+        tail = NULL;
+    if (segment->chunk) {
+        if (chunkPool)
+            chunkPool->release(segment->chunk);
+        else
+            delete segment->chunk;
+    }
+    if (segmentPool) {
+        segment->~Segment();
+        segmentPool->release(segment);
+    } else {
+        delete segment;
+    }
+}
+
+bool SendQueue::append(const char* data, size_t length) {
+    if (!admit(length))
+        return false;
+    charge(length);
+    if (account)
+        metricAdd(account->lines, 1);
+    while (length > 0) {
+        if (!tail || !tail->chunk || tail->end == CHUNK_SIZE)
+            push(chunkPool ? static_cast<Chunk*>(chunkPool->allocate()) : new Chunk, BufferRef(), 0, 0);
+        size_t room = CHUNK_SIZE - tail->end;
+        size_t n = length < room ? length : room;
+        memcpy(tail->chunk->data + tail->end, data, n);
+        tail->end += n;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool SendQueue::append(const BufferRef& data) {
+    if (data.empty())
+        return true;
+    if (!admit(data.size()))
+        return false;
+    push(NULL, data, 0, data.size());
+    charge(data.size());
+    if (account)
+        metricAdd(account->lines, 1);
+    return true;
+}
+
+int SendQueue::fillIov(struct iovec* iov, int maxIov) const {
+    int count = 0;
+    for (const Segment* it = head; it && count < maxIov; it = it->next) {
+        iov[count].iov_base = const_cast<char*>(it->base() + it->begin);
+        iov[count].iov_len = it->end - it->begin;
+        ++count;
+    }
+    return count;
+}
+
+void SendQueue::consume(size_t sent) {
+    if (sent > bytes)
+        sent = bytes;
+    refund(sent);
+    while (sent > 0) {
+        size_t left = head->end - head->begin;
+        if (sent < left) {
+            head->begin += sent;
+            return;
+        }
+        sent -= left;
+        pop();
+    }
+}
+
+void SendQueue::clear() {
+    while (head)
+        pop();
+    refund(bytes);
+}
+
+void SendQueue::dropUnsent() {
+    Segment* keep = head && head->begin > 0 ? head : NULL;
+    if (keep)
+        head = keep->next;
+    while (head)
+        pop();
+    if (keep) {
+        keep->next = NULL;
+        head = keep;
+        tail = keep;
+    }
+    refund(bytes - (keep ? keep->end - keep->begin : 0));
+    overflow = false;
+}
+
+void SendQueue::moveTo(SendQueue& other) {
+    other.clear();
+    other.chunkPool = chunkPool;
+    other.segmentPool = segmentPool;
+    other.head = head;
+    other.tail = tail;
+    other.charge(bytes);
+    head = NULL;
+    tail = NULL;
+    refund(bytes);
+}
+
+size_t SendQueue::size() const { return bytes; }
+
+bool SendQueue::empty() const { return bytes == 0; }
+
+void SendQueue::setLimit(size_t maxBytes) { limit = maxBytes; }
+
+bool SendQueue::overflowed() const { return overflow; }
+
+void SendQueue::setAccount(QueueAccount* counter) {
+    size_t queued = bytes;
+    refund(queued);
+    account = counter;
+    charge(queued);
+}
+
+void SendQueue::setPools(FixedPool* chunks, FixedPool* segments) {
+    chunkPool = chunks;
+    segmentPool = segments;
+}
+
+size_t SendQueue::segmentSize() { return sizeof(Segment); }
+
+/* Once over the limit nothing more is queued: the client is on its way out. */
+bool SendQueue::admit(size_t length) {
+    if (overflow)
+        return false;
+    if (limit > 0 && length > limit - (bytes < limit ? bytes : limit)) {
+        overflow = true;
+        return false;
+    }
+    return true;
+}
+
+/* Only the owning thread writes the account; other threads just read it. */
+void SendQueue::charge(size_t length) {
+    bytes += length;
+    if (!account)
+        return;
+    metricAdd(account->bytes, length);
+    if (bytes > metricRead(account->peak))
+        metricSet(account->peak, bytes);
+}
+
+void SendQueue::refund(size_t length) {
+    bytes -= length;
+    if (account)
+        metricSub(account->bytes, length);
+}
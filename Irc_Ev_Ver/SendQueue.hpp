@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/uio.h>
+#include "SharedBuffer.hpp"
+#include "Metrics.hpp"
+#include "Pool.hpp"
+
+/* A client's pending output as a list of segments, flushed with one
+   sendmsg()/writev() per batch:
+   - private replies are packed into fixed-size chunks owned by the queue,
+     so small lines do not cost an allocation each;
+   - broadcast lines are shared BufferRefs and are never copied.
+   A partial send only moves the front segment's offset; nothing is memmoved.
+   Segments form a singly linked list, so an empty queue owns no memory at
+   all; with pools set, segments and chunks come from the owning shard's
+   FixedPools instead of the heap.
+   With a limit set, an append that would take size() past it is refused
+   and the queue stays overflowed; the owner is expected to disconnect the
+   client. Queued bytes and lines are also added to an optional shared
+   account, which only the owning shard's thread may update. */
+class SendQueue {
+public:
+    enum { CHUNK_SIZE = 4096 };
+
+    SendQueue();
+    SendQueue(const SendQueue& other);
+    SendQueue& operator=(const SendQueue& other);
+    ~SendQueue();
+
+    /* False, appending nothing, when it would go past the limit. */
+    bool append(const char* data, size_t length);
+    bool append(const BufferRef& data);
+    /* Points `iov` at up to `maxIov` pending segments, returns how many. */
+    int fillIov(struct iovec* iov, int maxIov) const;
+    /* Drops `bytes` from the front after a (partial) send. */
+    void consume(size_t bytes);
+    void clear();
+    /* Keeps only a front segment that is partly sent and forgets an overflow,
+       so a last line can follow whole lines before the connection closes. */
+    void dropUnsent();
+    /* Moves every segment to `other`, emptied first, along with the pools.
+       Nothing is copied and the bytes stay where they are, so iovecs filled
+       from this queue still point at them. */
+    void moveTo(SendQueue& other);
+    size_t size() const;
+    bool empty() const;
+    /* 0 means unlimited. */
+    void setLimit(size_t bytes);
+    bool overflowed() const;
+    /* Keeps `*counter` up to date with size() and appends, see Shard::getMetrics(). */
+    void setAccount(QueueAccount* counter);
+    /* While empty: where chunks and segments come from from now on, NULL for the heap. */
+    void setPools(FixedPool* chunks, FixedPool* segments);
+    /* What a segment pool's objects must hold; chunk pools hold CHUNK_SIZE. */
+    static size_t segmentSize();
+
+private:
+    struct Chunk {
+        char data[CHUNK_SIZE];
+    };
+    struct Segment {
+        Segment* next;
+        Chunk* chunk;     /* owned chunk, or NULL for a shared buffer */
+        BufferRef shared;
+        size_t begin;     /* first unsent byte */
+        size_t end;       /* one past the last queued byte */
+        const char* base() const { return chunk ? chunk->data : shared.data(); }
+    };
+
+    Segment* head;
+    Segment* tail;
+    size_t bytes;
+    size_t limit;
+    bool overflow;
+    QueueAccount* account;
+    FixedPool* chunkPool;
+    FixedPool* segmentPool;
+
+    void copyFrom(const SendQueue& other);
+    Segment* push(Chunk* chunk, const BufferRef& shared, size_t begin, size_t end);
+    void pop();
+    bool admit(size_t length);
+    void charge(size_t length);
+    void refund(size_t length);
+};
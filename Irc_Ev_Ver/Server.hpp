@@ -3,13 +3,27 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include "Config.hpp"
 #include "Client.hpp"
-#include "Channel.hpp"
+#include "ChannelDirectory.hpp"
+#include "NickRegistry.hpp"
+#include "MetricsExporter.hpp"
+#include "Locks.hpp"
 
 class CommandHandler;
+class Shard;
 
+/* Server owns what every shard shares: the configuration, the directory of
+   all connected clients and the channels. Each Shard runs its own event loop
+   on its own thread and owns the sockets and buffers of its clients.
+   The shared state has two read-write locks, so commands on different
+   shards only wait for each other when one of them changes what the other
+   reads. PRIVMSG, WHOIS, MODE and TOPIC take both shared; JOIN, KICK,
+   INVITE and a disconnect take channelsLock exclusively, NICK, USER, a
+   connect and a disconnect take clientsLock exclusively. Locks are taken
+   in this order: channelsLock, clientsLock, then a Channel's own lock. */
 class Server {
 public:
     Server(const Config& cfg);
@@ -18,22 +32,37 @@ public:
     void run();
 
 private:
-    int m_serverSocket;
     Config config;
-    std::map<int, Client> m_clients;
-    std::vector<Channel> channels;
-    CommandHandler* cmdHandler;
+    std::vector<Shard*> shards;
+    std::map<int, Client*> m_clients; /* every client on every shard, guarded by clientsLock */
+    ChannelDirectory channels;        /* shared channel directory, guarded by channelsLock */
+    NickRegistry nicks;               /* casefolded nick -> socket, guarded by clientsLock */
+    pthread_rwlock_t channelsLock;    /* the channels, their members and invites; modes see Channel::getLock() */
+    pthread_rwlock_t clientsLock;     /* m_clients, nicks and the nick, user and real name of every client */
+    unsigned long nextClientId;       /* atomic, shards accept concurrently */
+    size_t maxFds;                    /* sysconf(_SC_OPEN_MAX), read once by initialize() */
+    int signalFd;                     /* SIGINT/SIGTERM/SIGHUP, watched by shard 0; -1 when handlers are used */
+    MetricsExporter exporter;         /* runs when admin_socket is set */
 
-    static bool shouldStop;
+    static volatile sig_atomic_t shouldStop;
     static void signalHandler(int sig);
+    static bool isStopping();
+    static void requestStop();
+    static void* shardMain(void* arg);
 
-    bool setupSocket();
-    void handleNewConnection(std::vector<pollfd>& fds);
-    void handleClientData(int clientSocket, std::vector<pollfd>& fds);
+    bool setupSignals();
+    void handleSignals();
+    void stop(); /* requestStop() and wake every shard */
+
+    unsigned long queuedBytes() const; /* send queues of every client on every shard, any thread */
+    Client* findClient(int clientSocket);
+    Client* findClientByNick(const std::string& nick);
     void removeClientFromChannels(int clientSocket);
-    void removeClient(int clientSocket, std::vector<pollfd>& fds);
     void shutdown();
 
     friend class CommandHandler;
+    friend class Shard;
+    friend class EventRouter;
+    friend class MetricsExporter;
+    friend class HandlerBench; /* builds a Server without sockets, see handlerbench.cpp */
 };
-
@@ -0,0 +1,967 @@
+#include "Shard.hpp"
+#include "Server.hpp"
+#include "CommandHandler.hpp"
+#include "Log.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+#include <fcntl.h>
+#include <cerrno>
+#include <utility>
+#include <sstream>
+#include <climits>
+
+static const size_t READ_CHUNK = 8192;
+/* Узел `clients`: клиент и заголовок красно-чёрного дерева std::map (цвет и три указателя). */
+static const size_t CLIENT_NODE_SIZE = sizeof(std::pair<const int, Client>) + 4 * sizeof(void*);
+
+#ifdef IOV_MAX
+static const int SEND_IOV_MAX = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+static const int SEND_IOV_MAX = 16;
+#endif
+
+Shard::Shard(Server& s, size_t idx)
+    : server(s), index(idx), m_serverSocket(-1), spareFd(-1), reactor(NULL), cmdHandler(NULL),
+      clientPool(CLIENT_NODE_SIZE, 64), segmentPool(SendQueue::segmentSize(), 256), chunkPool(SendQueue::CHUNK_SIZE, 16),
+      clients(std::less<int>(), PoolAllocator<std::pair<const int, Client> >(&clientPool)), tick(0) {
+    cmdHandler = new CommandHandler(server, *this);
+}
+
+Shard::~Shard() {
+    delete cmdHandler;
+    delete reactor;
+    if (m_serverSocket != -1) {
+        close(m_serverSocket);
+    }
+    if (spareFd != -1) {
+        close(spareFd);
+    }
+}
+
+size_t Shard::getIndex() const { return index; }
+
+pthread_t& Shard::getThread() { return thread; }
+
+bool Shard::initialize() {
+    reactor = Reactor::create(server.config.getReactorBackend());
+    if (index == 0) {
+        LOG_INFO("Event loop backend: " << reactor->name() << ", shards: " << server.config.getThreads());
+    }
+    if (!mailbox.isValid()) {
+        LOG_ERROR("unable to create shard mailbox, reason: " << strerror(errno));
+        return false;
+    }
+    if (!setupSocket()) {
+        return false;
+    }
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (!reactor->addListener(m_serverSocket) || !reactor->add(mailbox.fd(), REACTOR_READ)) {
+        LOG_ERROR("unable to register server socket, reason: " << strerror(errno));
+        return false;
+    }
+    if (index == 0 && server.signalFd != -1 && !reactor->add(server.signalFd, REACTOR_READ)) {
+        LOG_ERROR("unable to register signalfd, reason: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* Функция `run()` крутит цикл событий шарда: новые соединения, данные клиентов,
+   письма от других шардов, сигналы (нулевой шард) и таймеры клиентов.
+   Спит ровно до ближайшего таймера, а без таймеров — пока что-нибудь не придёт;
+   не спит вовсе, пока у кого-то остались строки сверх бюджета тика (`carried`).
+   Выходит, когда сервер получил сигнал остановки. */
+void Shard::run() {
+    std::vector<ReactorEvent> ready;
+
+    while (!Server::isStopping()) {
+        int timeout = carried.empty() ? timers.timeoutMs() : 0;
+        if (server.signalFd == -1 && (timeout < 0 || timeout > 50)) {
+            timeout = 50; // Без signalfd флаг остановки приходится проверять самим
+        }
+        int ret = reactor->wait(ready, timeout); /* отдаёт только готовые дескрипторы */
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR(reactor->name() << " wait failed with errno " << errno);
+            server.stop();
+            return;
+        }
+        unsigned long started = monotonicNanos(); // Время итерации без сна в wait()
+        timers.advance();
+        ++tick;
+        // Кому не хватило бюджета в прошлом тике — по очереди, с новым бюджетом. До событий:
+        // кто упрётся в бюджет на этих событиях, встанет в `carried` уже до следующего тика
+        resumeCarried();
+
+        for (int i = 0; i < ret; ++i) {
+            int fd = ready[i].fd;
+            unsigned events = ready[i].events;
+            if (events & REACTOR_ACCEPT) {
+                if (events & REACTOR_ERROR) {
+                    handleNewConnection(); // io_uring упёрся в EMFILE: очередь сбрасываем сами, через запасной дескриптор
+                } else {
+                    acceptClient(ready[i].result, NULL); // io_uring уже принял соединение сам
+                }
+                continue;
+            }
+            if (fd == m_serverSocket) {
+                handleNewConnection();
+                continue;
+            }
+            if (fd == mailbox.fd()) {
+                drainMailbox();
+                continue;
+            }
+            if (fd == server.signalFd) {
+                server.handleSignals();
+                continue;
+            }
+            if (events & REACTOR_SENT) {
+                handleClientSent(fd, events, ready[i].result);
+                continue;
+            }
+            if (events & REACTOR_DATA) {
+                if (ready[i].result > 0 && !(events & REACTOR_ERROR)) {
+                    processInput(fd, ready[i].data, ready[i].result);
+                } else if (clients.find(fd) != clients.end()) {
+                    LOG_INFO("Client disconnected or error occurred.");
+                    removeClient(fd);
+                }
+                continue;
+            }
+            if (events & (REACTOR_READ | REACTOR_ERROR)) {
+                handleClientData(fd, (events & REACTOR_ERROR) != 0); // Обрабатываем команды, включая QUIT
+            }
+            if ((ready[i].events & REACTOR_WRITE) && clients.find(fd) != clients.end()) {
+                handleClientWrite(fd);
+            }
+        }
+        expireTimers(); // После событий: PONG из этого же тика ещё успевает засчитаться
+        flushDirtyClients(); // Пишем сразу; POLLOUT включаем только тем, чей сокет полон
+        bufferPool.collect(); // Буферы, отпущенные за тик (в том числе другими шардами), снова в пуле
+        mailPool.collect(); // И письма, которые другие шарды уже разобрали
+        metrics.recordLoop(monotonicNanos() - started);
+    }
+}
+
+/* Функция `setupSocket()` настраивает серверный сокет для работы. */
+
+bool Shard::setupSocket() {
+    m_serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    /* AF_INET (IPv4) если есть Wi-Fi (192.168.1.1) и localhost (127.0.0.1) [или AF_INET6 (IPv6)], сервер будет слушать оба, SOCK_STREAM Transmission Control Protocol — протокол управления передачей) */
+    if (m_serverSocket < 0) {
+        LOG_ERROR("Unable to create socket");
+        return false;
+    }
+
+    if (fcntl(m_serverSocket, F_SETFL, O_NONBLOCK) < 0) /* Неблокирующий режим: F_SETFL поменять настройки, O_NONBLOCK собственно настройка -1/0 */
+    {
+        LOG_ERROR("fcntl failed to set non-blocking mode for server socket");
+        return false;
+    }
+
+    int opt = 1; /* включить SO_REUSEADDR повторно использовать порт, что не работало у чуваков на видео */
+    if (setsockopt(m_serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) /* Socket Option Level */
+    {
+        LOG_ERROR("setsockopt failed");
+        return false;
+    }
+
+#ifdef SO_REUSEPORT
+    /* Несколько шардов слушают один порт, ядро само раскидывает соединения между ними */
+    if (server.config.getThreads() > 1 && setsockopt(m_serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        LOG_ERROR("setsockopt SO_REUSEPORT failed, reason: " << strerror(errno));
+        return false;
+    }
+#endif
+
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET; /* AF_INET интернет-адреса IPv4 */
+    serverAddr.sin_addr.s_addr = INADDR_ANY; /* любой IP-адрес с компа */
+    serverAddr.sin_port = htons(server.config.getPort()); /* host to network short переводит в спец интернет-формат */
+
+    if (bind(m_serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) /* привязка сокета к порту и адресу */
+    {
+        LOG_ERROR("bind failed, reason: " << strerror(errno));
+        return false;
+    }
+
+    if (listen(m_serverSocket, server.config.getListenBacklog()) < 0) {
+        LOG_ERROR("listen failed, reason: " << strerror(errno));
+        return false;
+    }
+
+    if (index == 0) {
+        LOG_INFO("Server is listening on port " << server.config.getPort());
+    }
+    return true;
+}
+
+/* Функция `handleNewConnection()` разбирает очередь входящих соединений и передаёт
+   каждое в `acceptClient()`.  
+   - За одно пробуждение принимает до `listen_backlog` соединений, то есть целую
+     очередь: после обрыва сети тысячи клиентов приходят разом, и по одному
+     `accept()` на событие очередь переполняется, а ядро отбрасывает SYN.  
+   - Больше за раз не берёт, чтобы не держать остальных клиентов шарда; реактор
+     level-triggered, так что остаток придёт следующим событием.  
+   - При `EMFILE`/`ENFILE` соединения сбрасываются (`shedConnection()`), иначе
+     сокет так и остался бы готовым к чтению и цикл крутился бы вхолостую.
+     io_uring принимает сам и о нехватке дескрипторов сообщает `REACTOR_ACCEPT | REACTOR_ERROR`:
+     тогда очередь разбираем здесь же, а accept он включает обратно с паузой. */
+
+void Shard::handleNewConnection() {
+    int budget = server.config.getListenBacklog();
+    int shed = 0;
+    while (budget-- > 0) {
+        struct sockaddr_in clientAddr;
+        int clientSocket = acceptOne(&clientAddr);
+        if (clientSocket >= 0) {
+            acceptClient(clientSocket, &clientAddr);
+            continue;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        if ((errno == EMFILE || errno == ENFILE) && shedConnection()) {
+            ++shed;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EMFILE && errno != ENFILE) {
+            LOG_ERROR("Failed to accept client connection, reason: " << strerror(errno));
+        }
+        break;
+    }
+    if (shed > 0) {
+        LOG_ERROR("Out of file descriptors, dropped " << shed << " new connections");
+    }
+}
+
+/* Сокет приходит уже неблокирующим и с `FD_CLOEXEC`: `accept4()` делает это без лишних `fcntl()`. */
+
+int Shard::acceptOne(struct sockaddr_in* clientAddr) {
+    socklen_t clientLen = sizeof(*clientAddr);
+#ifdef SOCK_NONBLOCK
+    return accept4(m_serverSocket, (struct sockaddr *)clientAddr, &clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int clientSocket = accept(m_serverSocket, (struct sockaddr *)clientAddr, &clientLen);
+    if (clientSocket >= 0 && fcntl(clientSocket, F_SETFL, O_NONBLOCK) < 0) {
+        close(clientSocket);
+        return -1;
+    }
+    return clientSocket;
+#endif
+}
+
+/* Функция `shedConnection()` освобождает запасной дескриптор, принимает на его место
+   соединение и сразу закрывает: клиент получает отказ, а не висит в очереди.
+   `EMFILE` бывает и при пустой очереди (дескриптор выделяется раньше), тогда
+   возвращает false. */
+
+bool Shard::shedConnection() {
+    if (spareFd != -1) {
+        close(spareFd);
+    }
+    int clientSocket = accept(m_serverSocket, NULL, NULL);
+    if (clientSocket >= 0) {
+        close(clientSocket);
+    }
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return clientSocket >= 0;
+}
+
+/* Функция `acceptClient()` заводит клиента для уже принятого сокета.  
+1. **Проверяет лимит** файловых дескрипторов.  
+2. Сокет уже неблокирующий: `accept4()` или io_uring приняли его с `SOCK_NONBLOCK`.  
+3. **Создаёт объект клиента** в списке шарда (`clients`) и регистрирует его в общем каталоге (`m_clients`) под `clientsLock`.  
+4. **Отправляет приглашение ввести пароль**.  
+5. **Регистрирует сокет клиента** в реакторе только на чтение: интерес к записи включается, когда появятся данные.  
+6. Выводит сообщение о новом подключении.  
+7. В случае ошибки закрывает сокет и завершает работу.  
+   Лимит приблизительный: соседние шарды принимают одновременно, точный предел держит ядро (`EMFILE`). */
+
+void Shard::acceptClient(int clientSocket, const struct sockaddr_in* clientAddr) {
+    size_t connected;
+    {
+        ReadGuard guard(server.clientsLock);
+        connected = server.m_clients.size();
+    }
+    // Учитываем серверные сокеты шардов и минимум 3 стандартных дескриптора (stdin, stdout, stderr)
+    if (connected + server.shards.size() >= server.maxFds - 4) {
+        LOG_ERROR("Maximum number of file descriptors reached (" << server.maxFds << ")");
+        LOG_ERROR("Rejecting new connection " << describePeer(clientSocket, clientAddr));
+        close(clientSocket);
+        return;
+    }
+
+    int on = 1; // Строки тика и так склеиваются в один sendmsg(), Nagle только задержал бы ответ
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (!reactor->addConnection(clientSocket)) {
+        LOG_ERROR("unable to watch client socket, reason: " << strerror(errno));
+        close(clientSocket);
+        return;
+    }
+    unsigned long id = __atomic_fetch_add(&server.nextClientId, 1, __ATOMIC_RELAXED);
+    Client& client = clients.insert(std::make_pair(clientSocket, Client(clientSocket, id, index))).first->second;
+    {
+        WriteGuard guard(server.clientsLock);
+        server.m_clients[clientSocket] = &client;
+    }
+    client.touch(timers.now());
+    client.setLastCommand(timers.now());
+    client.getFloodBucket().reset(timers.now(), server.config.getFloodBurst());
+    client.setSendQueue(server.config.getSendQueueLimit(), &metrics.queues);
+    client.setQueuePools(&chunkPool, &segmentPool);
+    metricAdd(metrics.accepted, 1);
+    timers.arm(client.getTimer(), server.config.getRegistrationTimeout() * 1000UL);
+    // Client newClient(clientSocket);
+    // newClient.appendOutputBuffer("Enter password: ");
+    // m_clients.insert(std::pair<int, Client>(clientSocket, newClient));
+
+    LOG_INFO("New client connected: " << describePeer(clientSocket, clientAddr));
+}
+
+/* Адрес клиента для логов; если его нет под рукой (io_uring принял сам), спрашиваем у сокета. */
+
+std::string Shard::describePeer(int clientSocket, const struct sockaddr_in* clientAddr) {
+    struct sockaddr_in peer;
+    if (!clientAddr) {
+        socklen_t peerLen = sizeof(peer);
+        if (getpeername(clientSocket, (struct sockaddr *)&peer, &peerLen) < 0) {
+            std::ostringstream oss;
+            oss << "fd " << clientSocket;
+            return oss.str();
+        }
+        clientAddr = &peer;
+    }
+    std::ostringstream oss;
+    oss << inet_ntoa(clientAddr->sin_addr) << ":" << ntohs(clientAddr->sin_port);
+    return oss.str();
+}
+
+/* Функция `handleClientData()` обрабатывает данные, полученные от клиента.  
+1. **Чтение данных**  
+   - Вызывается, когда реактор сообщил о готовности сокета к чтению.  
+   - Читает кусками по `READ_CHUNK`, пока сокет не опустеет (`EAGAIN` или
+     короткое чтение), но не больше `read_budget` за тик и не больше, чем
+     осталось места в `recvq`: остальное дождётся следующего тика.  
+   - Перестаёт читать, как только клиент упёрся в бюджет команд тика или во
+     флуд-контроль: непрочитанное ядро придержит само.  
+   - Если клиент отключился, удаляет его (`removeClient()`).  
+   - `hangup`: реактор сообщил об ошибке или обрыве (`REACTOR_ERROR`). poll и epoll
+     сообщают о нём и без запрошенного чтения, на каждом `wait()`, поэтому клиента,
+     который сейчас читать не может, удаляем сразу, а не ждём его таймера.  
+
+2. **Обработка команд** — в `processInput()`, сразу после каждого куска. */
+
+void Shard::handleClientData(int clientSocket, bool hangup) {
+    size_t budget = server.config.getReadBudget();
+    size_t recvq = server.config.getRecvQueueLimit();
+    char buffer[READ_CHUNK];
+    while (budget > 0) {
+        ClientMap::iterator clientIt = clients.find(clientSocket);
+        if (clientIt == clients.end()) {
+            return; // Команда могла удалить клиента
+        }
+        Client& client = clientIt->second;
+        size_t room = recvq > client.getInputSize() ? recvq - client.getInputSize() : 0;
+        size_t wanted = budget < room ? budget : room;
+        if (wanted > sizeof(buffer)) {
+            wanted = sizeof(buffer);
+        }
+        if (client.isCarried() || client.getFloodTimer().isArmed() || wanted == 0) {
+            if (hangup) {
+                LOG_INFO("Client disconnected or error occurred.");
+                removeClient(clientSocket); // Иначе реактор будет будить нас до срабатывания таймера
+            }
+            return;
+        }
+        ssize_t bytesRead = read(clientSocket, buffer, wanted);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (bytesRead <= 0) {
+            // Клиент отключился или произошла ошибка
+            LOG_INFO("Client disconnected or error occurred.");
+            removeClient(clientSocket);
+            return;
+        }
+        processInput(clientSocket, buffer, bytesRead);
+        if (static_cast<size_t>(bytesRead) < wanted) {
+            return; // Сокет опустел, лишний read() вернул бы EAGAIN
+        }
+        budget -= bytesRead;
+    }
+}
+
+/* Функция `processInput()` режет полученные байты на строки (`LineFramer`) и выполняет
+   все полные строки. Общая для `read()` и для данных, которые io_uring принёс сам.  
+   - Строка длиннее 512 байт (RFC 1459) обрезается.  
+   - Если клиент сейчас ждёт бюджета (`admit()`), байты просто встают в очередь
+     за отложенными строками, выполнит их `runCommands()` по таймеру. Новых байт
+     тогда почти не бывает: чтение снято, кроме io_uring, который читает сам.  
+   - Если невыполненного (хвост строки плюс отложенное) набралось больше `recvq`,
+     клиент отключается с "RecvQ exceeded". */
+
+void Shard::processInput(int clientSocket, const char* data, size_t length) {
+    ClientMap::iterator clientIt = clients.find(clientSocket);
+    if (clientIt == clients.end()) {
+        return;
+    }
+
+    LOG_DEBUG("Raw data received: " << LogBytes(data, length) << " (bytesRead: " << length << ")");
+    metricAdd(metrics.bytesRead, length);
+    clientIt->second.touch(timers.now()); // Любые байты — клиент жив, PING ему пока не нужен
+
+    // Строки режутся прямо в буфере чтения, копируется только недочитанный хвост
+    clientIt->second.getFramer().feed(data, length);
+    if (!clientIt->second.getFloodTimer().isArmed()) {
+        runCommands(clientIt->second);
+        clientIt = clients.find(clientSocket); // Команда могла удалить клиента
+        if (clientIt == clients.end()) {
+            return;
+        }
+    }
+    if (clientIt->second.getInputSize() > server.config.getRecvQueueLimit()) {
+        dropClient(clientSocket, "RecvQ exceeded");
+    }
+}
+
+/* Функция `runCommands()` выполняет готовые строки клиента, пока их пускают бюджет
+   тика (`command_budget`) и `admit()`.  
+   - Строку, на которую не хватило бюджета, и всё после неё `LineFramer` откладывает.  
+   - Кончился бюджет тика — клиент встаёт в `carried` (`carry()`) и продолжит в следующем.  
+   - Если команда удалила клиента (QUIT, неверный пароль), сразу выходит.  
+   - Считает строки по командам: пришедшие и поставленные в очереди за время
+     команды (своим клиентам и в почтовые ящики чужих шардов).  
+   Общие каналы и ники обработчики блокируют сами, только на то, что трогают
+   (см. `Server.hpp`), так что команды разных шардов идут параллельно. */
+
+void Shard::runCommands(Client& client) {
+    int clientSocket = client.getSocket();
+    LineFramer& framer = client.getFramer();
+    LineView line;
+    while (framer.next(line)) {
+        Message msg;
+        if (!msg.parse(line)) {
+            continue;
+        }
+        TickBudget& budget = client.getTickBudget();
+        if (!budget.available(tick, server.config.getCommandBudget())) {
+            framer.park(line);
+            carry(client);
+            return;
+        }
+        if (!admit(client, msg.id)) {
+            framer.park(line);
+            return;
+        }
+        budget.spend();
+        LOG_DEBUG("Processed input: " << LogBytes(line.data, line.length));
+        bool wasRegistered = client.isRegistered();
+        unsigned long queued = metrics.queues.lines + metrics.posted;
+        cmdHandler->processCommand(clientSocket, msg);
+        metricAdd(metrics.linesIn[msg.id], 1);
+        metricAdd(metrics.linesOut[msg.id], metrics.queues.lines + metrics.posted - queued);
+        if (clients.find(clientSocket) == clients.end()) {
+            return; // Клиент удалён командой (QUIT и т.п.)
+        }
+        if (!wasRegistered && client.isRegistered()) {
+            metricAdd(metrics.registrations, 1);
+        }
+    }
+
+    if (framer.pending() > 0) {
+        LOG_DEBUG("Partial data remains in buffer: " << LogBytes(framer.pendingData(), framer.pending()));
+    }
+}
+
+/* Функция `carry()` ставит клиента в очередь следующего тика. Чтение с него
+   снимается в конце тика (`updateInterest()`), пока отложенное не выполнится. */
+
+void Shard::carry(Client& client) {
+    if (client.isCarried()) {
+        return;
+    }
+    client.setCarried(true);
+    carried.push_back(client.getSocket());
+    markDirty(client);
+}
+
+/* Функция `resumeCarried()` даёт каждому клиенту из `carried` новый бюджет, в том
+   порядке, в каком они туда попали. Кому снова не хватило — встаёт в конец, так
+   что клиенты с длинной очередью строк ходят по кругу, а не друг перед другом.
+   Вызывается в начале тика, до событий: так за тик клиент получает один бюджет,
+   а не второй сразу после того, как исчерпал первый на чтении. */
+
+void Shard::resumeCarried() {
+    std::vector<int> turn;
+    turn.swap(carried);
+    for (size_t i = 0; i < turn.size(); ++i) {
+        ClientMap::iterator it = clients.find(turn[i]);
+        if (it == clients.end() || !it->second.isCarried()) {
+            continue; // Удалён, а fd, может быть, уже у нового клиента
+        }
+        it->second.setCarried(false);
+        if (!it->second.getFloodTimer().isArmed()) {
+            runCommands(it->second);
+        }
+        it = clients.find(turn[i]); // Команда могла удалить клиента
+        if (it != clients.end()) {
+            markDirty(it->second); // Вернуть чтение, если всё отложенное выполнено
+        }
+    }
+}
+
+/* Функция `admit()` — защита от флуда («fake lag»). У каждого клиента корзина
+   токенов (`flood_burst` штук, пополняется на `flood_rate` в секунду), каждая
+   команда забирает свою цену (`commandCost()`: PRIVMSG дешевле JOIN и WHOIS).  
+   Когда токенов не хватает, строка не выбрасывается: клиент ждёт на таймере,
+   пока корзина не наберёт нужное, а остальные клиенты шарда тем временем
+   обслуживаются как обычно. `flood_rate 0` отключает проверку. */
+
+bool Shard::admit(Client& client, CommandId command) {
+    unsigned rate = server.config.getFloodRate();
+    if (rate == 0) {
+        return true;
+    }
+    unsigned burst = server.config.getFloodBurst();
+    unsigned cost = commandCost(command);
+    if (cost > burst) {
+        cost = burst; // Иначе такая команда не прошла бы никогда
+    }
+    TokenBucket& bucket = client.getFloodBucket();
+    if (bucket.take(cost, timers.now(), burst, rate)) {
+        return true;
+    }
+    client.countThrottle();
+    metricAdd(metrics.throttles, 1);
+    timers.arm(client.getFloodTimer(), bucket.delayFor(cost, rate));
+    markDirty(client); // Снять чтение в конце тика
+    LOG_DEBUG("Client " << client.getSocket() << " throttled, " << client.getFramer().parked() << " bytes parked");
+    return false;
+}
+
+/* Функция `handleClientWrite()` дописывает клиенту то, что не влезло в сокет
+   в конце прошлого тика (`flushDirtyClients()`).  
+   - Вызывается, когда реактор сообщил о готовности сокета к записи.  
+   - Когда буфер опустел, снимает интерес к записи (`updateInterest()`). */
+
+void Shard::handleClientWrite(int clientSocket) {
+    Client& client = clients[clientSocket];
+    if (sendPending(client)) {
+        updateInterest(client);
+    }
+}
+
+/* Функция `sendPending()` отправляет очередь клиента сразу, не дожидаясь реактора.  
+   - Очередь уходит `sendmsg()` по `SEND_IOV_MAX` кусков, без копирования в одну строку,
+     пока не кончится или сокет не заполнится (`EAGAIN` или неполная отправка).  
+   - Если отправка не удалась по другой причине, удаляет клиента и возвращает false. */
+
+bool Shard::sendPending(Client& client) {
+    int clientSocket = client.getSocket();
+    while (client.hasPendingOutput()) {
+        struct iovec iov[SEND_IOV_MAX];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = client.fillOutputIov(iov, SEND_IOV_MAX);
+        size_t wanted = 0;
+        for (size_t i = 0; i < msg.msg_iovlen; ++i) {
+            wanted += iov[i].iov_len;
+        }
+        ssize_t bytesWritten = sendmsg(clientSocket, &msg, MSG_NOSIGNAL);
+        if (bytesWritten < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (bytesWritten <= 0) {
+            LOG_INFO("Client " << clientSocket << " disconnected during send.");
+            removeClient(clientSocket); // Удаляем клиента только при реальной ошибке
+            return false;
+        }
+        client.eraseOutputBuffer(bytesWritten);
+        metricAdd(metrics.bytesWritten, bytesWritten);
+        LOG_DEBUG("Bytes sent: " << bytesWritten);
+        if (static_cast<size_t>(bytesWritten) < wanted) {
+            break; // Сокет полон, остаток допишем по готовности к записи
+        }
+    }
+    return true;
+}
+
+/* Функция `handleClientSent()` разбирает завершение отправки от реактора, который
+   пишет сам (io_uring): убирает отправленное из буфера и, если там ещё что-то есть,
+   сразу отправляет следующую порцию. */
+
+void Shard::handleClientSent(int clientSocket, unsigned events, int bytesSent) {
+    ClientMap::iterator it = clients.find(clientSocket);
+    if (it == clients.end()) {
+        return;
+    }
+    Client& client = it->second;
+    client.setWriteArmed(false);
+    if (events & REACTOR_ERROR) {
+        LOG_INFO("Client " << clientSocket << " disconnected during send.");
+        removeClient(clientSocket);
+        return;
+    }
+    if (bytesSent > 0) {
+        client.eraseOutputBuffer(bytesSent);
+        metricAdd(metrics.bytesWritten, bytesSent);
+        LOG_DEBUG("Bytes sent: " << bytesSent);
+    }
+    updateInterest(client);
+}
+
+/* Функция `markDirty()` запоминает клиента, которому за этот тик добавили данные в буфер.  
+   Флаг на самом клиенте не даёт добавить его в список дважды, так что рассылка  
+   на канал стоит O(участников), без поиска по всем дескрипторам. */
+
+void Shard::markDirty(Client& client) {
+    if (client.isDirty()) {
+        return;
+    }
+    client.setDirty(true);
+    dirtyClients.push_back(client.getSocket());
+}
+
+/* Функция `flushDirtyClients()` в конце тика проходит по списку изменённых клиентов,  
+   сразу отправляет им накопленное (`sendPending()`) и синхронизирует интерес к записи:
+   он нужен, только если сокет не принял всё. Так ответ уходит в том же тике, а не
+   через лишний круг `wait()`, и все строки тика уходят одним `sendmsg()`.
+   Тем, кто уже ждёт готовности к записи, не пишем: сокет всё равно полон.
+   io_uring пишет сам, ему отправку ставит `updateInterest()`.
+   Удалённых за тик клиентов просто пропускает.  
+   Клиента, чья очередь упёрлась в `sendq`, отключает здесь с "SendQ exceeded":
+   посреди рассылки удалять нельзя, рассылка идёт по списку участников канала,
+   а лишние строки `SendQueue` уже не принимала. */
+
+void Shard::flushDirtyClients() {
+    for (size_t i = 0; i < dirtyClients.size(); ++i) {
+        ClientMap::iterator it = clients.find(dirtyClients[i]);
+        if (it == clients.end()) {
+            continue;
+        }
+        it->second.setDirty(false);
+        if (it->second.isSendQueueExceeded()) {
+            LOG_WARN("Client " << it->first << " is not reading: " << it->second.getOutputSize()
+                     << " bytes queued, " << server.queuedBytes() << " on the server");
+            dropClient(it->first, "SendQ exceeded");
+            continue;
+        }
+        if (!reactor->completesIo() && !it->second.isWriteArmed() && !sendPending(it->second)) {
+            continue;
+        }
+        updateInterest(it->second);
+    }
+    dirtyClients.clear();
+}
+
+/* Функция `updateInterest()` синхронизирует интерес клиента в реакторе:  
+   - к записи — включает, когда в буфере появились данные, и снимает, когда буфер опустел;  
+   - к чтению — снимает, пока клиент ждёт бюджета (`admit()`) или следующего тика
+     (`carry()`): тогда ядро само придерживает его данные и TCP тормозит отправителя.  
+   Реактор трогаем только при смене состояния, а не на каждом тике. */
+
+void Shard::updateInterest(Client& client) {
+    bool reading = !client.getFloodTimer().isArmed() && !client.isCarried();
+    if (reactor->completesIo()) {
+        if (reading != client.isReadArmed() && reactor->modify(client.getSocket(), reading ? REACTOR_READ : 0)) {
+            client.setReadArmed(reading);
+        }
+        // Реактор пишет сам: одна отправка в полёте, остальное дождётся её завершения
+        if (client.isWriteArmed() || !client.hasPendingOutput()) {
+            return;
+        }
+        if (reactor->send(client.getSocket(), client.getOutputQueue())) {
+            client.setWriteArmed(true);
+        }
+        return;
+    }
+    bool pending = client.hasPendingOutput();
+    if (pending == client.isWriteArmed() && reading == client.isReadArmed()) {
+        return;
+    }
+    unsigned interest = (reading ? REACTOR_READ : 0) | (pending ? REACTOR_WRITE : 0);
+    if (reactor->modify(client.getSocket(), interest)) {
+        client.setWriteArmed(pending);
+        client.setReadArmed(reading);
+    }
+}
+
+/* Функция `deliver()` ставит строку в очередь любому клиенту.  
+   Свой клиент получает её сразу в буфер, чужой — через почтовый ящик шарда-владельца.  
+   Вызывается из обработчиков команд под `clientsLock` (хватает разделяемого):
+   пока он взят, чужой клиент не удалится и его fd не достанется новому. */
+
+void Shard::deliver(int clientSocket, const std::string& message) {
+    LineView line = { message.data(), message.size() };
+    deliver(clientSocket, BufferRef(&line, 1, &bufferPool));
+    flushPosted();
+}
+
+/* Разделяемый буфер не копируется: в очередь клиента попадает только ссылка на него. */
+
+void Shard::deliver(int clientSocket, const BufferRef& message) {
+    ClientMap::iterator it = clients.find(clientSocket);
+    if (it != clients.end()) {
+        it->second.appendOutputBuffer(message);
+        markDirty(it->second);
+        return;
+    }
+    Client* target = server.findClient(clientSocket);
+    if (!target) {
+        return;
+    }
+    if (outbox.size() < server.shards.size()) {
+        Outbox empty = { NULL, NULL };
+        outbox.resize(server.shards.size(), empty);
+    }
+    Outbox& box = outbox[target->getShard()];
+    Mailbox::Item* item = box.first;
+    if (!item || item->count == Mailbox::BATCH || item->line.data() != message.data()) {
+        item = mailPool.allocate();
+        item->line = message;
+        item->next = box.first;
+        if (!box.first) {
+            box.last = item;
+        }
+        box.first = item;
+    }
+    item->to[item->count].clientSocket = clientSocket;
+    item->to[item->count].clientId = target->getId();
+    ++item->count;
+    metricAdd(metrics.posted, 1);
+}
+
+/* Функция `flushPosted()` отправляет накопленное в `deliver()` по шардам: одна цепочка писем
+   на шард и один CAS на его почтовом ящике, сколько бы получателей там ни было. */
+
+void Shard::flushPosted() {
+    for (size_t i = 0; i < outbox.size(); ++i) {
+        if (outbox[i].first) {
+            server.shards[i]->post(outbox[i].first, outbox[i].last);
+            outbox[i].first = NULL;
+            outbox[i].last = NULL;
+        }
+    }
+}
+
+Client* Shard::findClient(int clientSocket) {
+    ClientMap::iterator it = clients.find(clientSocket);
+    return it == clients.end() ? NULL : &it->second;
+}
+
+void Shard::post(Mailbox::Item* first, Mailbox::Item* last) {
+    mailbox.post(first, last);
+}
+
+/* Функция `drainMailbox()` раскладывает письма от других шардов по буферам клиентов.  
+   В письме одна строка для нескольких клиентов; строка для уже отключённого клиента
+   (или для нового клиента на том же fd) выбрасывается. Письмо возвращается в пул
+   шарда-отправителя. */
+
+void Shard::drainMailbox() {
+    Mailbox::Item* item = mailbox.drain();
+    while (item) {
+        for (size_t i = 0; i < item->count; ++i) {
+            ClientMap::iterator it = clients.find(item->to[i].clientSocket);
+            if (it != clients.end() && it->second.getId() == item->to[i].clientId) {
+                it->second.appendOutputBuffer(item->line);
+                markDirty(it->second);
+            }
+        }
+        Mailbox::Item* next = item->next;
+        item->pool->release(item);
+        item = next;
+    }
+}
+
+/* Функция `removeClient()` удаляет клиента из сервера.   
+1. **Удаляет клиента из каналов** под `channelsLock` и **из общего каталога** (`m_clients`) и ников под `clientsLock`.  
+2. **Удаляет клиента из реактора**, чтобы сервер больше не следил за его событиями.  
+3. **Закрывает соединение** (`close(clientSocket)`) — только теперь: пока fd записан в каталоге и каналах,
+   его не может получить новый клиент на другом шарде.  
+4. **Удаляет клиента из списка шарда** и выводит сообщение о том, что клиент был удалён.  
+   Вызывающий не должен держать ни одной из этих блокировок. */
+
+void Shard::removeClient(int clientSocket) {
+    {
+        WriteGuard guard(server.channelsLock);
+        server.removeClientFromChannels(clientSocket);
+    }
+    ClientMap::iterator it = clients.find(clientSocket);
+    {
+        WriteGuard guard(server.clientsLock);
+        if (it != clients.end()) {
+            server.nicks.release(clientSocket, it->second.getNickname());
+        }
+        server.m_clients.erase(clientSocket);
+    }
+    reactor->remove(clientSocket);
+    close(clientSocket);
+    if (it != clients.end()) {
+        timers.cancel(it->second.getTimer());
+        timers.cancel(it->second.getFloodTimer());
+        clients.erase(it);
+        metricAdd(metrics.closed, 1);
+    }
+    LOG_INFO("Client " << clientSocket << " removed.");
+}
+
+void Shard::closeAll() {
+    for (ClientMap::iterator it = clients.begin(); it != clients.end(); ++it) {
+        timers.cancel(it->second.getTimer());
+        timers.cancel(it->second.getFloodTimer());
+        reactor->remove(it->first); // io_uring забирает очередь, если по ней ещё идёт отправка
+        close(it->first);
+    }
+    clients.clear();
+    dirtyClients.clear();
+    carried.clear();
+    drainMailbox(); // Письма держат буферы из пулов других шардов: отпускаем, пока те шарды живы (`Server::shutdown()`)
+
+    if (m_serverSocket != -1) {
+        close(m_serverSocket);
+        m_serverSocket = -1;
+    }
+}
+
+void Shard::wake() {
+    mailbox.wake();
+}
+
+unsigned long Shard::now() const {
+    return timers.now();
+}
+
+unsigned long Shard::getFloodThrottles() const {
+    return metricRead(metrics.throttles);
+}
+
+unsigned long Shard::getQueuedBytes() const {
+    return metricRead(metrics.queues.bytes);
+}
+
+BufferPool& Shard::getBufferPool() {
+    return bufferPool;
+}
+
+const FixedPool& Shard::getClientPool() const {
+    return clientPool;
+}
+
+const FixedPool& Shard::getSegmentPool() const {
+    return segmentPool;
+}
+
+const FixedPool& Shard::getChunkPool() const {
+    return chunkPool;
+}
+
+const BufferPool& Shard::getBufferPool() const {
+    return bufferPool;
+}
+
+const MailPool& Shard::getMailPool() const {
+    return mailPool;
+}
+
+const ShardMetrics& Shard::getMetrics() const {
+    return metrics;
+}
+
+/* Функция `expireTimers()` в конце тика разбирает клиентов, у которых истёк таймер:
+   либо таймаут (`handleTimeout()`), либо корзина набрала токенов на отложенные строки. */
+
+void Shard::expireTimers() {
+    TimerNode* timer;
+    while ((timer = timers.popExpired()) != NULL) {
+        int clientSocket = timer->owner;
+        ClientMap::iterator it = clients.find(clientSocket);
+        if (it == clients.end()) {
+            continue;
+        }
+        if (timer == &it->second.getFloodTimer()) {
+            runCommands(it->second);
+            it = clients.find(clientSocket); // Команда могла удалить клиента
+            if (it != clients.end()) {
+                markDirty(it->second); // Вернуть чтение, если бюджета хватило на всё отложенное
+            }
+        } else {
+            handleTimeout(it->second);
+        }
+    }
+}
+
+/* Функция `handleTimeout()` решает, что делать с клиентом, чей таймер истёк.
+   У клиента один таймер, и что он означает, видно по состоянию клиента:
+1. **Не зарегистрировался** (нет PASS, NICK или USER) за `registration_timeout` — отключаем.
+2. **Не ответил на PING** за `ping_timeout` — отключаем.
+3. **Молчит дольше `idle_timeout`** (PING/PONG не в счёт, 0 — не проверять) — отключаем.
+4. **Молчит дольше `ping_interval`** — шлём PING и ждём ответа `ping_timeout`.
+5. Иначе ставим таймер на ближайший из сроков.
+   Чтение данных таймер не переставляет, только обновляет время у клиента:
+   срок пересчитывается лениво, когда таймер сработает. */
+
+void Shard::handleTimeout(Client& client) {
+    const Config& config = server.config;
+    unsigned long now = timers.now();
+    if (!client.isRegistered()) {
+        dropClient(client.getSocket(), "Registration timed out");
+        return;
+    }
+    if (client.isAwaitingPong()) {
+        dropClient(client.getSocket(), "Ping timeout");
+        return;
+    }
+    unsigned long idleLimit = config.getIdleTimeout() * 1000UL;
+    if (idleLimit > 0 && now - client.getLastCommand() >= idleLimit) {
+        dropClient(client.getSocket(), "Idle timeout");
+        return;
+    }
+    unsigned long pingAt = client.getLastActivity() + config.getPingInterval() * 1000UL;
+    if (now >= pingAt) {
+        client.appendOutputBuffer("PING :server\r\n");
+        markDirty(client);
+        client.setAwaitingPong(true);
+        timers.arm(client.getTimer(), config.getPingTimeout() * 1000UL);
+        return;
+    }
+    unsigned long next = pingAt;
+    if (idleLimit > 0 && client.getLastCommand() + idleLimit < next) {
+        next = client.getLastCommand() + idleLimit;
+    }
+    timers.arm(client.getTimer(), next - now);
+}
+
+/* Функция `dropClient()` отключает клиента по таймауту или переполнению очереди. Строка ERROR
+   встаёт в конец очереди и уходит вместе с ней, без ожидания записи: соединение сейчас закроется.
+   Мимо очереди её слать нельзя — она врезалась бы в недописанную строку.  
+   - Переполненную очередь сначала сбрасываем, кроме начатой строки (`SendQueue::dropUnsent()`).  
+   - Если io_uring ещё пишет очередь, трогать её нельзя: клиент уходит без ERROR. */
+
+void Shard::dropClient(int clientSocket, const char* reason) {
+    LOG_INFO("Client " << clientSocket << " dropped: " << reason);
+    ClientMap::iterator it = clients.find(clientSocket);
+    if (it != clients.end() && !(reactor->completesIo() && it->second.isWriteArmed())) {
+        Client& client = it->second;
+        if (client.isSendQueueExceeded()) {
+            client.getOutputQueue().dropUnsent();
+        }
+        client.appendOutputBuffer(std::string("ERROR :Closing link (") + reason + ")\r\n");
+        if (!sendPending(client)) {
+            return; // Отправка не удалась, клиент уже удалён
+        }
+    }
+    removeClient(clientSocket);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "Client.hpp"
+#include "Reactor.hpp"
+#include "Mailbox.hpp"
+#include "TimerWheel.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include "Pool.hpp"
+
+class Server;
+class CommandHandler;
+
+/* A Shard is one reactor thread: its own listening socket (SO_REUSEPORT when
+   there are several shards), its own reactor and the clients it accepted.
+   Only the owning thread touches a client's socket and buffers; other shards
+   hand it lines through the shard's Mailbox. */
+class Shard {
+public:
+    typedef std::map<int, Client, std::less<int>, PoolAllocator<std::pair<const int, Client> > > ClientMap;
+
+    Shard(Server& s, size_t idx);
+    ~Shard();
+    bool initialize();
+    void run();
+    size_t getIndex() const;
+    pthread_t& getThread();
+
+    /* Owner thread: one of this shard's clients, or NULL. */
+    Client* findClient(int clientSocket);
+    /* Queue a line for any client; goes through the owner's mailbox when it lives on another shard.
+       Caller holds Server::clientsLock shared. A BufferRef for another shard's
+       client waits in the outbox, batched with the other recipients on that
+       shard, until flushPosted(); the string overload posts it right away. */
+    void deliver(int clientSocket, const std::string& message);
+    void deliver(int clientSocket, const BufferRef& message);
+    /* Owner thread: posts the outbox, one chain of items per shard. */
+    void flushPosted();
+    /* Any thread: items from another shard's MailPool, see Mailbox::post(). */
+    void post(Mailbox::Item* first, Mailbox::Item* last);
+    void markDirty(Client& client);
+    void removeClient(int clientSocket);
+    void closeAll();
+    /* Any thread: interrupts the reactor wait, e.g. to notice Server::isStopping(). */
+    void wake();
+    /* Monotonic milliseconds as of this tick (TimerWheel::now()). */
+    unsigned long now() const;
+    /* Times a client of this shard ran out of flood budget. */
+    unsigned long getFloodThrottles() const;
+    /* Any thread: bytes in the send queues of this shard's clients. */
+    unsigned long getQueuedBytes() const;
+    /* Any thread, fields read with metricRead(). */
+    const ShardMetrics& getMetrics() const;
+    /* Owner thread: where broadcasts rendered on this shard are allocated. */
+    BufferPool& getBufferPool();
+    /* Any thread, for their getStats(). */
+    const FixedPool& getClientPool() const;
+    const FixedPool& getSegmentPool() const;
+    const FixedPool& getChunkPool() const;
+    const BufferPool& getBufferPool() const;
+    const MailPool& getMailPool() const;
+
+private:
+    /* Items for one shard's clients not posted yet, newest first. */
+    struct Outbox {
+        Mailbox::Item* first;
+        Mailbox::Item* last;
+    };
+
+    Server& server;
+    size_t index;
+    int m_serverSocket;
+    int spareFd;                    /* /dev/null held back so accept() can still shed connections at EMFILE */
+    Reactor* reactor;
+    CommandHandler* cmdHandler;
+    /* Declared before everything that holds their objects, so they go last. */
+    FixedPool clientPool;           /* nodes of `clients` */
+    FixedPool segmentPool;          /* SendQueue segments */
+    FixedPool chunkPool;            /* SendQueue chunks */
+    BufferPool bufferPool;          /* broadcast lines, see EventRouter::render() */
+    MailPool mailPool;              /* items this shard posts to the others' mailboxes */
+    Mailbox mailbox;
+    std::vector<Outbox> outbox;     /* per shard, see deliver() */
+    ClientMap clients;              /* clients owned by this shard */
+    std::vector<int> dirtyClients;  /* clients whose sendq changed during this tick */
+    std::vector<int> carried;       /* clients out of tick budget with lines left, resumed next tick in this order */
+    unsigned long tick;             /* loop iterations so far, for TickBudget */
+    TimerWheel timers;              /* deadlines and flood delays of the clients, drive the reactor timeout */
+    ShardMetrics metrics;           /* written by this thread only, queues kept by the clients' SendQueues */
+    pthread_t thread;
+
+    bool setupSocket();
+    void handleNewConnection();
+    int acceptOne(struct sockaddr_in* clientAddr);
+    bool shedConnection();
+    void acceptClient(int clientSocket, const struct sockaddr_in* clientAddr);
+    static std::string describePeer(int clientSocket, const struct sockaddr_in* clientAddr);
+    void handleClientData(int clientSocket, bool hangup);
+    void processInput(int clientSocket, const char* data, size_t length);
+    void runCommands(Client& client);
+    void carry(Client& client);
+    void resumeCarried();
+    bool admit(Client& client, CommandId command);
+    void handleClientWrite(int clientSocket);
+    bool sendPending(Client& client);
+    void handleClientSent(int clientSocket, unsigned events, int bytesSent);
+    void drainMailbox();
+    void flushDirtyClients();
+    void updateInterest(Client& client);
+    void expireTimers();
+    void handleTimeout(Client& client);
+    void dropClient(int clientSocket, const char* reason);
+
+    Shard(const Shard&);
+    Shard& operator=(const Shard&);
+
+    friend class HandlerBench;
+};
@@ -0,0 +1,84 @@
+#include "SharedBuffer.hpp"
+#include "Pool.hpp"
+#include <cstring>
+#include <new>
+
+SharedBuffer::SharedBuffer(size_t len, BufferPool* from) : refs(1), length(len), pool(from) {}
+
+SharedBuffer::~SharedBuffer() {}
+
+SharedBuffer* SharedBuffer::create(const char* data, size_t length) {
+    LineView part = { data, length };
+    return create(&part, 1, NULL);
+}
+
+SharedBuffer* SharedBuffer::create(const LineView* parts, size_t count, BufferPool* pool) {
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        length += parts[i].length;
+    }
+    void* raw = pool ? pool->allocate(sizeof(SharedBuffer) + length) : NULL;
+    if (!raw) {
+        pool = NULL;
+        raw = ::operator new(sizeof(SharedBuffer) + length);
+    }
+    SharedBuffer* buffer = new (raw) SharedBuffer(length, pool);
+    char* out = reinterpret_cast<char*>(buffer + 1);
+    for (size_t i = 0; i < count; ++i) {
+        if (parts[i].length > 0) {
+            memcpy(out, parts[i].data, parts[i].length);
+            out += parts[i].length;
+        }
+    }
+    return buffer;
+}
+
+void SharedBuffer::retain() { __atomic_add_fetch(&refs, 1, __ATOMIC_RELAXED); }
+
+void SharedBuffer::release() {
+    if (__atomic_sub_fetch(&refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        BufferPool* from = pool;
+        size_t bytes = sizeof(SharedBuffer) + length;
+        this->~SharedBuffer();
+        if (from)
+            from->release(this, bytes);
+        else
+            ::operator delete(this);
+    }
+}
+
+const char* SharedBuffer::data() const { return reinterpret_cast<const char*>(this + 1); }
+
+size_t SharedBuffer::size() const { return length; }
+
+BufferRef::BufferRef() : buffer(NULL) {}
+
+BufferRef::BufferRef(const std::string& data) : buffer(SharedBuffer::create(data.data(), data.size())) {}
+
+BufferRef::BufferRef(const LineView* parts, size_t count, BufferPool* pool)
+    : buffer(SharedBuffer::create(parts, count, pool)) {}
+
+BufferRef::BufferRef(const BufferRef& other) : buffer(other.buffer) {
+    if (buffer)
+        buffer->retain();
+}
+
+BufferRef& BufferRef::operator=(const BufferRef& other) {
+    if (other.buffer)
+        other.buffer->retain();
+    if (buffer)
+        buffer->release();
+    buffer = other.buffer;
+    return *this;
+}
+
+BufferRef::~BufferRef() {
+    if (buffer)
+        buffer->release();
+}
+
+const char* BufferRef::data() const { return buffer ? buffer->data() : ""; }
+
+size_t BufferRef::size() const { return buffer ? buffer->size() : 0; }
+
+bool BufferRef::empty() const { return size() == 0; }
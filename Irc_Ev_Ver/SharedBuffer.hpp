@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include "LineFramer.hpp"
+
+class BufferPool;
+
+/* Immutable, reference-counted line of output. A broadcast is rendered once
+   into a SharedBuffer and every recipient's send queue only keeps a
+   BufferRef to it, so fan-out memory does not grow with the channel size.
+   The count is atomic: references travel to other shards through Mailbox,
+   and the buffer goes back to the pool it came from on whichever shard
+   drops the last one. */
+class SharedBuffer {
+public:
+    static SharedBuffer* create(const char* data, size_t length);
+    /* `parts` joined into one buffer, taken from `pool` (owner thread only) when a size class fits. */
+    static SharedBuffer* create(const LineView* parts, size_t count, BufferPool* pool);
+    void retain();
+    void release();
+    const char* data() const;
+    size_t size() const;
+
+private:
+    int refs;
+    size_t length; /* the bytes follow the header in the same allocation */
+    BufferPool* pool; /* NULL when it came from operator new */
+
+    SharedBuffer(size_t len, BufferPool* from);
+    ~SharedBuffer();
+    SharedBuffer(const SharedBuffer&);
+    SharedBuffer& operator=(const SharedBuffer&);
+};
+
+/* Owning handle to a SharedBuffer; copying it only bumps the count. */
+class BufferRef {
+public:
+    BufferRef();
+    explicit BufferRef(const std::string& data);
+    BufferRef(const LineView* parts, size_t count, BufferPool* pool);
+    BufferRef(const BufferRef& other);
+    BufferRef& operator=(const BufferRef& other);
+    ~BufferRef();
+
+    const char* data() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    SharedBuffer* buffer;
+};
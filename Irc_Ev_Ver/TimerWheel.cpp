@@ -0,0 +1,165 @@
+#include "TimerWheel.hpp"
+#include <climits>
+#include <time.h>
+
+static const unsigned long SLOT_MASK = TimerWheel::SLOTS - 1;
+/* Anything further out waits in the top level and is re-placed when it gets there. */
+static const unsigned long MAX_DELTA = (1UL << (TimerWheel::LEVELS * TimerWheel::LEVEL_BITS)) - 1;
+
+TimerNode::TimerNode() : owner(-1), expires(0), prev(NULL), next(NULL) {}
+
+TimerNode::TimerNode(const TimerNode& other) : owner(other.owner), expires(0), prev(NULL), next(NULL) {}
+
+TimerNode& TimerNode::operator=(const TimerNode& other) {
+    owner = other.owner;
+    return *this;
+}
+
+bool TimerNode::isArmed() const { return prev != NULL; }
+
+TimerWheel::TimerWheel() : current(0), nowMs(0), startMs(clockMs()), armed(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            wheel[level][slot].prev = &wheel[level][slot];
+            wheel[level][slot].next = &wheel[level][slot];
+        }
+    }
+    expired.prev = &expired;
+    expired.next = &expired;
+}
+
+unsigned long TimerWheel::now() const { return nowMs; }
+
+size_t TimerWheel::size() const { return armed; }
+
+void TimerWheel::arm(TimerNode& node, unsigned long delayMs) {
+    cancel(node);
+    node.expires = (nowMs + delayMs + TICK_MS - 1) / TICK_MS;
+    place(node);
+    ++armed;
+}
+
+void TimerWheel::cancel(TimerNode& node) {
+    if (!node.isArmed())
+        return;
+    unlink(node);
+    --armed;
+}
+
+void TimerWheel::advance() {
+    advanceTo(clockMs() - startMs);
+}
+
+/* Runs every tick up to `ms`. Whenever level 0 wraps, the next slot of the
+   level above is spread over the levels below it first. */
+void TimerWheel::advanceTo(unsigned long ms) {
+    nowMs = ms;
+    unsigned long target = nowMs / TICK_MS;
+    if (armed == 0) {
+        current = target + 1;
+        return;
+    }
+    while (current <= target) {
+        TimerNode& head = wheel[0][current & SLOT_MASK];
+        if ((current & SLOT_MASK) == 0)
+            cascade(1);
+        while (head.next != &head) {
+            TimerNode* node = head.next;
+            unlink(*node);
+            link(expired, *node);
+        }
+        ++current;
+    }
+}
+
+TimerNode* TimerWheel::popExpired() {
+    if (expired.next == &expired)
+        return NULL;
+    TimerNode* node = expired.next;
+    unlink(*node);
+    --armed;
+    return node;
+}
+
+/* The earliest tick that has work: a due slot on level 0, or the point where
+   a non-empty slot of a higher level gets cascaded. */
+int TimerWheel::timeoutMs() const {
+    if (expired.next != &expired)
+        return 0;
+    if (armed == 0)
+        return -1;
+    unsigned long next = ULONG_MAX;
+    for (int level = 0; level < LEVELS; ++level) {
+        unsigned long base = current >> (level * LEVEL_BITS);
+        /* The slot under the cursor is cascaded with the next tick when that
+           tick starts a turn of this level; otherwise it was cascaded already
+           and holds timers a full turn away. */
+        unsigned long first = (current & ((1UL << (level * LEVEL_BITS)) - 1)) == 0 ? 0 : 1;
+        for (unsigned long k = first; k < first + SLOTS; ++k) {
+            const TimerNode& head = wheel[level][(base + k) & SLOT_MASK];
+            if (head.next != &head) {
+                unsigned long tick = (base + k) << (level * LEVEL_BITS);
+                if (tick < next)
+                    next = tick;
+                break;
+            }
+        }
+    }
+    unsigned long dueMs = next * TICK_MS;
+    if (dueMs <= nowMs)
+        return 0;
+    unsigned long wait = dueMs - nowMs;
+    return wait > static_cast<unsigned long>(INT_MAX) ? INT_MAX : static_cast<int>(wait);
+}
+
+unsigned long TimerWheel::clockMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000UL + static_cast<unsigned long>(ts.tv_nsec) / 1000000UL;
+}
+
+void TimerWheel::link(TimerNode& head, TimerNode& node) {
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+void TimerWheel::unlink(TimerNode& node) {
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = NULL;
+    node.next = NULL;
+}
+
+/* Level L holds timers due within SLOTS^(L+1) ticks, in the slot picked by
+   bits L*LEVEL_BITS and up of their expiry. Late timers go to the slot
+   that runs next. */
+void TimerWheel::place(TimerNode& node) {
+    if (node.expires < current) {
+        link(wheel[0][current & SLOT_MASK], node);
+        return;
+    }
+    unsigned long delta = node.expires - current;
+    if (delta > MAX_DELTA) {
+        delta = MAX_DELTA;
+        node.expires = current + MAX_DELTA;
+    }
+    int level = 0;
+    while (level + 1 < LEVELS && delta >= (1UL << ((level + 1) * LEVEL_BITS)))
+        ++level;
+    link(wheel[level][(node.expires >> (level * LEVEL_BITS)) & SLOT_MASK], node);
+}
+
+/* Called when every level below `level` has wrapped. */
+void TimerWheel::cascade(int level) {
+    unsigned long index = (current >> (level * LEVEL_BITS)) & SLOT_MASK;
+    TimerNode& head = wheel[level][index];
+    while (head.next != &head) {
+        TimerNode* node = head.next;
+        unlink(*node);
+        place(*node);
+    }
+    if (index == 0 && level + 1 < LEVELS)
+        cascade(level + 1);
+}
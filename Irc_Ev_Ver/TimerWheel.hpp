@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+/* A timer that can be linked into a TimerWheel. It is embedded in its owner,
+   so arming and cancelling never allocate. A copy starts out unarmed. */
+struct TimerNode {
+    TimerNode();
+    TimerNode(const TimerNode& other);
+    TimerNode& operator=(const TimerNode& other);
+    bool isArmed() const;
+
+    int owner;             /* for the owner to recognise the timer, e.g. its socket */
+    unsigned long expires; /* tick the timer is due at */
+    TimerNode* prev;
+    TimerNode* next;
+};
+
+/* Hierarchical timer wheel: LEVELS rings of SLOTS lists, each level SLOTS
+   times coarser than the one below. Arming and cancelling are O(1) list
+   operations; a timer moves down a level whenever the ring below wraps,
+   so it is touched at most LEVELS times before it fires. Times are
+   milliseconds on the monotonic clock since the wheel was created, read
+   once per advance(). One wheel per shard, owner thread only. */
+class TimerWheel {
+public:
+    enum { TICK_MS = 100, LEVEL_BITS = 6, SLOTS = 1 << LEVEL_BITS, LEVELS = 4 };
+
+    TimerWheel();
+    /* The time as of the last advance(). */
+    unsigned long now() const;
+    /* (Re)arms `node` to fire no earlier than `delayMs` from now(). */
+    void arm(TimerNode& node, unsigned long delayMs);
+    void cancel(TimerNode& node);
+    /* Reads the clock and moves every timer that is due to the expired list. */
+    void advance();
+    /* The same at `ms` since the wheel was created instead of the clock, which
+       must not go back; lets a test drive the wheel with a fake clock. */
+    void advanceTo(unsigned long ms);
+    /* Takes one timer off the expired list, NULL when there is none left. */
+    TimerNode* popExpired();
+    /* How long the event loop may sleep before a timer needs attention, -1 when none is armed. */
+    int timeoutMs() const;
+    size_t size() const;
+
+private:
+    TimerNode wheel[LEVELS][SLOTS]; /* list heads */
+    TimerNode expired;
+    unsigned long current;          /* next tick to process */
+    unsigned long nowMs;
+    unsigned long startMs;
+    size_t armed;
+
+    static unsigned long clockMs();
+    static void link(TimerNode& head, TimerNode& node);
+    static void unlink(TimerNode& node);
+    void place(TimerNode& node);
+    void cascade(int level);
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+};
@@ -0,0 +1,565 @@
+#include "UringReactor.hpp"
+
+#ifdef IRC_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+
+namespace {
+
+const unsigned RING_ENTRIES = 4096;
+const unsigned BUF_ENTRIES = 256;   /* power of two */
+const unsigned BUF_SIZE = 4096;
+const unsigned short BUF_GROUP = 0;
+const size_t SENDS_PER_SLAB = 16;
+
+/* user_data layout: the low 3 bits hold the operation. SEND carries a
+   SendOp pointer (8-byte aligned), the others carry (generation, fd). */
+enum { OP_ACCEPT = 1, OP_RECV = 2, OP_POLL = 3, OP_SEND = 4, OP_CANCEL = 5, OP_TIMEOUT = 6 };
+
+/* How long a listener waits after running out of descriptors. */
+const long ACCEPT_BACKOFF_NS = 100 * 1000000L;
+
+/* recvState bits: a recv is in flight / the owner does not want to read. */
+enum { RECV_ARMED = 1, RECV_PAUSED = 2 };
+
+uint64_t encode(unsigned op, int fd, unsigned gen) {
+    return (((static_cast<uint64_t>(gen & 0xffffff) << 32) | static_cast<uint32_t>(fd)) << 3) | op;
+}
+
+unsigned opOf(uint64_t data) { return static_cast<unsigned>(data & 7); }
+int fdOf(uint64_t data) { return static_cast<int>(static_cast<uint32_t>(data >> 3)); }
+unsigned genOfData(uint64_t data) { return static_cast<unsigned>((data >> 35) & 0xffffff); }
+
+unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+ReactorEvent makeEvent(int fd, unsigned events, int result, const char* data) {
+    ReactorEvent ev;
+    ev.fd = fd;
+    ev.events = events;
+    ev.result = result;
+    ev.data = data;
+    return ev;
+}
+
+}
+
+UringReactor::UringReactor()
+    : ringFd(-1), valid(false), multishotRecv(true), cancelByFd(false),
+      sqRing(NULL), cqRing(NULL), sqRingSize(0), cqRingSize(0), sqes(NULL), sqesSize(0),
+      sqHead(NULL), sqTail(NULL), sqMask(NULL), sqArray(NULL), sqEntries(0),
+      cqHead(NULL), cqTail(NULL), cqMask(NULL), cqes(NULL), localTail(0), toSubmit(0),
+      bufRing(NULL), bufBase(NULL), bufTail(0), sends(NULL),
+      sendPool(sizeof(SendOp), SENDS_PER_SLAB) {
+    acceptBackoff.tv_sec = 0;
+    acceptBackoff.tv_nsec = ACCEPT_BACKOFF_NS;
+    valid = setupRing() && setupBufferRing();
+    if (valid)
+        cancelByFd = probeCancelByFd();
+}
+
+/* The kernel may still be reading what a send in flight points at, so those
+   are cancelled and reaped for a moment before their memory goes. */
+UringReactor::~UringReactor() {
+    if (valid && sends) {
+        for (SendOp* op = sends; op; op = op->next)
+            cancel(reinterpret_cast<uintptr_t>(op) | OP_SEND);
+        for (int round = 0; sends && round < 10; ++round) {
+            if (enter(toSubmit, 1, 100) < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+                break;
+            unsigned head = *cqHead;
+            unsigned tail = loadAcquire(cqTail);
+            for (; head != tail; ++head) {
+                uint64_t data = cqes[head & *cqMask].user_data;
+                if (opOf(data) == OP_SEND)
+                    finishSend(reinterpret_cast<SendOp*>(static_cast<uintptr_t>(data & ~static_cast<uint64_t>(7))));
+            }
+            storeRelease(cqHead, head);
+        }
+    }
+    while (sends)
+        finishSend(sends);
+    if (bufBase)
+        munmap(bufBase, BUF_ENTRIES * BUF_SIZE);
+    if (bufRing)
+        munmap(bufRing, BUF_ENTRIES * sizeof(io_uring_buf));
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    if (ringFd != -1)
+        close(ringFd);
+}
+
+bool UringReactor::isValid() const { return valid; }
+
+bool UringReactor::setupRing() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (ringFd < 0)
+        return false;
+    /* Needed: one mmap for both rings, no dropped CQEs, wait with a timeout. */
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+        return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (cqRingSize > sqRingSize)
+        sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+    void* ring = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+        return false;
+    sqRing = static_cast<unsigned char*>(ring);
+    cqRing = sqRing;
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* s = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (s == MAP_FAILED)
+        return false;
+    sqes = static_cast<io_uring_sqe*>(s);
+
+    sqHead = reinterpret_cast<unsigned*>(sqRing + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+    localTail = *sqTail;
+
+    /* Multishot accept/recv and provided buffer rings all need ACCEPT/RECV/SENDMSG. */
+    size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<unsigned char> probeMem(probeSize, 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(&probeMem[0]);
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        return false;
+    const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+                        IORING_OP_TIMEOUT };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+/* Cancelling by fd (5.19) is tried on the ring's own fd, where nothing is in
+   flight: a kernel that knows the flag finds nothing, an older one says -EINVAL. */
+bool UringReactor::probeCancelByFd() {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = ringFd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = OP_CANCEL;
+    if (enter(toSubmit, 1, -1) < 0)
+        return false;
+    bool supported = false;
+    unsigned head = *cqHead;
+    unsigned tail = loadAcquire(cqTail);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        if (cqe.user_data == OP_CANCEL)
+            supported = cqe.res != -EINVAL;
+    }
+    storeRelease(cqHead, head);
+    return supported;
+}
+
+bool UringReactor::setupBufferRing() {
+    void* ring = mmap(NULL, BUF_ENTRIES * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    bufRing = static_cast<unsigned char*>(ring);
+    void* base = mmap(NULL, BUF_ENTRIES * BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return false;
+    bufBase = static_cast<unsigned char*>(base);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(bufRing);
+    reg.ring_entries = BUF_ENTRIES;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+
+    for (unsigned bid = 0; bid < BUF_ENTRIES; ++bid)
+        recycleBuffer(static_cast<unsigned short>(bid));
+    publishBuffers();
+    return true;
+}
+
+/* The ring tail overlays bufs[0].resv, so only addr/len/bid are written here. */
+void UringReactor::recycleBuffer(unsigned short bid) {
+    io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(bufRing);
+    io_uring_buf* b = &bufs[bufTail & (BUF_ENTRIES - 1)];
+    b->addr = reinterpret_cast<uintptr_t>(bufBase + static_cast<size_t>(bid) * BUF_SIZE);
+    b->len = BUF_SIZE;
+    b->bid = bid;
+    ++bufTail;
+}
+
+void UringReactor::publishBuffers() {
+    unsigned short* tail = reinterpret_cast<unsigned short*>(bufRing + offsetof(io_uring_buf, resv));
+    __atomic_store_n(tail, bufTail, __ATOMIC_RELEASE);
+}
+
+io_uring_sqe* UringReactor::nextSqe() {
+    if (localTail - loadAcquire(sqHead) >= sqEntries) {
+        /* Ring full: hand what we have to the kernel first. */
+        if (enter(toSubmit, 0, 0) < 0 && errno != EINTR && errno != EBUSY)
+            return NULL;
+        if (localTail - loadAcquire(sqHead) >= sqEntries)
+            return NULL;
+    }
+    unsigned idx = localTail & *sqMask;
+    io_uring_sqe* sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[idx] = idx;
+    ++localTail;
+    ++toSubmit;
+    storeRelease(sqTail, localTail);
+    return sqe;
+}
+
+int UringReactor::enter(unsigned submit, unsigned minComplete, int timeoutMs) {
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void* argp = NULL;
+    size_t argSize = 0;
+    if (minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0) {
+            memset(&arg, 0, sizeof(arg));
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+            arg.ts = reinterpret_cast<uintptr_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof(arg);
+        }
+    }
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, submit, minComplete, flags, argp, argSize));
+    if (ret >= 0)
+        toSubmit -= static_cast<unsigned>(ret) < toSubmit ? static_cast<unsigned>(ret) : toSubmit;
+    return ret;
+}
+
+unsigned UringReactor::genOf(int fd) {
+    if (static_cast<size_t>(fd) >= generation.size())
+        generation.resize(fd + 1, 0);
+    return generation[fd];
+}
+
+unsigned char& UringReactor::recvStateOf(int fd) {
+    if (static_cast<size_t>(fd) >= recvState.size())
+        recvState.resize(fd + 1, 0);
+    return recvState[fd];
+}
+
+void UringReactor::armAccept(int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = encode(OP_ACCEPT, fd, genOf(fd));
+}
+
+void UringReactor::armAcceptLater(int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uintptr_t>(&acceptBackoff);
+    sqe->len = 1;
+    sqe->user_data = encode(OP_TIMEOUT, fd, genOf(fd));
+}
+
+void UringReactor::armRecv(int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->ioprio = multishotRecv ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = encode(OP_RECV, fd, genOf(fd));
+    recvStateOf(fd) |= RECV_ARMED;
+}
+
+void UringReactor::armPoll(int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = encode(OP_POLL, fd, genOf(fd));
+}
+
+bool UringReactor::add(int fd, unsigned interest) {
+    (void)interest;
+    armPoll(fd);
+    return true;
+}
+
+/* Writes go through send(), so only read interest means anything here. A
+   paused connection's recv is cancelled by its user_data, which leaves its
+   sends alone; data that was already received still comes out. */
+bool UringReactor::modify(int fd, unsigned interest) {
+    if (fd < 0)
+        return false;
+    unsigned char& state = recvStateOf(fd);
+    if (!(interest & REACTOR_READ)) {
+        if (state & RECV_PAUSED)
+            return true;
+        state |= RECV_PAUSED;
+        if (state & RECV_ARMED)
+            cancel(encode(OP_RECV, fd, genOf(fd)));
+        return true;
+    }
+    if (state & RECV_PAUSED) {
+        state &= ~RECV_PAUSED;
+        if (!(state & RECV_ARMED))
+            armRecv(fd);
+    }
+    return true;
+}
+
+void UringReactor::cancel(uint64_t userData) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = userData;
+    sqe->user_data = OP_CANCEL;
+}
+
+/* A send in flight keeps going with the owner's queue moved into it. Without
+   cancel-by-fd every request of the fd is cancelled by its user_data, which
+   all carry the generation being retired here. */
+void UringReactor::remove(int fd) {
+    if (fd < 0)
+        return;
+    unsigned gen = genOf(fd);
+    generation[fd] = (gen + 1) & 0xffffff;
+    recvStateOf(fd) = 0;
+    SendOp* op = static_cast<size_t>(fd) < sendOf.size() ? sendOf[fd] : NULL;
+    if (op) {
+        op->queue->moveTo(op->pinned);
+        op->queue = NULL;
+        sendOf[fd] = NULL;
+    }
+    if (cancelByFd) {
+        io_uring_sqe* sqe = nextSqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = OP_CANCEL;
+        }
+    } else {
+        cancel(encode(OP_RECV, fd, gen));
+        cancel(encode(OP_POLL, fd, gen));
+        cancel(encode(OP_ACCEPT, fd, gen));
+        cancel(encode(OP_TIMEOUT, fd, gen));
+        if (op)
+            cancel(reinterpret_cast<uintptr_t>(op) | OP_SEND);
+    }
+    /* Submit now: the kernel resolves the fd at issue time and the caller
+       closes it right after, so a deferred cancel could hit a reused fd. */
+    enter(toSubmit, 0, 0);
+}
+
+bool UringReactor::addListener(int fd) {
+    armAccept(fd);
+    return true;
+}
+
+bool UringReactor::addConnection(int fd) {
+    armRecv(fd);
+    return true;
+}
+
+bool UringReactor::completesIo() const { return true; }
+
+/* Up to SEND_IOV segments go out per SENDMSG; the owner sends the rest once
+   this one completes and it has consumed what went out. The owner keeps one
+   send in flight per fd, so the pool only grows with the connections that
+   are writing at once; after that a send allocates nothing. */
+bool UringReactor::send(int fd, SendQueue& queue) {
+    if (queue.empty())
+        return false;
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return false;
+    SendOp* op = new (sendPool.allocate()) SendOp;
+    int count = queue.fillIov(op->iov, SEND_IOV);
+    op->fd = fd;
+    op->queue = &queue;
+    memset(&op->msg, 0, sizeof(op->msg));
+    op->msg.msg_iov = op->iov;
+    op->msg.msg_iovlen = count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&op->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uintptr_t>(op) | OP_SEND;
+
+    op->prev = NULL;
+    op->next = sends;
+    if (sends)
+        sends->prev = op;
+    sends = op;
+    if (static_cast<size_t>(fd) >= sendOf.size())
+        sendOf.resize(fd + 1, NULL);
+    sendOf[fd] = op;
+    return true;
+}
+
+void UringReactor::finishSend(SendOp* op) {
+    if (op->prev)
+        op->prev->next = op->next;
+    else
+        sends = op->next;
+    if (op->next)
+        op->next->prev = op->prev;
+    if (op->queue && sendOf[op->fd] == op)
+        sendOf[op->fd] = NULL;
+    op->~SendOp(); // a queue taken over by remove() lets go of its chunks and buffers here
+    sendPool.release(op);
+}
+
+int UringReactor::wait(std::vector<ReactorEvent>& ready, int timeoutMs) {
+    ready.clear();
+    if (!handedOut.empty()) {
+        for (size_t i = 0; i < handedOut.size(); ++i)
+            recycleBuffer(handedOut[i]);
+        handedOut.clear();
+        publishBuffers();
+    }
+    bool haveCqes = loadAcquire(cqTail) != *cqHead;
+    if (toSubmit > 0 || !haveCqes) {
+        int ret = enter(toSubmit, haveCqes ? 0 : 1, timeoutMs);
+        if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+            return -1;
+        if (ret < 0 && errno == EINTR && loadAcquire(cqTail) == *cqHead)
+            return -1;
+    }
+
+    std::vector<int> rearmRecv;
+    unsigned head = *cqHead;
+    unsigned tail = loadAcquire(cqTail);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        uint64_t data = cqe.user_data;
+        unsigned op = opOf(data);
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+        if (op == OP_SEND) {
+            SendOp* s = reinterpret_cast<SendOp*>(static_cast<uintptr_t>(data & ~static_cast<uint64_t>(7)));
+            if (s->queue) {
+                if (cqe.res < 0)
+                    ready.push_back(makeEvent(s->fd, REACTOR_SENT | REACTOR_ERROR, 0, NULL));
+                else
+                    ready.push_back(makeEvent(s->fd, REACTOR_SENT, cqe.res, NULL));
+            }
+            finishSend(s);
+            continue;
+        }
+        if (op == OP_CANCEL)
+            continue;
+
+        int fd = fdOf(data);
+        bool stale = genOf(fd) != genOfData(data);
+        if (op == OP_RECV) {
+            if (!stale && !more)
+                recvStateOf(fd) &= ~RECV_ARMED;
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                unsigned short bid = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                handedOut.push_back(bid);
+                if (!stale && cqe.res >= 0)
+                    ready.push_back(makeEvent(fd, REACTOR_DATA, cqe.res,
+                                              reinterpret_cast<const char*>(bufBase + static_cast<size_t>(bid) * BUF_SIZE)));
+            } else if (stale) {
+                continue;
+            } else if (cqe.res == 0) {
+                ready.push_back(makeEvent(fd, REACTOR_DATA, 0, NULL));
+            } else if (cqe.res == -ECANCELED) {
+                continue; /* paused by modify() */
+            } else if (cqe.res == -ENOBUFS) {
+                rearmRecv.push_back(fd); /* ring ran dry; buffers come back on the next wait() */
+            } else if (cqe.res == -EINVAL && multishotRecv) {
+                multishotRecv = false; /* kernel without multishot recv: one SQE per read */
+                rearmRecv.push_back(fd);
+            } else if (cqe.res < 0) {
+                ready.push_back(makeEvent(fd, REACTOR_DATA | REACTOR_ERROR, cqe.res, NULL));
+            }
+            if (!stale && !more && cqe.res > 0)
+                rearmRecv.push_back(fd);
+        } else if (op == OP_ACCEPT) {
+            if (stale) {
+                if (cqe.res >= 0)
+                    close(cqe.res);
+                continue;
+            }
+            if (cqe.res >= 0) {
+                ready.push_back(makeEvent(fd, REACTOR_ACCEPT, cqe.res, NULL));
+            } else if ((cqe.res == -EMFILE || cqe.res == -ENFILE) && !more) {
+                /* The kernel takes the descriptor before looking at the queue, so
+                   a new accept would fail at once even with nothing queued: the
+                   owner sheds what is queued and accept comes back after a pause. */
+                ready.push_back(makeEvent(fd, REACTOR_ACCEPT | REACTOR_ERROR, cqe.res, NULL));
+                armAcceptLater(fd);
+                continue;
+            }
+            if (!more)
+                armAccept(fd);
+        } else if (op == OP_TIMEOUT) {
+            if (!stale)
+                armAccept(fd);
+        } else if (op == OP_POLL) {
+            if (stale)
+                continue;
+            if (cqe.res > 0)
+                ready.push_back(makeEvent(fd, REACTOR_READ, 0, NULL));
+            if (!more)
+                armPoll(fd);
+        }
+    }
+    storeRelease(cqHead, head);
+
+    for (size_t i = 0; i < rearmRecv.size(); ++i) {
+        unsigned char state = recvStateOf(rearmRecv[i]);
+        if (!(state & (RECV_ARMED | RECV_PAUSED)))
+            armRecv(rearmRecv[i]);
+    }
+    return static_cast<int>(ready.size());
+}
+
+const char* UringReactor::name() const { return "io_uring"; }
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Reactor.hpp"
+#include "SendQueue.hpp"
+#include "Pool.hpp"
+#include <sys/socket.h>
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define IRC_HAVE_URING 1
+# endif
+#endif
+
+#ifdef IRC_HAVE_URING
+
+#include <linux/io_uring.h>
+
+/* Completion backend around io_uring, driven through the raw syscalls.
+   - listeners use multishot accept, so one SQE keeps accepting; out of
+     descriptors, the owner is told to shed and accept is re-armed by a timeout;
+   - connections use multishot recv into a kernel-provided buffer ring,
+     the data is handed out as REACTOR_DATA events (valid until next wait());
+   - modify() without REACTOR_READ cancels a connection's recv, and it is
+     armed again when read interest comes back;
+   - sends are one SENDMSG over the caller's SendQueue segments, no copy,
+     from a pooled SendOp; remove() moves a queue with a send in flight into
+     the SendOp, which keeps the chunks and BufferRefs alive until the CQE
+     arrives;
+   - other descriptors (mailbox eventfd) are watched with multishot poll.
+   A busy tick costs one io_uring_enter() that both submits and reaps. */
+class UringReactor : public Reactor {
+public:
+    UringReactor();
+    ~UringReactor();
+    bool isValid() const;
+
+    bool add(int fd, unsigned interest);
+    bool modify(int fd, unsigned interest);
+    void remove(int fd);
+    int wait(std::vector<ReactorEvent>& ready, int timeoutMs);
+    const char* name() const;
+
+    bool addListener(int fd);
+    bool addConnection(int fd);
+    bool completesIo() const;
+    bool send(int fd, SendQueue& queue);
+
+private:
+    enum { SEND_IOV = 256 };
+
+    struct SendOp {
+        int fd;
+        SendQueue* queue;  /* the owner's queue, NULL once remove() took it over */
+        SendQueue pinned;  /* what remove() took over, freed with the op */
+        msghdr msg;
+        iovec iov[SEND_IOV];
+        SendOp* prev;      /* every op in flight, see `sends` */
+        SendOp* next;
+    };
+
+    int ringFd;
+    bool valid;
+    bool multishotRecv;
+    bool cancelByFd;  /* IORING_ASYNC_CANCEL_FD, 5.19 and later */
+
+    unsigned char* sqRing;
+    unsigned char* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    unsigned localTail;   /* SQEs prepared but not yet published */
+    unsigned toSubmit;
+
+    unsigned char* bufRing;   /* io_uring_buf ring shared with the kernel */
+    unsigned char* bufBase;   /* the buffers themselves */
+    unsigned short bufTail;
+    std::vector<unsigned short> handedOut; /* buffers lent to the caller since the last wait() */
+
+    std::vector<unsigned> generation; /* per fd, bumped on remove() to drop stale completions */
+    std::vector<unsigned char> recvState; /* per fd, RECV_ARMED | RECV_PAUSED */
+    std::vector<SendOp*> sendOf; /* per fd, the send in flight for its current owner */
+    SendOp* sends; /* all SendOps in flight, including those of removed fds */
+    FixedPool sendPool; /* SendOps; as many as were ever in flight at once */
+    __kernel_timespec acceptBackoff; /* read by the kernel when a timeout SQE is submitted */
+
+    bool setupRing();
+    bool setupBufferRing();
+    io_uring_sqe* nextSqe();
+    int enter(unsigned submit, unsigned minComplete, int timeoutMs);
+    void recycleBuffer(unsigned short bid);
+    void publishBuffers();
+    unsigned genOf(int fd);
+    unsigned char& recvStateOf(int fd);
+    void armAccept(int fd);
+    void armAcceptLater(int fd);
+    void armRecv(int fd);
+    void armPoll(int fd);
+    bool probeCancelByFd();
+    void cancel(uint64_t userData);
+    void finishSend(SendOp* op);
+
+    UringReactor(const UringReactor&);
+    UringReactor& operator=(const UringReactor&);
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "HandlerBench.hpp"
+#include "TimerWheel.hpp"
+#include "Log.hpp"
+
+/* handlerbench: ns/op and allocations/op of the command handlers at a few
+   client/member counts, without sockets. Logging is set to errors only so
+   the handlers' INFO lines are not part of what is measured.
+   `handlerbench threads` runs several shards on their own threads instead,
+   see HandlerBench::scaling(); `handlerbench framer`, `parse` and `replies`
+   time LineFramer, the parser with the command switch and the numeric reply
+   builder on their own.
+   `handlerbench allocs`, `timers` and `sendq` are checks rather than
+   benchmarks: they fail when a hot handler allocates at all, when the
+   timer wheel fires a timer early, late, twice or after it was cancelled,
+   or when a client that does not read is not dropped at its sendq limit
+   with every queued byte given back. */
+
+/* Per thread, so counting does not put a shared cache line under every
+   allocation of the threads mode. */
+static __thread unsigned long allocations = 0;
+
+/* Shards of the multi-shard case of `handlerbench allocs`. */
+static const size_t ALLOC_SHARDS = 4;
+
+unsigned long allocationCount() {
+    return allocations;
+}
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    ++allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+void operator delete[](void* p) throw() {
+    free(p);
+}
+
+static void print(size_t scale, const HandlerBench::Result& result) {
+    printf("%-18s %8lu %10lu %12.1f %10.2f %12.1f\n", result.name, static_cast<unsigned long>(scale), result.ops,
+           result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+}
+
+/* For the micro-benchmarks, where one op is a line rather than a command. */
+static void printRate(const HandlerBench::Result& result) {
+    printf("%-18s %10lu %10.1f %14.0f %10.2f %10.1f\n", result.name, result.ops, result.nsPerOp,
+           1e9 / result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+}
+
+static void printRateHeader() {
+    printf("%-18s %10s %10s %14s %10s %10s\n", "case", "ops", "ns/op", "ops/s", "allocs/op", "bytes/op");
+}
+
+static int usage() {
+    std::cerr << "Usage: ./handlerbench [members ...]         (each at least 3; default 10 1000 50000)\n"
+                 "       ./handlerbench threads [max [members]] (PRIVMSG with 1, 2, 4 ... max shards; default 4 100)\n"
+                 "       ./handlerbench framer                  (lines/s through LineFramer)\n"
+                 "       ./handlerbench parse                   (lines/s parsed and dispatched, mixed commands)\n"
+                 "       ./handlerbench replies                 (numeric replies/s into a send queue)\n"
+                 "       ./handlerbench allocs [members ...]    (fails if a hot handler allocates; default 10 1000)\n"
+                 "       ./handlerbench timers                  (TimerWheel against a fake clock)\n"
+                 "       ./handlerbench sendq [bytes ...]       (a reader that never reads is dropped; default 8192 65536 1048576)"
+              << std::endl;
+    return 1;
+}
+
+/* Aggregate PRIVMSG throughput as shards are added. Every shard sends to a
+   channel of its own; "local" keeps each channel's members on its shard,
+   "spread" puts them on all shards, so lines cross the mailboxes. */
+static int runThreads(int argc, char** argv) {
+    long maxThreads = argc > 2 ? atol(argv[2]) : 4;
+    long members = argc > 3 ? atol(argv[3]) : 100;
+    if (maxThreads < 1 || members < 1)
+        return usage();
+    printf("%-8s %8s %8s %12s %12s %14s\n", "layout", "threads", "members", "ops", "cmds/s", "lines/s");
+    for (int spread = 0; spread < 2; ++spread) {
+        for (long threads = 1; threads <= maxThreads; threads *= 2) {
+            HandlerBench::Scaling result =
+                HandlerBench::scaling(static_cast<size_t>(threads), static_cast<size_t>(members), spread != 0, 1.0);
+            printf("%-8s %8lu %8ld %12lu %12.0f %14.0f\n", spread ? "spread" : "local",
+                   static_cast<unsigned long>(result.threads), members, result.ops, result.opsPerSec, result.linesPerSec);
+        }
+    }
+    return 0;
+}
+
+/* PRIVMSG to a channel, which used to copy the whole member map per
+   recipient check, KICK, which copied it twice, PRIVMSG to a nick and
+   WHOIS must not allocate once the pools are warm: each is run once to warm
+   up and then counted. A member-map copy costs one allocation per member,
+   so zero allocations also means zero copies. Each scale runs on one shard
+   and again on ALLOC_SHARDS, where most members get the line through their
+   shard's mailbox. */
+static int runAllocations(int argc, char** argv) {
+    std::vector<size_t> scales;
+    for (int i = 2; i < argc; ++i) {
+        long scale = atol(argv[i]);
+        if (scale < 3)
+            return usage();
+        scales.push_back(static_cast<size_t>(scale));
+    }
+    if (scales.empty()) {
+        scales.push_back(10);
+        scales.push_back(1000);
+    }
+    typedef HandlerBench::Result (HandlerBench::*Case)();
+    const Case cases[] = { &HandlerBench::channelMessage, &HandlerBench::kick, &HandlerBench::privateMessage,
+                           &HandlerBench::whois };
+    const size_t shardCounts[] = { 1, ALLOC_SHARDS };
+    int failed = 0;
+    printf("%-18s %8s %6s %10s %12s %8s\n", "handler", "members", "shards", "ops", "allocations", "");
+    for (size_t i = 0; i < scales.size(); ++i) {
+        for (size_t s = 0; s < sizeof(shardCounts) / sizeof(shardCounts[0]); ++s) {
+            HandlerBench bench(scales[i], shardCounts[s]);
+            for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+                (bench.*cases[c])();
+                HandlerBench::Result result = (bench.*cases[c])();
+                printf("%-18s %8lu %6lu %10lu %12lu %8s\n", result.name, static_cast<unsigned long>(scales[i]),
+                       static_cast<unsigned long>(shardCounts[s]), result.ops, result.allocations,
+                       result.allocations == 0 ? "ok" : "FAILED");
+                failed += result.allocations != 0;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+/* One scenario of runTimers(): `count` timers armed at time 0, every
+   `cancelEvery`th one cancelled right away, and then the clock driven the
+   way Shard::run() does, sleeping exactly timeoutMs() each time, or in
+   fixed `stepMs` jumps when that is not 0 (a loop that overslept). */
+static bool checkTimers(const char* name, const std::vector<unsigned long>& delays, size_t cancelEvery,
+                        unsigned long stepMs) {
+    TimerWheel wheel;
+    std::vector<TimerNode> nodes(delays.size());
+    std::vector<unsigned long> firedAt(delays.size(), 0);
+    std::vector<int> fired(delays.size(), 0);
+    size_t live = 0;
+    for (size_t i = 0; i < delays.size(); ++i) {
+        nodes[i].owner = static_cast<int>(i);
+        wheel.arm(nodes[i], delays[i]);
+        if (cancelEvery && i % cancelEvery == 0)
+            wheel.cancel(nodes[i]);
+        else
+            ++live;
+    }
+    bool ok = wheel.size() == live;
+
+    unsigned long now = 0;
+    unsigned long wakeups = 0;
+    for (int timeout = wheel.timeoutMs(); timeout >= 0 && ok; timeout = wheel.timeoutMs()) {
+        unsigned long last = now;
+        now += stepMs ? stepMs : static_cast<unsigned long>(timeout);
+        wheel.advanceTo(now);
+        ++wakeups;
+        for (TimerNode* node; (node = wheel.popExpired()) != NULL;) {
+            ++fired[node->owner];
+            firedAt[node->owner] = now;
+        }
+        /* Nothing may have been due before the time the wheel asked to wake at. */
+        for (size_t i = 0; i < delays.size() && !stepMs; ++i) {
+            if (fired[i] && firedAt[i] == now && delays[i] + TimerWheel::TICK_MS <= last)
+                ok = false;
+        }
+    }
+
+    size_t early = 0, late = 0, wrongCount = 0;
+    for (size_t i = 0; i < delays.size(); ++i) {
+        bool cancelled = cancelEvery && i % cancelEvery == 0;
+        if (fired[i] != (cancelled ? 0 : 1)) {
+            ++wrongCount;
+            continue;
+        }
+        if (cancelled)
+            continue;
+        unsigned long slack = stepMs ? stepMs : 0;
+        if (firedAt[i] < delays[i])
+            ++early;
+        else if (firedAt[i] >= delays[i] + TimerWheel::TICK_MS + slack)
+            ++late;
+    }
+    ok = ok && early == 0 && late == 0 && wrongCount == 0 && wheel.size() == 0;
+    printf("%-22s %8lu %8lu %8lu %8lu %8lu %8s\n", name, static_cast<unsigned long>(delays.size()), wakeups,
+           static_cast<unsigned long>(early), static_cast<unsigned long>(late), static_cast<unsigned long>(wrongCount),
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/* TimerWheel with a fake clock (TimerWheel::advanceTo()): timers on every
+   level of the wheel, cancels, re-arms and an oversleeping loop. A timer
+   must fire once, not before its delay and less than one TICK_MS after it
+   (plus the step when the loop oversleeps); a cancelled one never. */
+static int runTimers() {
+    printf("%-22s %8s %8s %8s %8s %8s\n", "scenario", "timers", "wakeups", "early", "late", "count");
+    int failed = 0;
+
+    std::vector<unsigned long> levels;
+    const unsigned long spread[] = { 0, 1, 99, 100, 101, 250, 6399, 6400, 6500, 65000, 409599, 409600, 500000,
+                                     5 * 3600 * 1000UL, 26214400 };
+    levels.assign(spread, spread + sizeof(spread) / sizeof(spread[0]));
+    failed += !checkTimers("every level", levels, 0, 0);
+
+    std::vector<unsigned long> random(2000);
+    unsigned long seed = 12345;
+    for (size_t i = 0; i < random.size(); ++i) {
+        seed = seed * 1103515245UL + 12345UL;
+        random[i] = (seed >> 8) % (2 * 3600 * 1000UL);
+    }
+    failed += !checkTimers("random, 1/5 cancelled", random, 5, 0);
+    failed += !checkTimers("random, 1s steps", random, 0, 1000);
+
+    /* Re-arming moves a timer: it fires once, at the new delay. */
+    TimerWheel wheel;
+    TimerNode node;
+    node.owner = 1;
+    wheel.arm(node, 60000);
+    wheel.arm(node, 300);
+    int fires = 0;
+    unsigned long firstAt = 0;
+    for (unsigned long now = 100; now <= 120000; now += 100) {
+        wheel.advanceTo(now);
+        while (wheel.popExpired()) {
+            if (fires++ == 0)
+                firstAt = now;
+        }
+    }
+    bool rearmed = fires == 1 && firstAt >= 300 && firstAt < 300 + TimerWheel::TICK_MS && wheel.timeoutMs() == -1;
+    printf("%-22s %8d %8s %8s %8s %8d %8s\n", "re-arm", 1, "-", "-", "-", fires, rearmed ? "ok" : "FAILED");
+    failed += !rearmed;
+    return failed ? 1 : 0;
+}
+
+/* HandlerBench::slowReader() at each limit: the reader must be dropped, its
+   queue never above the limit, and the shard's QueueAccount and pools back
+   to nothing once it is gone. */
+static int runSendQueue(int argc, char** argv) {
+    std::vector<size_t> limits;
+    for (int i = 2; i < argc; ++i) {
+        long limit = atol(argv[i]);
+        if (limit < 1024)
+            return usage();
+        limits.push_back(static_cast<size_t>(limit));
+    }
+    if (limits.empty()) {
+        limits.push_back(8192);
+        limits.push_back(65536);
+        limits.push_back(1048576);
+    }
+
+    printf("%10s %8s %8s %10s %8s %8s %8s %8s %8s\n", "sendq", "lines", "dropped", "peak", "queued", "chunks",
+           "segments", "buffers", "");
+    int failed = 0;
+    for (size_t i = 0; i < limits.size(); ++i) {
+        HandlerBench::SlowReader result = HandlerBench::slowReader(limits[i]);
+        bool ok = result.dropped && result.peak <= limits[i] && result.queued == 0 && result.chunks == 0 &&
+                  result.segments == 0 && result.buffers == 0;
+        printf("%10lu %8lu %8s %10lu %8lu %8lu %8lu %8lu %8s\n", static_cast<unsigned long>(limits[i]), result.lines,
+               result.dropped ? "yes" : "no", result.peak, result.queued, result.chunks, result.segments,
+               result.buffers, ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    Log::setLevel(LOG_LEVEL_ERROR);
+    if (argc > 1 && std::string(argv[1]) == "threads")
+        return runThreads(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "allocs")
+        return runAllocations(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "timers")
+        return runTimers();
+    if (argc > 1 && std::string(argv[1]) == "sendq")
+        return runSendQueue(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "framer") {
+        printRateHeader();
+        printRate(HandlerBench::framer());
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "parse") {
+        printRateHeader();
+        printRate(HandlerBench::parse());
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "replies") {
+        printRateHeader();
+        printRate(HandlerBench::replies());
+        return 0;
+    }
+
+    std::vector<size_t> scales;
+    for (int i = 1; i < argc; ++i) {
+        long scale = atol(argv[i]);
+        if (scale < 3)
+            return usage();
+        scales.push_back(static_cast<size_t>(scale));
+    }
+    if (scales.empty()) {
+        scales.push_back(10);
+        scales.push_back(1000);
+        scales.push_back(50000);
+    }
+
+    printf("%-18s %8s %10s %12s %10s %12s\n", "handler", "members", "ops", "ns/op", "allocs/op", "bytes/op");
+    for (size_t i = 0; i < scales.size(); ++i) {
+        HandlerBench bench(scales[i]);
+        print(scales[i], bench.join());
+        print(scales[i], bench.channelMessage());
+        print(scales[i], bench.privateMessage());
+        print(scales[i], bench.mode());
+        print(scales[i], bench.kick());
+        print(scales[i], bench.whois());
+    }
+    return 0;
+}
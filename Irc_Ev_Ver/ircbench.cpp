@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "Bench.hpp"
+
+/* ircbench: load generator and latency benchmark for ircserv.
+   Prints one JSON object with the results (stdout or --output), progress
+   goes to stderr. The server's flood control applies to the simulated
+   clients too: keep --rate under flood_rate or set flood_rate 0. */
+
+static void usage() {
+    std::cerr << "Usage: ./ircbench [options]\n"
+                 "  --scenario NAME      load; storm: connect everything at once and stop;\n"
+                 "                       churn: QUIT and reconnect instead of sending (load)\n"
+                 "  --host ADDR          server address (127.0.0.1)\n"
+                 "  --port N             server port (6667)\n"
+                 "  --password PW        connection password (jopa)\n"
+                 "  --clients N          paced clients (1000)\n"
+                 "  --channels N         channels they are spread over (10)\n"
+                 "  --flooders N         extra clients writing PRIVMSGs non-stop (0)\n"
+                 "  --rate R             PRIVMSGs (churn: reconnects) per second per paced client (1)\n"
+                 "  --private P          percent of them sent to a user, not the channel (10)\n"
+                 "  --payload B          bytes of message text (64)\n"
+                 "  --connect-window N   handshakes in progress at once, storm: all (64)\n"
+                 "  --connect-rate R     new connections per second, 0 unlimited (0)\n"
+                 "  --setup-timeout S    seconds for all clients to join (30)\n"
+                 "  --warmup S           seconds of load before measuring (1)\n"
+                 "  --duration S         seconds of measured load (10)\n"
+                 "  --drain S            seconds to wait for late deliveries (2)\n"
+                 "  --seed N             random seed for targets and send phases (1)\n"
+                 "  --output FILE        write the JSON there instead of stdout\n";
+}
+
+static bool parseInt(const char* value, int min, int& out) {
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < min || n > 1000000)
+        return false;
+    out = static_cast<int>(n);
+    return true;
+}
+
+static bool parseSeconds(const char* value, double& out) {
+    char* end;
+    double n = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || n < 0)
+        return false;
+    out = n;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::string output;
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << flag << " needs a value" << std::endl;
+            return 1;
+        }
+        const char* value = argv[i + 1];
+        bool ok = true;
+        int seed = 0;
+        if (flag == "--scenario") {
+            options.scenario = value;
+            ok = options.scenario == "load" || options.scenario == "storm" || options.scenario == "churn";
+        } else if (flag == "--host")
+            options.host = value;
+        else if (flag == "--port")
+            ok = parseInt(value, 1, options.port) && options.port <= 65535;
+        else if (flag == "--password")
+            options.password = value;
+        else if (flag == "--clients")
+            ok = parseInt(value, 1, options.clients);
+        else if (flag == "--channels")
+            ok = parseInt(value, 1, options.channels);
+        else if (flag == "--flooders")
+            ok = parseInt(value, 0, options.flooders);
+        else if (flag == "--rate")
+            ok = parseSeconds(value, options.rate);
+        else if (flag == "--private")
+            ok = parseInt(value, 0, options.privatePercent) && options.privatePercent <= 100;
+        else if (flag == "--payload")
+            ok = parseInt(value, 0, options.payload) && options.payload <= 400;
+        else if (flag == "--connect-window")
+            ok = parseInt(value, 1, options.connectWindow);
+        else if (flag == "--connect-rate")
+            ok = parseSeconds(value, options.connectRate);
+        else if (flag == "--setup-timeout")
+            ok = parseSeconds(value, options.setupTimeout);
+        else if (flag == "--warmup")
+            ok = parseSeconds(value, options.warmup);
+        else if (flag == "--duration")
+            ok = parseSeconds(value, options.duration);
+        else if (flag == "--drain")
+            ok = parseSeconds(value, options.drain);
+        else if (flag == "--seed") {
+            ok = parseInt(value, 0, seed);
+            options.seed = seed;
+        } else if (flag == "--output")
+            output = value;
+        else {
+            std::cerr << "Error: unknown option " << flag << std::endl;
+            usage();
+            return 1;
+        }
+        if (!ok) {
+            std::cerr << "Error: invalid value '" << value << "' for " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    Bench bench(options);
+    if (!bench.run())
+        return 1;
+    if (output.empty()) {
+        bench.writeJson(std::cout);
+        return 0;
+    }
+    std::ofstream file(output.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot write " << output << std::endl;
+        return 1;
+    }
+    bench.writeJson(file);
+    return 0;
+}
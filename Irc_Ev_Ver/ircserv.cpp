@@ -3,6 +3,7 @@
 #include <string>
 #include "Server.hpp"
 #include "Config.hpp"
+#include "Log.hpp"
 
 bool is_valid_number(const char* str) {
     if (!str || str[0] == '\0')
@@ -15,8 +16,8 @@ bool is_valid_number(const char* str) {
 }
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        std::cerr << "Usage: ./ircserv <port> <password>" << std::endl;
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: ./ircserv <port> <password> [options-file]" << std::endl;
         return 1;
     }
 
@@ -36,19 +37,27 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    std::cout << "Starting IRC server on port " << port << " with password: " << password << std::endl;
+    Log::start();
+    LOG_INFO("Starting IRC server on port " << port << " with password: " << password);
 
+    int status = 0;
     try {
         Config config(port, password);
+        if (argc == 4) {
+            config.loadOptions(argv[3]);
+        }
+        Log::setLevel(config.getLogLevel());
         Server server(config);
         if (!server.initialize()) {
-            return 1;
+            status = 1;
+        } else {
+            server.run();
         }
-        server.run();
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+        LOG_ERROR(e.what());
+        status = 1;
     }
 
-    return 0;
+    Log::stop();
+    return status;
 }
\ No newline at end of file